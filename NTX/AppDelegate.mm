@@ -11,6 +11,7 @@
 #import "ToolkitProtocolController.h"
 #import "Preferences.h"
 #import "Utilities.h"
+#import "MappedFilePipe.h"
 #import "NTK/Pipes.h"
 #import "NTK/Globals.h"
 
@@ -68,8 +69,7 @@ extern void PrintCode(RefArg inFunc);
 //						 InstallScript:<function, 0 args, #03C7A4CD> }
 // we just need to call the InstallScript
 	path = [NSBundle.mainBundle URLForResource:@"EditorCommands" withExtension:@""];
-	CStdIOPipe pipe(path.fileSystemRepresentation, "r");
-	RefVar obj(UnflattenRef(pipe));
+	RefVar obj(UnflattenFile(path.fileSystemRepresentation));
 	DoMessage(obj, MakeSymbol("InstallScript"), RA(NILREF));
 
 // compile/execute GlobalData and GlobalFunctions files
@@ -246,8 +246,7 @@ extern void PrintCode(RefArg inFunc);
 
 	//	stream in platform file definitions
 	NSURL * path = [NSBundle.mainBundle URLForResource:inPlatform withExtension:nil subdirectory:@"Platforms"];
-	CStdIOPipe pipe(path.fileSystemRepresentation, "r");
-	RefVar platform(UnflattenRef(pipe));
+	RefVar platform(UnflattenFile(path.fileSystemRepresentation));
 
 	// set global __platform frame
 	installerFrame = GetFrameSlot(platform, MakeSymbol("installer"));
@@ -0,0 +1,37 @@
+/*
+	File:		BatchImporter.h
+
+	Contains:	Batch conversion of legacy Mac NTK projects.
+					Finds every Mac NTK project in a folder tree and writes an NTX
+					project for each to a matching tree in the destination folder.
+					A pool of workers maps and reads the projects -- forks, items,
+					settings -- and posts each to the main queue, where the main
+					thread, which owns the NewtonScript heap, turns it into a project
+					frame. There is only one NewtonScript heap, so that stage cannot
+					itself run in parallel; but the main run loop keeps running
+					throughout.
+					A report gives the time taken, and any failure, per project, and
+					overall throughput.
+
+	Run by NTXBenchmarks, which takes the folders from the environment.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <Foundation/Foundation.h>
+
+
+/* -----------------------------------------------------------------------------
+	N T X B a t c h I m p o r t e r
+----------------------------------------------------------------------------- */
+
+@interface NTXBatchImporter : NSObject
+
+@property(nonatomic,readonly) NSURL * sourceURL;
+@property(nonatomic,readonly) NSURL * destinationURL;
+@property(nonatomic,assign) NSUInteger numOfWorkers;		// defaults to the number of active processors
+
+- (id)initWithSource:(NSURL *)inSource destination:(NSURL *)inDestination;
+- (void)runWithCompletion:(void (^)(NSDictionary * inReport))inCompletion;		// call on the main thread
+
+@end
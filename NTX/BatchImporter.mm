@@ -0,0 +1,256 @@
+/*
+	File:		BatchImporter.mm
+
+	Contains:	Batch conversion of legacy Mac NTK projects.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "BatchImporter.h"
+#import "MacRsrcProject.h"
+#import "MappedFilePipe.h"
+
+
+/* -----------------------------------------------------------------------------
+	N T X B a t c h I m p o r t e r
+	Each file in the tree is a job. Workers read jobs and post the results to
+	the main queue, which converts them between its other events.
+	A job record is a dictionary that becomes the project’s entry in the
+	report; until it is converted it also holds the project object, under
+	"project".
+----------------------------------------------------------------------------- */
+
+@interface NTXBatchImporter ()
+{
+	NSMutableArray<NSMutableDictionary *> * _projects;
+	NSUInteger _numOfFiles, _numOfJobsDone, _numOfConverted, _numOfFailed;
+	double _readTime, _convertTime;
+	CFAbsoluteTime _startTime;
+	void (^_completion)(NSDictionary * inReport);
+}
+@end
+
+@implementation NTXBatchImporter
+
+- (id)initWithSource:(NSURL *)inSource destination:(NSURL *)inDestination {
+	if (self = [super init]) {
+		_sourceURL = inSource.URLByResolvingSymlinksInPath;
+		_destinationURL = inDestination;
+		_numOfWorkers = NSProcessInfo.processInfo.activeProcessorCount;
+	}
+	return self;
+}
+
+
+/* -----------------------------------------------------------------------------
+	List every regular file in the source tree.
+	AppleDouble ._ files hold resource forks; they are not projects in their
+	own right.
+----------------------------------------------------------------------------- */
+
+- (NSArray<NSURL *> *)candidates {
+	NSMutableArray * files = [[NSMutableArray alloc] init];
+	NSDirectoryEnumerator * iter = [NSFileManager.defaultManager enumeratorAtURL:self.sourceURL
+															includingPropertiesForKeys:@[NSURLIsRegularFileKey]
+																				options:NSDirectoryEnumerationSkipsPackageDescendants
+																		 errorHandler:nil];
+	for (NSURL * url in iter) {
+		NSNumber * isRegularFile;
+		if ([url getResourceValue:&isRegularFile forKey:NSURLIsRegularFileKey error:NULL] && isRegularFile.boolValue
+		&&  ![url.lastPathComponent hasPrefix:@"._"]) {
+			[files addObject:url.URLByResolvingSymlinksInPath];
+		}
+	}
+	return files;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read a project. Runs on a worker.
+	Args:		inURL			file that may be a project
+	Return:	job record
+----------------------------------------------------------------------------- */
+
+- (NSMutableDictionary *)read:(NSURL *)inURL {
+	NSString * path = [inURL.path substringFromIndex:self.sourceURL.path.length];
+	if ([path hasPrefix:@"/"]) {
+		path = [path substringFromIndex:1];
+	}
+	NSMutableDictionary * job = [NSMutableDictionary dictionaryWithObject:path forKey:@"path"];
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	NTXRsrcProject * project = [[NTXRsrcProject alloc] initWithURL:inURL];
+	if (project == nil) {
+		job[@"status"] = @"skipped";
+	} else {
+		if (![project readItems]) {
+			job[@"warning"] = @"no project settings";
+		}
+		// projects refer to their items by name; report any we can’t find
+		NSMutableArray * missingItems = [[NSMutableArray alloc] init];
+		for (NSDictionary * item in project.items) {
+			NSURL * itemURL = item[@"url"];
+			if (![itemURL checkResourceIsReachableAndReturnError:NULL]) {
+				[missingItems addObject:itemURL.lastPathComponent];
+			}
+		}
+		job[@"items"] = [NSNumber numberWithUnsignedInteger:project.items.count];
+		if (missingItems.count > 0) {
+			job[@"missingItems"] = missingItems;
+		}
+		job[@"project"] = project;
+	}
+	job[@"readMs"] = @((CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+	return job;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Convert a project that has been read, and write it out.
+	Runs on the main thread.
+	Args:		ioJob			job record
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)convert:(NSMutableDictionary *)ioJob {
+	NTXRsrcProject * project = ioJob[@"project"];
+	[ioJob removeObjectForKey:@"project"];
+
+	NSURL * projectURL = [self.destinationURL URLByAppendingPathComponent:ioJob[@"path"]];
+	if ([projectURL.pathExtension caseInsensitiveCompare:@"ntk"] == NSOrderedSame) {
+		projectURL = projectURL.URLByDeletingPathExtension;
+	}
+	projectURL = [projectURL URLByAppendingPathExtension:@"newtonproj"];
+	NSError *__autoreleasing error = nil;
+	if (![NSFileManager.defaultManager createDirectoryAtURL:projectURL.URLByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:&error]) {
+		ioJob[@"status"] = @"failed";
+		ioJob[@"error"] = error.localizedDescription;
+		return;
+	}
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	NewtonErr err = noErr;
+	newton_try
+	{
+		// a destination we can’t write fails this project, not the batch
+		RefVar proj(project.projectRef);
+		FlattenToFile(proj, projectURL.fileSystemRepresentation);
+	}
+	newton_catch_all
+	{
+		err = (NewtonErr)(long)CurrentException()->data;
+	}
+	end_try;
+	ioJob[@"convertMs"] = @((CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+
+	if (err) {
+		ioJob[@"status"] = @"failed";
+		ioJob[@"error"] = [NSString stringWithFormat:@"NewtonScript error %d", err];
+	} else {
+		ioJob[@"status"] = @"converted";
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Convert all the projects in the source tree.
+	Returns at once; the main run loop must keep running for the conversion
+	to complete.
+	Args:		inCompletion	called on the main thread with the report
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)runWithCompletion:(void (^)(NSDictionary * inReport))inCompletion {
+	NSAssert(NSThread.isMainThread, @"NewtonScript objects must be created on the main thread");
+
+	_startTime = CFAbsoluteTimeGetCurrent();
+	_projects = [[NSMutableArray alloc] init];
+	_numOfJobsDone = _numOfConverted = _numOfFailed = 0;
+	_readTime = _convertTime = 0.0;
+	_completion = inCompletion;
+
+	NSArray<NSURL *> * files = self.candidates;
+	_numOfFiles = files.count;
+	if (_numOfFiles == 0) {
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[self finish];
+		});
+		return;
+	}
+
+	// feed the files to the worker pool, no more than numOfWorkers at once
+	dispatch_queue_t workQueue = dispatch_queue_create("com.newton.import", DISPATCH_QUEUE_CONCURRENT);
+	dispatch_semaphore_t workers = dispatch_semaphore_create(MAX(self.numOfWorkers, 1));
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+		for (NSURL * url in files) {
+			dispatch_semaphore_wait(workers, DISPATCH_TIME_FOREVER);
+			dispatch_async(workQueue, ^{
+				NSMutableDictionary * job = [self read:url];
+				dispatch_semaphore_signal(workers);
+				// convert projects as they are read
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[self jobRead:job];
+				});
+			});
+		}
+	});
+}
+
+
+/* -----------------------------------------------------------------------------
+	Convert a project a worker has read, and account for it.
+	Runs on the main thread.
+	Args:		ioJob			job record
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)jobRead:(NSMutableDictionary *)ioJob {
+	if (ioJob[@"project"] != nil) {
+		[self convert:ioJob];
+		_readTime += [ioJob[@"readMs"] doubleValue];
+		_convertTime += [ioJob[@"convertMs"] doubleValue];
+		if ([ioJob[@"status"] isEqualToString:@"converted"]) {
+			++_numOfConverted;
+		} else {
+			++_numOfFailed;
+		}
+		[_projects addObject:ioJob];
+	}
+	// else not a project
+	if (++_numOfJobsDone == _numOfFiles) {
+		[self finish];
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Make the report and hand it to the completion block.
+	Runs on the main thread.
+----------------------------------------------------------------------------- */
+
+- (void)finish {
+	[_projects sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"path" ascending:YES]]];
+
+	double elapsed = CFAbsoluteTimeGetCurrent() - _startTime;
+	NSDictionary * report = @{ @"source":self.sourceURL.path,
+										@"destination":self.destinationURL.path,
+										@"workers":[NSNumber numberWithUnsignedInteger:self.numOfWorkers],
+										@"filesScanned":[NSNumber numberWithUnsignedInteger:_numOfFiles],
+										@"converted":[NSNumber numberWithUnsignedInteger:_numOfConverted],
+										@"failed":[NSNumber numberWithUnsignedInteger:_numOfFailed],
+										@"seconds":@(elapsed),
+										@"projectsPerSecond":@(elapsed > 0.0 ? _projects.count / elapsed : 0.0),
+										@"readMs":@(_readTime),
+										@"convertMs":@(_convertTime),
+										@"projects":_projects };
+	NSLog(@"Imported %@ of %@ projects from %@ (%@ failed) in %.2fs", report[@"converted"], [NSNumber numberWithUnsignedInteger:_projects.count], self.sourceURL.path, report[@"failed"], elapsed);
+
+	void (^completion)(NSDictionary *) = _completion;
+	_completion = nil;
+	_projects = nil;
+	if (completion) {
+		completion(report);
+	}
+}
+
+@end
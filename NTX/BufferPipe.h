@@ -0,0 +1,59 @@
+/*
+	File:		BufferPipe.h
+
+	Contains:	A pipe that writes into a growable memory buffer.
+					Lets us flatten an object in one pass: there’s no need to call
+					FlattenRefSize() first to find out how big a buffer to allocate.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__BUFFERPIPE_H)
+#define __BUFFERPIPE_H 1
+
+#include "NewtonKit.h"
+
+#define kBufferPipeInitialSize (4*KByte)
+
+
+/* -----------------------------------------------------------------------------
+	C B u f f e r P i p e
+	The buffer doubles as necessary. Bytes written can be read back.
+----------------------------------------------------------------------------- */
+
+class CBufferPipe : public CPipe
+{
+public:
+				CBufferPipe(size_t inSize = kBufferPipeInitialSize);
+				~CBufferPipe();
+
+	long		readSeek(long inOffset, int inSelector);
+	long		readPosition(void) const;
+	long		writeSeek(long inOffset, int inSelector);
+	long		writePosition(void) const;
+	void		readChunk(void * outBuf, size_t & ioSize, bool & outEOF);
+	void		writeChunk(const void * inBuf, size_t inSize, bool inFlush);
+	void		flushRead(void);
+	void		flushWrite(void);
+	void		reset(void);
+	void		overflow();
+	void		underflow(long, bool&);
+
+	void		align(size_t inAlignment);
+	char *	data(void) const;
+	size_t	size(void) const;
+
+private:
+	void		reserve(size_t inSize);
+
+	char *	fBuf;
+	size_t	fAllocSize;
+	size_t	fSize;			// high-water mark of bytes written
+	size_t	fReadOffset;
+	size_t	fWriteOffset;
+};
+
+inline char *	CBufferPipe::data(void) const { return fBuf; }
+inline size_t	CBufferPipe::size(void) const { return fSize; }
+
+#endif	/* __BUFFERPIPE_H */
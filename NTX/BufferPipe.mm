@@ -0,0 +1,161 @@
+/*
+	File:		BufferPipe.mm
+
+	Contains:	A pipe that writes into a growable memory buffer.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "BufferPipe.h"
+#import <stdio.h>
+
+
+/* -----------------------------------------------------------------------------
+	C B u f f e r P i p e
+----------------------------------------------------------------------------- */
+
+CBufferPipe::CBufferPipe(size_t inSize)
+	:	fBuf(NULL), fAllocSize(0), fSize(0), fReadOffset(0), fWriteOffset(0)
+{
+	reserve(inSize);
+}
+
+
+CBufferPipe::~CBufferPipe()
+{
+	if (fBuf)
+		free(fBuf);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Make sure the buffer can hold at least inSize bytes.
+	Grow geometrically so flattening is linear in the size of the result.
+----------------------------------------------------------------------------- */
+
+void
+CBufferPipe::reserve(size_t inSize)
+{
+	if (inSize > fAllocSize) {
+		size_t newSize = fAllocSize > 0 ? fAllocSize : kBufferPipeInitialSize;
+		while (newSize < inSize)
+			newSize *= 2;
+		char * newBuf = (char *)realloc(fBuf, newSize);
+		if (newBuf == NULL)
+			ThrowErr(exPipe, kOSErrNoMemory);
+		fBuf = newBuf;
+		fAllocSize = newSize;
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Pad with zeroes to the given alignment, eg for dock event parameters.
+----------------------------------------------------------------------------- */
+
+void
+CBufferPipe::align(size_t inAlignment)
+{
+	size_t delta = fWriteOffset % inAlignment;
+	if (delta != 0) {
+		ULong padding[2] = { 0, 0 };
+		for (delta = inAlignment - delta; delta > 0; delta -= MIN(delta, sizeof(padding)))
+			writeChunk(padding, MIN(delta, sizeof(padding)), false);
+	}
+}
+
+
+void
+CBufferPipe::writeChunk(const void * inBuf, size_t inSize, bool inFlush)
+{
+	reserve(fWriteOffset + inSize);
+	memcpy(fBuf + fWriteOffset, inBuf, inSize);
+	fWriteOffset += inSize;
+	if (fSize < fWriteOffset)
+		fSize = fWriteOffset;
+}
+
+
+void
+CBufferPipe::readChunk(void * outBuf, size_t & ioSize, bool & outEOF)
+{
+	if (ioSize > fSize - fReadOffset)
+		ioSize = fSize - fReadOffset;
+	memcpy(outBuf, fBuf + fReadOffset, ioSize);
+	fReadOffset += ioSize;
+	outEOF = (fReadOffset >= fSize);
+}
+
+
+static long
+SeekOffset(long inOffset, int inSelector, size_t inPos, size_t inSize)
+{
+	if (inSelector == SEEK_CUR)
+		inOffset += inPos;
+	else if (inSelector == SEEK_END)
+		inOffset += inSize;
+	if (inOffset < 0 || (size_t)inOffset > inSize)
+		ThrowErr(exPipe, kOSErrBadParameters);
+	return inOffset;
+}
+
+
+long
+CBufferPipe::readSeek(long inOffset, int inSelector)
+{
+	fReadOffset = SeekOffset(inOffset, inSelector, fReadOffset, fSize);
+	return fReadOffset;
+}
+
+
+long
+CBufferPipe::readPosition(void) const
+{
+	return fReadOffset;
+}
+
+
+long
+CBufferPipe::writeSeek(long inOffset, int inSelector)
+{
+	fWriteOffset = SeekOffset(inOffset, inSelector, fWriteOffset, fSize);
+	return fWriteOffset;
+}
+
+
+long
+CBufferPipe::writePosition(void) const
+{
+	return fWriteOffset;
+}
+
+
+void
+CBufferPipe::flushRead(void)
+{ }
+
+
+void
+CBufferPipe::flushWrite(void)
+{ }
+
+
+void
+CBufferPipe::reset(void)
+{
+	fSize = fReadOffset = fWriteOffset = 0;
+}
+
+
+void
+CBufferPipe::overflow()
+{
+	reserve(fAllocSize + 1);
+}
+
+
+void
+CBufferPipe::underflow(long inSize, bool & outEOF)
+{
+	outEOF = (fReadOffset >= fSize);
+}
@@ -0,0 +1,33 @@
+/*
+	File:		CommsBenchmark.h
+
+	Contains:	Comms stack benchmarks.
+					Measures CRC16, the page buffer, MNP framing/unframing over an
+					in-memory loopback, and the toolkit protocol end-to-end against
+					the mock Newton -- throughput, per-packet latency percentiles,
+					system calls and heap growth per KB.
+					Payloads are generated from a fixed seed, and results are written
+					as JSON so runs can be compared for regressions.
+
+	Run by NTXBenchmarks.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <Foundation/Foundation.h>
+
+
+/* -----------------------------------------------------------------------------
+	N C C o m m s B e n c h m a r k
+----------------------------------------------------------------------------- */
+
+@interface NCCommsBenchmark : NSObject
+
+@property(nonatomic,assign) unsigned int seed;
+@property(nonatomic,assign) NSUInteger payloadSize;		// bytes through each benchmark
+@property(nonatomic,assign) NSUInteger eventSize;			// bytes per toolkit event
+
+- (NSDictionary *)run;
+- (BOOL)writeResultsTo:(NSURL *)inURL;
+
+@end
@@ -0,0 +1,393 @@
+/*
+	File:		CommsBenchmark.mm
+
+	Contains:	Comms stack benchmarks.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "CommsBenchmark.h"
+#import "MockNewton.h"
+#import "DockErrors.h"
+#import "NewtonKit.h"
+
+#include <mach/mach_time.h>
+#include <malloc/malloc.h>
+#include <poll.h>
+#include <vector>
+#include <algorithm>
+
+#define kDefaultPayloadSize	(1024*1024)
+#define kDefaultEventSize		1024
+#define kPumpTimeout				10		// seconds without progress before we give up
+
+#define kMB							(1024.0*1024.0)
+
+
+/* -----------------------------------------------------------------------------
+	Heap in use, for measuring heap growth.
+	The system doesn’t count allocations as such, so this is the best
+	indication of allocation we can get without instrumenting malloc.
+----------------------------------------------------------------------------- */
+
+static size_t
+HeapInUse(void)
+{
+	malloc_statistics_t stats;
+	malloc_zone_statistics(NULL, &stats);
+	return stats.size_in_use;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Summarise latency samples.
+	Args:		ioSamples		mach_absolute_time() intervals; sorted on return
+				inTimebase		to convert them to nanoseconds
+	Return:	percentiles in microseconds
+----------------------------------------------------------------------------- */
+
+static NSDictionary *
+Percentiles(std::vector<uint64_t> & ioSamples, const mach_timebase_info_data_t & inTimebase)
+{
+	if (ioSamples.empty())
+		return @{};
+	std::sort(ioSamples.begin(), ioSamples.end());
+	double toMicroseconds = (double)inTimebase.numer / inTimebase.denom / 1000.0;
+	size_t last = ioSamples.size() - 1;
+	return @{ @"p50":@(ioSamples[last * 50 / 100] * toMicroseconds),
+				 @"p90":@(ioSamples[last * 90 / 100] * toMicroseconds),
+				 @"p99":@(ioSamples[last * 99 / 100] * toMicroseconds),
+				 @"max":@(ioSamples[last] * toMicroseconds),
+				 @"count":@(ioSamples.size()) };
+}
+
+
+/* -----------------------------------------------------------------------------
+	N C C o m m s B e n c h m a r k
+----------------------------------------------------------------------------- */
+
+@interface NCCommsBenchmark () <NTXStreamProtocol>
+{
+	mach_timebase_info_data_t timebase;
+
+	// toolkit benchmark state
+	NSMutableData * rxStream;
+	BOOL isConnected;
+	NSUInteger resultsReceived;
+}
+- (NSData *)payload;
+- (double)seconds:(uint64_t)inTicks;
+- (NSDictionary *)runCRC:(NSData *)inPayload;
+- (NSDictionary *)runPageBuffer:(NSData *)inPayload;
+- (NSDictionary *)runMNP:(NSData *)inPayload;
+- (NSDictionary *)runToolkit:(NSData *)inPayload;
+- (NCError)pump:(NCEndpoint *)inEndpoint wake:(int)inWakefd until:(BOOL (^)(void))inDone;
+@end
+
+
+@implementation NCCommsBenchmark
+
+- (id)init {
+	if (self = [super init]) {
+		_seed = 1;
+		_payloadSize = kDefaultPayloadSize;
+		_eventSize = kDefaultEventSize;
+		mach_timebase_info(&timebase);
+	}
+	return self;
+}
+
+
+- (double)seconds:(uint64_t)inTicks {
+	return (double)inTicks * timebase.numer / timebase.denom / NSEC_PER_SEC;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Generate the payload -- the same for every run with the same seed.
+----------------------------------------------------------------------------- */
+
+- (NSData *)payload {
+	NSMutableData * payload = [NSMutableData dataWithLength:self.payloadSize];
+	unsigned char * p = (unsigned char *)payload.mutableBytes;
+	unsigned int prng = self.seed;
+	for (NSUInteger i = 0; i < self.payloadSize; ++i)
+		p[i] = rand_r(&prng) & 0xFF;
+	return payload;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Run all benchmarks.
+	Args:		--
+	Return:	results dictionary, ready for JSON
+----------------------------------------------------------------------------- */
+
+- (NSDictionary *)run {
+	NSData * payload = [self payload];
+	return @{ @"date":[[[NSISO8601DateFormatter alloc] init] stringFromDate:[NSDate date]],
+				 @"seed":@(self.seed),
+				 @"payloadSize":@(self.payloadSize),
+				 @"eventSize":@(self.eventSize),
+				 @"crc16":[self runCRC:payload],
+				 @"pageBuffer":[self runPageBuffer:payload],
+				 @"mnp":[self runMNP:payload],
+				 @"toolkit":[self runToolkit:payload] };
+}
+
+
+- (BOOL)writeResultsTo:(NSURL *)inURL {
+	NSDictionary * results = [self run];
+	NSError * error = nil;
+	NSData * json = [NSJSONSerialization dataWithJSONObject:results options:NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error:&error];
+	if (json == nil || ![json writeToURL:inURL options:NSDataWritingAtomic error:&error]) {
+		NSLog(@"-[NCCommsBenchmark writeResultsTo:] %@", error);
+		return NO;
+	}
+	return YES;
+}
+
+
+#pragma mark Benchmarks
+/* -----------------------------------------------------------------------------
+	CRC16, a block at a time and -- as the framing code does it -- a byte at
+	a time.
+----------------------------------------------------------------------------- */
+
+- (NSDictionary *)runCRC:(NSData *)inPayload {
+	CRC16 * crc = [[CRC16 alloc] init];
+	unsigned char * p = (unsigned char *)inPayload.bytes;
+	unsigned int len = (unsigned int)inPayload.length;
+
+	uint64_t start = mach_absolute_time();
+	[crc computeCRC:p length:len];
+	double blockTime = [self seconds:mach_absolute_time() - start];
+	unsigned int blockCRC = ([crc get:0] << 8) | [crc get:1];
+
+	[crc reset];
+	start = mach_absolute_time();
+	for (unsigned int i = 0; i < len; ++i)
+		[crc computeCRC:p[i]];
+	double byteTime = [self seconds:mach_absolute_time() - start];
+
+	return @{ @"blockMBps":@(len / kMB / blockTime),
+				 @"byteMBps":@(len / kMB / byteTime),
+				 @"crc":@(blockCRC) };
+}
+
+
+/* -----------------------------------------------------------------------------
+	The page buffer through which all endpoint I/O passes.
+----------------------------------------------------------------------------- */
+
+- (NSDictionary *)runPageBuffer:(NSData *)inPayload {
+	NCBuffer * page = [[NCBuffer alloc] init];
+	NSMutableData * output = [NSMutableData dataWithLength:inPayload.length];
+	const unsigned char * src = (const unsigned char *)inPayload.bytes;
+	unsigned char * dst = (unsigned char *)output.mutableBytes;
+	NSUInteger len = inPayload.length;
+
+	uint64_t start = mach_absolute_time();
+	for (NSUInteger offset = 0; offset < len; ) {
+		unsigned int count = [page fill:(unsigned int)MIN(len - offset, (NSUInteger)page.freeSpace) from:src + offset];
+		[page drain:count into:dst + offset];
+		offset += count;
+	}
+	double time = [self seconds:mach_absolute_time() - start];
+
+	return @{ @"MBps":@(len / kMB / time),
+				 @"verified":@([output isEqualToData:inPayload]) };
+}
+
+
+/* -----------------------------------------------------------------------------
+	MNP framing and unframing over an in-memory loopback.
+	One endpoint sends the payload to another, an LT frame at a time; the
+	receiver’s LA frame is passed back before the next LT can be sent. So the
+	latency of each packet covers framing, unframing, and acknowledgement.
+----------------------------------------------------------------------------- */
+
+- (NSDictionary *)runMNP:(NSData *)inPayload {
+	MNPSerialEndpoint * sender = [[MNPSerialEndpoint alloc] init];
+	MNPSerialEndpoint * receiver = [[MNPSerialEndpoint alloc] init];
+	NCBuffer * page = [[NCBuffer alloc] init];
+	NSMutableData * txData = [inPayload mutableCopy];
+	NSMutableData * rxData = [NSMutableData dataWithCapacity:inPayload.length];
+	NSMutableData * noData = [NSMutableData data];
+	std::vector<uint64_t> latency;
+	latency.reserve(inPayload.length / kMNPPacketSize + 1);
+
+	size_t heapBefore = HeapInUse();
+	uint64_t start = mach_absolute_time();
+	while (rxData.length < inPayload.length) {
+		uint64_t t0 = mach_absolute_time();
+		[sender writePage:page from:txData];			// LT
+		if (page.count == 0)
+			break;
+		[receiver readPage:page into:rxData];
+		[receiver writePage:page from:noData];			// LA
+		[sender readPage:page into:noData];
+		latency.push_back(mach_absolute_time() - t0);
+	}
+	double time = [self seconds:mach_absolute_time() - start];
+	long heapGrowth = (long)HeapInUse() - (long)heapBefore;
+
+	return @{ @"MBps":@(rxData.length / kMB / time),
+				 @"packetLatencyMicroseconds":Percentiles(latency, timebase),
+				 @"netHeapBytesPerKB":@((double)heapGrowth * 1024.0 / inPayload.length),
+				 @"verified":@([rxData isEqualToData:inPayload]) };
+}
+
+
+/* -----------------------------------------------------------------------------
+	The toolkit protocol end-to-end.
+	The payload is sent to the mock Newton as kTCode events, each of which it
+	answers with kTResult. The endpoint is driven as the endpoint controller
+	drives it, so every read() and write() is a real system call.
+----------------------------------------------------------------------------- */
+
+- (NSDictionary *)runToolkit:(NSData *)inPayload {
+	MockNewtonEndpoint * ep = [[MockNewtonEndpoint alloc] init];
+	ep.newton.seed = self.seed;
+	std::vector<uint64_t> latency;
+	latency.reserve(inPayload.length / self.eventSize + 1);
+	NCError err = noErr;
+	int wakefd[2];
+
+	if (pipe(wakefd) < 0)
+		return @{ @"error":@(errno) };
+	fcntl(wakefd[0], F_SETFL, fcntl(wakefd[0], F_GETFL, 0) | O_NONBLOCK);
+	ep.pipefd = wakefd[1];
+
+	rxStream = [[NSMutableData alloc] init];
+	isConnected = NO;
+	resultsReceived = 0;
+	NSUInteger eventsSent = 0, bytesSent = 0;
+	size_t heapBefore = HeapInUse();
+	uint64_t start = mach_absolute_time();
+
+	XTRY
+	{
+		XFAIL(err = [ep listen])
+		XFAIL(err = [self pump:ep wake:wakefd[0] until:^BOOL{ return self->isConnected; }])
+
+		uint32_t header[4];
+		header[0] = CANONICAL_LONG(kNewtEventClass);
+		header[1] = CANONICAL_LONG(kToolkitEventId);
+		header[2] = CANONICAL_LONG(kTOK);
+		header[3] = 0;
+		[ep write:header length:sizeof(header)];
+
+		const unsigned char * p = (const unsigned char *)inPayload.bytes;
+		NSMutableData * event = [NSMutableData dataWithCapacity:sizeof(header) + self.eventSize + 3];
+		for (NSUInteger offset = 0; offset < inPayload.length; offset += self.eventSize) {
+			NSUInteger len = MIN(self.eventSize, inPayload.length - offset);
+			header[2] = CANONICAL_LONG(kTCode);
+			header[3] = CANONICAL_LONG((uint32_t)len);
+			event.length = 0;
+			[event appendBytes:header length:sizeof(header)];
+			[event appendBytes:p + offset length:len];
+			event.length = LONGALIGN(event.length);
+
+			uint64_t t0 = mach_absolute_time();
+			[ep write:event.bytes length:(unsigned int)event.length];
+			++eventsSent;
+			XFAIL(err = [self pump:ep wake:wakefd[0] until:^BOOL{ return self->resultsReceived == eventsSent; }])
+			latency.push_back(mach_absolute_time() - t0);
+			bytesSent += len;
+		}
+	}
+	XENDTRY;
+
+	double time = [self seconds:mach_absolute_time() - start];
+	long heapGrowth = (long)HeapInUse() - (long)heapBefore;
+	NCEndpointStats stats = ep.stats;
+	NCMockNewton * newton = ep.newton;
+	[ep close];
+	close(wakefd[0]);
+	close(wakefd[1]);
+	rxStream = nil;
+
+	double kb = MAX(bytesSent, (NSUInteger)1) / 1024.0;
+	return @{ @"error":@(err),
+				 @"MBps":@(bytesSent / kMB / time),
+				 @"eventLatencyMicroseconds":Percentiles(latency, timebase),
+				 @"syscallsPerKB":@((stats.readCalls + stats.writeCalls) / kb),
+				 @"wireBytesPerKB":@((stats.bytesRead + stats.bytesWritten) / kb),
+				 @"netHeapBytesPerKB":@(heapGrowth / kb),
+				 @"framesSent":@(newton.framesSent),
+				 @"framesReceived":@(newton.framesReceived),
+				 @"framesResent":@(newton.framesResent) };
+}
+
+
+/* -----------------------------------------------------------------------------
+	Drive an endpoint until a condition is met.
+	Args:		inEndpoint		the endpoint
+				inWakefd			read end of its write-signal pipe
+				inDone			the condition
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+- (NCError)pump:(NCEndpoint *)inEndpoint wake:(int)inWakefd until:(BOOL (^)(void))inDone {
+	NCError err = noErr;
+	uint64_t lastTick = mach_absolute_time();
+	int idleTicks = 0;
+	while (err == noErr && !inDone()) {
+		struct pollfd fds[2] = { { inEndpoint.rfd, POLLIN, 0 }, { inWakefd, POLLIN, 0 } };
+		if ([inEndpoint willWrite])
+			fds[0].events |= POLLOUT;
+		int n = poll(fds, 2, 100);
+		if (n < 0 && errno != EINTR) {
+			err = kDockErrDesktopError;
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			char signal[16];
+			while (read(inWakefd, signal, sizeof(signal)) > 0)
+				;
+		}
+		if (fds[0].revents & POLLIN)
+			err = [inEndpoint readDispatchSource:self];
+		if (err == noErr && (fds[0].revents & POLLOUT))
+			err = [inEndpoint writeDispatchSource];
+
+		// tick the endpoint’s ack/inactivity timers
+		if ([self seconds:mach_absolute_time() - lastTick] >= 1.0) {
+			lastTick = mach_absolute_time();
+			[inEndpoint handleTickTimer];
+			if (n == 0 && ++idleTicks >= kPumpTimeout)
+				err = kDockErrIdleTooLong;
+		}
+		if (n > 0)
+			idleTicks = 0;
+	}
+	return err;
+}
+
+
+/* -----------------------------------------------------------------------------
+	NTXStreamProtocol: count the toolkit events we’re waiting for.
+----------------------------------------------------------------------------- */
+
+- (void)addData:(NSData *)inData {
+	[rxStream appendData:inData];
+	while (rxStream.length >= sizeof(DockEventHeader)) {
+		const uint32_t * header = (const uint32_t *)rxStream.bytes;
+		uint32_t length = CANONICAL_LONG(header[3]);
+		NSUInteger eventLength = sizeof(DockEventHeader) + LONGALIGN(length);
+		if (rxStream.length < eventLength)
+			break;
+		switch (CANONICAL_LONG(header[2])) {
+		case kTConnect:
+			isConnected = YES;
+			break;
+		case kTResult:
+			++resultsReceived;
+			break;
+		}
+		[rxStream replaceBytesInRange:NSMakeRange(0, eventLength) withBytes:NULL length:0];
+	}
+}
+
+@end
@@ -50,10 +50,25 @@ int	REPprintf(const char * inFormat, ...);
 #define kDefaultTimeoutInSecs		 30
 
 
+/* -----------------------------------------------------------------------------
+	I/O statistics -- system calls and bytes through an endpoint’s fd.
+----------------------------------------------------------------------------- */
+
+typedef struct
+{
+	uint64_t		readCalls;
+	uint64_t		writeCalls;
+	uint64_t		bytesRead;
+	uint64_t		bytesWritten;
+} NCEndpointStats;
+
+
 @protocol NTXStreamProtocol
 - (void)addData:(NSData *)inData;
 @end
 
+@class NCTraceCapture;
+
 
 /* -----------------------------------------------------------------------------
 	N C E n d p o i n t
@@ -79,18 +94,23 @@ int	REPprintf(const char * inFormat, ...);
 //	dispatch_source_t writeSrc;	// GCD dispatch source for writing data to fd
 	NCBuffer * wPageBuf;				// 1K buffer into which to write fd data
 	NSMutableData * wData;
+	dispatch_data_t wSegments;		// unframed data to be written, held by reference
+	dispatch_data_t wOutSegments;	// taken from wSegments by the i/o loop and being written
 	BOOL isSyncWrite;
 }
 @property(nonatomic,readonly) int rfd;		// read file descriptor
 @property(nonatomic,readonly) int wfd;		// write file descriptor
 @property(nonatomic,assign) int pipefd;
 @property(nonatomic,assign) int timeout;
+@property(nonatomic,readonly) NCEndpointStats stats;
+@property(nonatomic,strong) NCTraceCapture * capture;	// this connection’s link traffic capture, if any
 
 // public interface
 + (BOOL)isAvailable;
 
 - (NCError)write:(const void *)inData length:(unsigned int)inLength;
 - (NCError)writeSync:(const void *)inData length:(unsigned int)inLength;
+- (NCError)writeData:(dispatch_data_t)inData;
 - (BOOL)willWrite;
 - (void)writeDone;
 
@@ -98,6 +118,7 @@ int	REPprintf(const char * inFormat, ...);
 - (NCError)listen;
 - (NCError)accept;
 - (void) handleTickTimer;
+- (BOOL)framesOutput;
 - (NCError)readPage:(NCBuffer *)inFrameBuf into:(NSMutableData *)ioData;
 - (void)writePage:(NCBuffer *)inFrameBuf from:(NSMutableData *)inDataBuf;
 - (NCError)close;
@@ -8,19 +8,20 @@
 
 #import "Endpoint.h"
 #import "DockErrors.h"
+#include <sys/uio.h>
 
 // we need to know all available transports
 #import "MNPSerialEndpoint.h"
 #import "EinsteinEndpoint.h"
+#import "MockNewton.h"
+#import "TraceCapture.h"
+#import "PreferenceKeys.h"
 //#import "EthernetEndpoint.h"
 //#import "BluetoothEndpoint.h"
 
 
-/* -----------------------------------------------------------------------------
-	D a t a
------------------------------------------------------------------------------ */
-
-BOOL gTraceIO = NO;
+// most segments we hand to one writev()
+#define kMaxWriteSegments 16
 
 /* -----------------------------------------------------------------------------
 	N C E n d p o i n t
@@ -45,6 +46,8 @@ BOOL gTraceIO = NO;
 
 		wPageBuf = [[NCBuffer alloc] init];
 		wData = [[NSMutableData alloc] init];
+		wSegments = dispatch_data_empty;
+		wOutSegments = nil;
 
 		syncWrite = dispatch_semaphore_create(0);
 		isSyncWrite = NO;
@@ -117,6 +120,19 @@ BOOL gTraceIO = NO;
 }
 
 
+/*------------------------------------------------------------------------------
+	Does this endpoint frame the data it writes?
+	If not, data is written to the fd straight from the caller’s buffers,
+	gathered by writev(); otherwise it is copied through -writePage:from:.
+	Args:		--
+	Return:	YES => data must go through -writePage:from:
+------------------------------------------------------------------------------*/
+
+- (BOOL)framesOutput {
+	return NO;	// subclass responsibility
+}
+
+
 /*------------------------------------------------------------------------------
 	Read from the file descriptor.
 	Unframe that data (if necessary: think MNP serial) and add it to the input
@@ -130,16 +146,11 @@ BOOL gTraceIO = NO;
 
 	// read() into a 1K buffer, and pass it to the transport for unframing/packetising
 	int count = read(self.rfd, rPageBuf.ptr, rPageBuf.freeSpace);
+	_stats.readCalls++;
 	if (count > 0) {
-
-#if kDebugOn
-if (gTraceIO) {
-	NSMutableString * str = [NSMutableString stringWithCapacity:count*3];
-	for (int i = 0; i < count; ++i) {
-		[str appendFormat:@" %02X", rPageBuf.ptr[i]];
-	}
-	NSLog(@"<<%@",str);
-}
+		_stats.bytesRead += count;
+#if kCaptureOn
+		[_capture record:kTraceRx data:rPageBuf.ptr length:count];
 #endif
 
 		[rData setLength:0];
@@ -186,8 +197,13 @@ if (gTraceIO) {
 - (BOOL)willWrite {
 	__block BOOL willDo = NO;
 	dispatch_sync(ioQueue, ^{
+		if (wOutSegments == nil && dispatch_data_get_size(wSegments) > 0) {
+			// take everything queued so far; callers can go on queueing while we write it
+			wOutSegments = wSegments;
+			wSegments = dispatch_data_empty;
+		}
 		[self writePage:wPageBuf from:wData];
-		willDo = wPageBuf.count > 0;
+		willDo = wOutSegments != nil || wPageBuf.count > 0;
 	});
 	return willDo;
 }
@@ -195,19 +211,47 @@ if (gTraceIO) {
 
 - (NCError)writeDispatchSource {
 	NCError err = noErr;
-	// fetch a frame from the buffer and write() it
-	if (wPageBuf.count > 0) {
-		int count = write(self.wfd, wPageBuf.ptr, wPageBuf.count);
+	if (wOutSegments != nil) {
+		// gather as many segments as we can into one writev()
+		struct iovec iov[kMaxWriteSegments];
+		struct iovec * iovp = iov;
+		__block int iovcnt = 0;
+		dispatch_data_apply(wOutSegments, ^bool(dispatch_data_t region, size_t offset, const void * buffer, size_t size) {
+			iovp[iovcnt].iov_base = (void *)buffer;
+			iovp[iovcnt].iov_len = size;
+			return ++iovcnt < kMaxWriteSegments;
+		});
+		ssize_t count = writev(self.wfd, iov, iovcnt);
+		_stats.writeCalls++;
 		if (count > 0) {
+			_stats.bytesWritten += count;
+#if kCaptureOn
+			ssize_t remaining = count;
+			for (int i = 0; i < iovcnt && remaining > 0; ++i) {
+				size_t len = MIN(iov[i].iov_len, (size_t)remaining);
+				[_capture record:kTraceTx data:iov[i].iov_base length:len];
+				remaining -= len;
+			}
+#endif
 
-#if kDebugOn
-if (gTraceIO) {
-	NSMutableString * str = [NSMutableString stringWithCapacity:count*3];
-	for (int i = 0; i < count; ++i) {
-		[str appendFormat:@" %02X", wPageBuf.ptr[i]];
-	}
-	NSLog(@">>%@",str);
-}
+			size_t size = dispatch_data_get_size(wOutSegments);
+			wOutSegments = ((size_t)count < size) ? dispatch_data_create_subrange(wOutSegments, count, size - count) : nil;
+			[self writeDone];
+		} else if (count == 0) {
+			err = kDockErrDisconnected;
+		} else {	// count < 0 => error
+			if (errno != EAGAIN && errno != EINTR) {
+				err = kDockErrDesktopError;
+			}
+		}
+	} else if (wPageBuf.count > 0) {
+		// fetch a frame from the buffer and write() it
+		int count = write(self.wfd, wPageBuf.ptr, wPageBuf.count);
+		_stats.writeCalls++;
+		if (count > 0) {
+			_stats.bytesWritten += count;
+#if kCaptureOn
+			[_capture record:kTraceTx data:wPageBuf.ptr length:count];
 #endif
 
 			[wPageBuf drain:count];
@@ -252,11 +296,51 @@ if (gTraceIO) {
 - (NCError)write:(const void *)inData length:(unsigned int)inLength {
 	NCError err = noErr;
 	if (inData != NULL && inLength > 0) {
+		if (self.framesOutput) {
+			dispatch_sync(ioQueue, ^{
+				BOOL wasEmpty = wData.length == 0;
+				[wData appendBytes:inData length:inLength];
+				if (wasEmpty) {
+					write(self.pipefd, "X", 1);
+				}
+			});
+		} else {
+			// the caller’s buffer won’t outlive us, so this is the one copy we make
+			err = [self writeData:dispatch_data_create(inData, inLength, NULL, DISPATCH_DATA_DESTRUCTOR_DEFAULT)];
+		}
+	}
+	return err;
+}
+
+
+/*------------------------------------------------------------------------------
+	Public interface: write data to the endpoint without copying it.
+	The data is held until it has been written; an endpoint that doesn’t frame
+	its output writes it to the fd straight from the data’s own buffers.
+	Args:		inData			may be made of many regions, eg by
+									dispatch_data_create_concat()
+	Return:	error code
+------------------------------------------------------------------------------*/
+
+- (NCError)writeData:(dispatch_data_t)inData {
+	NCError err = noErr;
+	if (inData != nil && dispatch_data_get_size(inData) > 0) {
 		dispatch_sync(ioQueue, ^{
-			BOOL wasEmpty = wData.length == 0;
-			[wData appendBytes:inData length:inLength];
-			if (wasEmpty) {
-				write(self.pipefd, "X", 1);
+			if (self.framesOutput) {
+				BOOL wasEmpty = wData.length == 0;
+				dispatch_data_apply(inData, ^bool(dispatch_data_t region, size_t offset, const void * buffer, size_t size) {
+					[wData appendBytes:buffer length:size];
+					return true;
+				});
+				if (wasEmpty) {
+					write(self.pipefd, "X", 1);
+				}
+			} else {
+				BOOL wasEmpty = dispatch_data_get_size(wSegments) == 0;
+				wSegments = dispatch_data_create_concat(wSegments, inData);
+				if (wasEmpty) {
+					write(self.pipefd, "X", 1);
+				}
 			}
 		});
 	}
@@ -275,8 +359,12 @@ if (gTraceIO) {
 	NCError err = noErr;
 	if (inData != NULL && inLength > 0) {
 		dispatch_sync(ioQueue, ^{
-			BOOL wasEmpty = wData.length == 0;
-			[wData appendBytes:inData length:inLength];
+			BOOL wasEmpty = wData.length == 0 && dispatch_data_get_size(wSegments) == 0 && wOutSegments == nil;
+			if (self.framesOutput) {
+				[wData appendBytes:inData length:inLength];
+			} else {
+				wSegments = dispatch_data_create_concat(wSegments, dispatch_data_create(inData, inLength, NULL, DISPATCH_DATA_DESTRUCTOR_DEFAULT));
+			}
 			if (wasEmpty) {
 				isSyncWrite = YES;
 				write(self.pipefd, "Y", 1);
@@ -291,7 +379,7 @@ if (gTraceIO) {
 - (void)writeDone
 {
 	dispatch_sync(ioQueue, ^{
-		if (isSyncWrite && wData.length == 0) {
+		if (isSyncWrite && wData.length == 0 && dispatch_data_get_size(wSegments) == 0 && wOutSegments == nil) {
 			isSyncWrite = NO;
 			dispatch_semaphore_signal(syncWrite);
 		}
@@ -407,6 +495,14 @@ if (gTraceIO) {
 			[ep setTimeout:1];
 			err = [self addEndpoint:ep name:"Einstein"];
 		}
+#if DEBUG
+		// the mock Newton is for development only: never listen for it in a release build
+		if ([MockNewtonEndpoint isAvailable]) {
+			ep = [[MockNewtonEndpoint alloc] init];
+			[ep setTimeout:1];
+			err = [self addEndpoint:ep name:"mock Newton"];
+		}
+#endif
 /*
 		if ([TCPIPEndpoint isAvailable]) {
 			ep = [[TCPIPEndpoint alloc] init];
@@ -484,6 +580,13 @@ if (gTraceIO) {
 						// accept this connection, cancel other listener transports
 						ep = epi;
 						[self useEndpoint:ep];
+#if kCaptureOn
+						// capture this connection’s traffic if asked
+						NSString * captureFolder = [NSUserDefaults.standardUserDefaults stringForKey:kTraceCapturePref];
+						if (captureFolder) {
+							ep.capture = [NCTraceCapture captureInFolder:captureFolder];
+						}
+#endif
 						break;
 					}
 				}
@@ -531,6 +634,10 @@ NSLog(@"select(): %d, errno = %d", nfds, errno);
 			err = kDockErrDisconnected;	// because there are no comms after we break
 		}
 	}
+#if kCaptureOn
+	[ep.capture close];
+	ep.capture = nil;
+#endif
 	self.error = err;
 }
 
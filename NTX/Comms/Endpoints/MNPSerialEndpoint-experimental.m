@@ -356,8 +356,6 @@ const unsigned char kLAPacket[] =
 	D a t a
 ----------------------------------------------------------------------------- */
 
-extern BOOL gTraceIO;
-
 int doHandshaking = 0;
 
 static unsigned char ltPacketHeader[sizeof(kLTPacket)];
@@ -885,10 +883,6 @@ NSLog(@"#### received LD packet (disconnect)");
 	}
 	else
 	{
-#if 0 //kDebugOn
-if (gTraceIO)
-NSLog(@"\n     <-- ACK");
-#endif
 		isACKPending = NO;
 		// stop acknowledgement timer T401
 	}
@@ -911,6 +905,16 @@ NSLog(@"\n     <-- ACK");
 { /* this really does nothing */ }
 
 
+/* -----------------------------------------------------------------------------
+	Every byte we send is framed, so data must be copied through -writePage:.
+----------------------------------------------------------------------------- */
+
+- (BOOL) framesOutput
+{
+	return YES;
+}
+
+
 /* -----------------------------------------------------------------------------
 	Send data from the output buffer.
 	Have to break the data into 256-byte LT packet sized chunks,
@@ -26,8 +26,6 @@
 #include "CRC.h"
 #include "NCBuffer.h"
 
-#define kCaptureOn 1
-
 //	Standard ASCII Mnemonics
 
 #define	chNUL						0x00
@@ -86,8 +86,6 @@ const unsigned char kLAFrame[] =
 	D a t a
 ----------------------------------------------------------------------------- */
 
-extern BOOL gTraceIO;
-
 int doHandshaking = 0;
 
 static unsigned char ltFrameHeader[sizeof(kLTFrame)];
@@ -618,9 +616,6 @@ NSLog(@" <-- received unknown packet type (%d)", rFrameType);
 	rSequence = rFrameBuf.ptr[2];	// third char in header is packet sequence number
 
 	if (rSequence == prevSequence) {
-if (gTraceIO) {
-	NSLog(@"-[MNPSerialEndpoint rcvLT:] packet %d resent", rSequence);
-}
 		// must not rebuffer the data if this is a resend
 	} else {
 		unsigned int headerLen = 1 + rFrameBuf.ptr[0];	// first char in header is header length
@@ -728,6 +723,15 @@ NSLog(@" <-- received LD packet (disconnect)");
 }
 
 
+/* -----------------------------------------------------------------------------
+	Every byte we send is framed, so data must be copied through -writePage:.
+----------------------------------------------------------------------------- */
+
+- (BOOL)framesOutput {
+	return YES;
+}
+
+
 /* -----------------------------------------------------------------------------
 	Send data from the output buffer.
 	Have to break the data into 256-byte LT packet sized chunks,
@@ -0,0 +1,72 @@
+/*
+	File:		MockNewton.h
+
+	Contains:	A stand-in Newton device, for exercising the dock and toolkit
+					protocols end-to-end without hardware or an emulator.
+					It runs in-process on its own queue and talks MNP over one end of
+					a socket pair; MockNewtonEndpoint connects to the other end.
+					Events are answered by handler blocks, which can be replaced to
+					script a session; the defaults answer toolkit connect/code/object
+					and the basic dock soup commands from an in-memory store.
+					Latency, CRC errors and dropped LA frames can be injected to
+					exercise the desktop’s recovery paths.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "MNPSerialEndpoint.h"
+#import "NTKProtocol.h"
+
+@class NCMockNewton;
+
+typedef void (^NCMockEventHandler)(NCMockNewton * inNewton, EventType inTag, NSData * inData);
+
+
+/* -----------------------------------------------------------------------------
+	N C M o c k N e w t o n
+	Fault injection is driven by a seeded PRNG, so a failing run can be
+	repeated exactly.
+----------------------------------------------------------------------------- */
+
+@interface NCMockNewton : NSObject
+
+@property(nonatomic,readonly) int fd;							// desktop end of the link
+@property(nonatomic,readonly) BOOL isLinkUp;
+
+// fault injection
+@property(nonatomic,assign) NSTimeInterval latency;		// delay before each frame we send
+@property(nonatomic,assign) double crcErrorRate;			// probability of corrupting the FCS of a frame we send
+@property(nonatomic,assign) double dropAckRate;				// probability of not acknowledging an LT frame we receive
+@property(nonatomic,assign) unsigned int seed;
+
+// statistics
+@property(nonatomic,readonly) NSUInteger framesSent;
+@property(nonatomic,readonly) NSUInteger framesReceived;
+@property(nonatomic,readonly) NSUInteger framesResent;
+@property(nonatomic,readonly) NSUInteger badFramesReceived;
+@property(nonatomic,readonly) NSUInteger crcErrorsInjected;
+@property(nonatomic,readonly) NSUInteger acksDropped;
+
+// in-memory store: soup name => { entry id => flattened entry }
+@property(nonatomic,readonly) NSMutableDictionary<NSString *, NSMutableDictionary<NSNumber *, NSData *> *> * soups;
+
+- (NCError)open;
+- (void)startAs:(EventId)inEventId;
+- (void)close;
+
+- (void)on:(EventType)inTag do:(NCMockEventHandler)inHandler;
+- (void)sendEvent:(EventType)inTag data:(NSData *)inData;
+- (void)sendEvent:(EventType)inTag value:(int32_t)inValue;
+- (void)disconnect;
+
+@end
+
+
+/* -----------------------------------------------------------------------------
+	M o c k N e w t o n E n d p o i n t
+	Available when the MockNewton user default is set.
+----------------------------------------------------------------------------- */
+
+@interface MockNewtonEndpoint : MNPSerialEndpoint
+@property(nonatomic,readonly) NCMockNewton * newton;
+@end
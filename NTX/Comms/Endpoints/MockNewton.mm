@@ -0,0 +1,1095 @@
+/*
+	File:		MockNewton.mm
+
+	Contains:	A stand-in Newton device.
+					The Newton end of the link is implemented just far enough to keep
+					MNPSerialEndpoint honest: we initiate the link with LR, confirm the
+					desktop’s LR with LA, and thereafter exchange LT frames one at a
+					time (k = 1), resending any that are not acknowledged.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "MockNewton.h"
+#import "PreferenceKeys.h"
+#import "DockErrors.h"
+
+#include <sys/socket.h>
+#include <strings.h>
+#include <libkern/OSByteOrder.h>
+
+
+/* -----------------------------------------------------------------------------
+	C o n s t a n t s
+----------------------------------------------------------------------------- */
+
+enum
+{
+	kLRFrameType = 1,		// link request
+	kLDFrameType,			// link disconnect
+	kLxFrameType,
+	kLTFrameType,			// link transfer
+	kLAFrameType,			// link acknowledge
+	kLNFrameType,			// link attention
+	kLNAFrameType			// link attention acknowledge
+};
+
+static const unsigned char kNewtonLRFrame[] =
+{
+	23,		/* Length of header */
+	kLRFrameType,
+	0x02,
+	0x01, 0x06, 0x01, 0x00, 0x00, 0x00, 0x00, 0xFF,
+	0x02, 0x01, 0x02,			/* Framing mode = octet-oriented */
+	0x03, 0x01, 0x01,			/* Number of outstanding LT frames, k = 1 */
+	0x04, 0x02, 0x40, 0x00,	/* Maximum info field length, N401 = 64 */
+	0x08, 0x01, 0x03			/* Data phase optimisation, N401 = 256 & fixed LT, LA frames */
+};
+
+static const unsigned char kNewtonLDFrame[] =
+{
+	4,			/* Length of header */
+	kLDFrameType,
+	0x01, 0x01, 0xFF			/* Reason code = user-initiated disconnect */
+};
+
+// acknowledgement timer T401, in seconds
+#define kAckTimeout		1
+
+// dock protocol commands we answer -- as in DockEvent.h
+#define kDockEventId			'dock'
+#define kDRequestToDock		'rtdk'
+#define kDResult				'dres'
+#define kDDisconnect			'disc'
+#define kDHello				'helo'
+#define kDSetCurrentSoup	'ssou'
+#define kDGetSoupIDs			'gsid'
+#define kDSoupIDs				'sids'
+#define kDReturnEntry		'rete'
+#define kDEntry				'entr'
+#define kDAddEntry			'adde'
+#define kDAddedID				'adid'
+#define kDChangedEntry		'cent'
+#define kDDeleteEntries		'dele'
+#define kDEmptySoup			'esou'
+
+#define kDockProtocolVersion	10
+
+
+/* -----------------------------------------------------------------------------
+	Flattened entries.
+	The store keeps entries flattened, as they arrive. Their ids are read and
+	stamped on the NSOF itself: handlers run on our queue, not the thread the
+	NewtonScript world belongs to, so we must not make any Refs.
+----------------------------------------------------------------------------- */
+
+// NSOF object tags -- as in StreamPrinter.mm
+#define kNSOFVersion 2
+
+enum
+{
+	kNSOFImmediate,
+	kNSOFCharacter,
+	kNSOFUnicodeCharacter,
+	kNSOFBinaryObject,
+	kNSOFArray,
+	kNSOFPlainArray,
+	kNSOFFrame,
+	kNSOFSymbol,
+	kNSOFString,
+	kNSOFPrecedent,
+	kNSOFNIL,
+	kNSOFSmallRect,
+	kNSOFLargeBinary
+};
+
+#define kMaxNesting		256
+
+struct NSOFReader
+{
+	const unsigned char *	stream;
+	size_t		size;
+	size_t		offset;
+	ULong			precedent;		// ID of the next object that can be referred to
+	bool			isBad;
+};
+
+
+/* -----------------------------------------------------------------------------
+	Check there is data to be read; if not, the entry is damaged.
+----------------------------------------------------------------------------- */
+
+static bool
+Have(NSOFReader & ioReader, size_t inLength)
+{
+	if (ioReader.offset <= ioReader.size && inLength <= ioReader.size - ioReader.offset)
+		return true;
+	ioReader.isBad = true;
+	return false;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read an xlong: a byte, or 0xFF then a big-endian long.
+----------------------------------------------------------------------------- */
+
+static ULong
+ReadXLong(NSOFReader & ioReader)
+{
+	if (!Have(ioReader, 1))
+		return 0;
+	ULong value = ioReader.stream[ioReader.offset++];
+	if (value == 0xFF) {
+		if (!Have(ioReader, 4))
+			return 0;
+		value = OSReadBigInt32(ioReader.stream, ioReader.offset);
+		ioReader.offset += 4;
+	}
+	return value;
+}
+
+
+static void
+AppendXLong(NSMutableData * ioData, ULong inValue)
+{
+	unsigned char xlong[5] = { 0xFF };
+	if (inValue < 0xFF) {
+		xlong[0] = inValue;
+		[ioData appendBytes:xlong length:1];
+	} else {
+		OSWriteBigInt32(xlong, 1, inValue);
+		[ioData appendBytes:xlong length:5];
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Append what has been read since an offset.
+----------------------------------------------------------------------------- */
+
+static void
+Emit(const NSOFReader & inReader, size_t inFrom, NSMutableData * ioData)
+{
+	if (ioData && !inReader.isBad)
+		[ioData appendBytes:inReader.stream + inFrom length:inReader.offset - inFrom];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read an object, copying it if asked.
+	Precedent IDs are given in the order objects are read, so inserting an
+	object moves up the ID of every object after it.
+	Args:		ioReader			positioned at the object
+				ioData			the copy; nil => just skip the object
+				inInsertedID	precedent references to this ID or above are
+									moved up one
+				inDepth			of nested objects read
+	Return:	--
+----------------------------------------------------------------------------- */
+
+static void
+CopyObject(NSOFReader & ioReader, NSMutableData * ioData, ULong inInsertedID, int inDepth)
+{
+	if (inDepth > kMaxNesting || !Have(ioReader, 1)) {
+		ioReader.isBad = true;
+		return;
+	}
+	size_t start = ioReader.offset;
+	unsigned char tag = ioReader.stream[ioReader.offset++];
+	switch (tag) {
+	case kNSOFImmediate:
+	case kNSOFCharacter:
+		ReadXLong(ioReader);
+		break;
+
+	case kNSOFUnicodeCharacter:
+		if (Have(ioReader, 2))
+			ioReader.offset += 2;
+		break;
+
+	case kNSOFNIL:
+		break;
+
+	case kNSOFPrecedent: {
+			ULong id = ReadXLong(ioReader);
+			if (ioData && !ioReader.isBad) {
+				[ioData appendBytes:&tag length:1];
+				AppendXLong(ioData, id >= inInsertedID ? id + 1 : id);
+			}
+		}
+		return;
+
+	case kNSOFSmallRect:
+		ioReader.precedent++;
+		if (Have(ioReader, 4))
+			ioReader.offset += 4;
+		break;
+
+	case kNSOFSymbol:
+	case kNSOFString: {
+			ioReader.precedent++;
+			ULong len = ReadXLong(ioReader);
+			if (Have(ioReader, len))
+				ioReader.offset += len;
+		}
+		break;
+
+	case kNSOFBinaryObject: {
+			ioReader.precedent++;
+			ULong len = ReadXLong(ioReader);
+			Emit(ioReader, start, ioData);
+			CopyObject(ioReader, ioData, inInsertedID, inDepth + 1);
+			start = ioReader.offset;
+			if (Have(ioReader, len))
+				ioReader.offset += len;
+		}
+		break;
+
+	case kNSOFArray:
+	case kNSOFPlainArray:
+	case kNSOFFrame: {
+			ioReader.precedent++;
+			ULong count = ReadXLong(ioReader);
+			Emit(ioReader, start, ioData);
+			if (tag == kNSOFArray)
+				CopyObject(ioReader, ioData, inInsertedID, inDepth + 1);
+			else if (tag == kNSOFFrame)
+				count *= 2;		// tags, then values
+			for (ULong i = 0; i < count && !ioReader.isBad; ++i)
+				CopyObject(ioReader, ioData, inInsertedID, inDepth + 1);
+		}
+		return;
+
+	case kNSOFLargeBinary: {
+			ioReader.precedent++;
+			Emit(ioReader, start, ioData);
+			CopyObject(ioReader, ioData, inInsertedID, inDepth + 1);
+			// compressed byte, then length, compander name length, compander parms length, reserved longs
+			start = ioReader.offset;
+			if (Have(ioReader, 17)) {
+				uint64_t len = (uint64_t)OSReadBigInt32(ioReader.stream, ioReader.offset + 1)
+								 + OSReadBigInt32(ioReader.stream, ioReader.offset + 5)
+								 + OSReadBigInt32(ioReader.stream, ioReader.offset + 9);
+				ioReader.offset += 17;
+				if (Have(ioReader, len))
+					ioReader.offset += len;
+			}
+		}
+		break;
+
+	default:
+		ioReader.isBad = true;
+		return;
+	}
+	Emit(ioReader, start, ioData);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read the tags of a flattened entry.
+	Args:		ioReader			reader of the entry; left at its first value
+				outTags			offset of its first tag
+				outCount			number of slots
+				outIdSlot		index of its _uniqueId slot; -1 if it has none
+	Return:	true => the entry is a frame
+----------------------------------------------------------------------------- */
+
+static bool
+ReadEntryTags(NSOFReader & ioReader, size_t & outTags, ULong & outCount, long & outIdSlot)
+{
+	outIdSlot = -1;
+	if (!Have(ioReader, 2) || ioReader.stream[0] != kNSOFVersion || ioReader.stream[1] != kNSOFFrame)
+		return false;
+	ioReader.offset = 2;
+	ioReader.precedent = 1;		// the entry itself is 0
+	outCount = ReadXLong(ioReader);
+	outTags = ioReader.offset;
+	for (ULong i = 0; i < outCount && !ioReader.isBad; ++i) {
+		size_t tag = ioReader.offset;
+		CopyObject(ioReader, nil, 0, 0);
+		if (!ioReader.isBad && ioReader.stream[tag] == kNSOFSymbol) {
+			NSOFReader name = ioReader;
+			name.offset = tag + 1;
+			if (ReadXLong(name) == 9 && strncasecmp((const char *)name.stream + name.offset, "_uniqueId", 9) == 0)
+				outIdSlot = i;
+		}
+	}
+	return !ioReader.isBad;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return a flattened entry with its _uniqueId set -- as the Newton does when
+	it adds an entry to a soup.
+	Args:		inEntry			flattened entry
+				inId				its id
+	Return:	flattened entry; nil if it is not a frame we can understand
+----------------------------------------------------------------------------- */
+
+static NSData *
+EntryWithId(NSData * inEntry, int32_t inId)
+{
+	NSOFReader reader = { (const unsigned char *)inEntry.bytes, inEntry.length, 0, 0, false };
+	size_t tags;
+	ULong count;
+	long idSlot;
+	if (!ReadEntryTags(reader, tags, count, idSlot))
+		return nil;
+
+	unsigned char immediate = kNSOFImmediate;
+	NSMutableData * entry = [NSMutableData dataWithCapacity:inEntry.length + 16];
+	if (idSlot >= 0) {
+		// replace the value where it lies -- it must not be an object that can
+		// be referred to, or the IDs after it would change
+		for (long i = 0; i < idSlot; ++i)
+			CopyObject(reader, nil, 0, 0);
+		size_t value = reader.offset;
+		ULong precedent = reader.precedent;
+		CopyObject(reader, nil, 0, 0);
+		if (reader.isBad || reader.precedent != precedent)
+			return nil;
+		[entry appendBytes:reader.stream length:value];
+		[entry appendBytes:&immediate length:1];
+		AppendXLong(entry, (ULong)inId << 2);		// MAKEINT
+		[entry appendBytes:reader.stream + reader.offset length:reader.size - reader.offset];
+	} else {
+		// add a tag after the others; every value’s precedent ID moves up one
+		ULong insertedID = reader.precedent;
+		unsigned char header[2] = { kNSOFVersion, kNSOFFrame };
+		[entry appendBytes:header length:sizeof(header)];
+		AppendXLong(entry, count + 1);
+		[entry appendBytes:reader.stream + tags length:reader.offset - tags];
+		unsigned char symbol = kNSOFSymbol;
+		[entry appendBytes:&symbol length:1];
+		AppendXLong(entry, 9);
+		[entry appendBytes:"_uniqueId" length:9];
+		for (ULong i = 0; i < count && !reader.isBad; ++i)
+			CopyObject(reader, entry, insertedID, 0);
+		if (reader.isBad)
+			return nil;
+		[entry appendBytes:&immediate length:1];
+		AppendXLong(entry, (ULong)inId << 2);
+	}
+	return entry;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the _uniqueId of a flattened entry.
+	Args:		inEntry			flattened entry
+	Return:	its id; -1 if it has none
+----------------------------------------------------------------------------- */
+
+static int32_t
+EntryId(NSData * inEntry)
+{
+	NSOFReader reader = { (const unsigned char *)inEntry.bytes, inEntry.length, 0, 0, false };
+	size_t tags;
+	ULong count;
+	long idSlot;
+	if (!ReadEntryTags(reader, tags, count, idSlot) || idSlot < 0)
+		return -1;
+	for (long i = 0; i < idSlot; ++i)
+		CopyObject(reader, nil, 0, 0);
+	if (reader.isBad || !Have(reader, 1) || reader.stream[reader.offset] != kNSOFImmediate)
+		return -1;
+	reader.offset++;
+	int32_t ref = (int32_t)ReadXLong(reader);
+	return (!reader.isBad && (ref & 0x03) == 0) ? ref >> 2 : -1;		// ISINT, RVALUE
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the long at an index into event data.
+----------------------------------------------------------------------------- */
+
+static int32_t
+LongAt(NSData * inData, NSUInteger index)
+{
+	if ((index + 1) * sizeof(int32_t) > inData.length)
+		return 0;
+	return CANONICAL_LONG(((const int32_t *)inData.bytes)[index]);
+}
+
+
+/* -----------------------------------------------------------------------------
+	N C M o c k N e w t o n
+----------------------------------------------------------------------------- */
+
+@interface NCMockNewton ()
+- (void)installDefaultHandlers;
+- (void)receive:(const unsigned char *)inBuf length:(size_t)inLength;
+- (void)processFrame;
+- (void)receiveEvents;
+- (void)xmitLA;
+- (void)xmitLT;
+- (void)startAckTimer:(unsigned char)inSequence;
+- (NSData *)frame:(const unsigned char *)inHeader data:(const unsigned char *)inBuf length:(NSUInteger)inLength;
+- (void)writeFrame:(NSData *)inFrame;
+- (void)write:(NSData *)inData;
+- (BOOL)roll:(double)inProbability;
+@end
+
+
+@implementation NCMockNewton
+{
+	int newtonfd;							// our end of the link
+	dispatch_queue_t queue;				// everything happens on this serial queue
+	dispatch_source_t readSrc;
+
+	int rState;								// unframing FSM state
+	NSMutableData * rFrame;
+	CRC16 * rFCS;
+	unsigned char rFCS0;
+	unsigned char rSequence;			// of the last LT frame received
+	NSMutableData * rData;				// received data awaiting a whole event
+
+	NSMutableData * wData;				// event data awaiting transfer
+	NSData * wFrame;						// LT frame awaiting acknowledgement
+	unsigned char wSequence;
+	BOOL isACKPending;
+
+	EventId eventId;						// toolkit or dock
+	NSMutableDictionary<NSNumber *, NCMockEventHandler> * handlers;
+	NSString * currentSoup;
+	int32_t nextEntryId;
+	unsigned int prng;
+}
+
+
+- (id)init {
+	if (self = [super init]) {
+		_fd = newtonfd = -1;
+		queue = dispatch_queue_create("com.newton.mock", DISPATCH_QUEUE_SERIAL);
+		rFrame = [[NSMutableData alloc] initWithCapacity:kMNPFrameSize];
+		rFCS = [[CRC16 alloc] init];
+		rData = [[NSMutableData alloc] init];
+		wData = [[NSMutableData alloc] init];
+		handlers = [[NSMutableDictionary alloc] init];
+		_soups = [[NSMutableDictionary alloc] init];
+		nextEntryId = 1;
+		eventId = kToolkitEventId;
+		self.seed = 1;
+		[self installDefaultHandlers];
+	}
+	return self;
+}
+
+
+- (void)dealloc {
+	[self close];
+}
+
+
+- (void)setSeed:(unsigned int)inSeed {
+	_seed = inSeed;
+	prng = inSeed;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Roll the dice for fault injection.
+	Args:		inProbability	0..1
+	Return:	YES => inject the fault
+----------------------------------------------------------------------------- */
+
+- (BOOL)roll:(double)inProbability {
+	if (inProbability <= 0.0)
+		return NO;
+	return (double)rand_r(&prng) / RAND_MAX < inProbability;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Create the link.
+	The desktop end is non-blocking, like the serial port; it belongs to the
+	endpoint, which closes it.
+	Args:		--
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+- (NCError)open {
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		NSLog(@"Error creating mock Newton link - %s (%d).", strerror(errno), errno);
+		return errno;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+	_fd = fds[0];
+	newtonfd = fds[1];
+
+	readSrc = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, newtonfd, 0, queue);
+	dispatch_source_t src = readSrc;
+	NCMockNewton *__weak weakself = self;
+	int rfd = newtonfd;
+	dispatch_source_set_event_handler(readSrc, ^{
+		unsigned char buf[kRxBufLength];
+		ssize_t count = read(rfd, buf, sizeof(buf));
+		if (count > 0)
+			[weakself receive:buf length:count];
+		else if (count == 0)
+			// desktop has closed its end
+			dispatch_source_cancel(src);
+	});
+	dispatch_source_set_cancel_handler(readSrc, ^{ close(rfd); });
+	dispatch_resume(readSrc);
+	return noErr;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Initiate the link, as a Newton does when the user taps Connect.
+	Once the desktop has answered, we open the conversation with kTConnect
+	or kDRequestToDock.
+	Args:		inEventId		kToolkitEventId or kDockEventId
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)startAs:(EventId)inEventId {
+	dispatch_async(queue, ^{
+		self->eventId = inEventId;
+		self->rSequence = 0;
+		self->wSequence = 0;
+		[self writeFrame:[self frame:kNewtonLRFrame data:NULL length:0]];
+	});
+}
+
+
+- (void)close {
+	if (readSrc) {
+		dispatch_source_cancel(readSrc);	// closes newtonfd
+		readSrc = nil;
+		newtonfd = -1;
+	}
+	_isLinkUp = NO;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Register the handler for an event received from the desktop.
+	Handlers are called on our queue.
+	Args:		inTag				event tag
+				inHandler		nil => ignore the event
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)on:(EventType)inTag do:(NCMockEventHandler)inHandler {
+	dispatch_sync(queue, ^{
+		self->handlers[@(inTag)] = inHandler;
+	});
+}
+
+
+/* -----------------------------------------------------------------------------
+	Send an event to the desktop, with the event id of the current
+	conversation.
+	Args:		inTag				event tag
+				inData			event data; may be nil
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)sendEvent:(EventType)inTag data:(NSData *)inData {
+	dispatch_async(queue, ^{
+		uint32_t header[4];
+		header[0] = CANONICAL_LONG(kNewtEventClass);
+		header[1] = CANONICAL_LONG(self->eventId);
+		header[2] = CANONICAL_LONG(inTag);
+		header[3] = CANONICAL_LONG((uint32_t)inData.length);
+		[self->wData appendBytes:header length:sizeof(header)];
+		if (inData.length > 0) {
+			[self->wData appendData:inData];
+			NSUInteger padLength = inData.length & 0x03;
+			if (padLength != 0) {
+				uint32_t padding = 0;
+				[self->wData appendBytes:&padding length:4 - padLength];
+			}
+		}
+		[self xmitLT];
+	});
+}
+
+
+- (void)sendEvent:(EventType)inTag value:(int32_t)inValue {
+	int32_t value = CANONICAL_LONG(inValue);
+	[self sendEvent:inTag data:[NSData dataWithBytes:&value length:sizeof(value)]];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Drop the link.
+----------------------------------------------------------------------------- */
+
+- (void)disconnect {
+	dispatch_async(queue, ^{
+		if (self->_isLinkUp) {
+			self->_isLinkUp = NO;
+			[self writeFrame:[self frame:kNewtonLDFrame data:NULL length:0]];
+		}
+	});
+}
+
+
+#pragma mark Default handlers
+/* -----------------------------------------------------------------------------
+	Answer the toolkit protocol as a Newton running the Toolkit App would --
+	except that we don’t evaluate anything, we just report success.
+	Answer the dock soup commands from the in-memory store. Soups spring into
+	existence when they are made current.
+----------------------------------------------------------------------------- */
+
+- (void)installDefaultHandlers {
+	NCMockEventHandler ok = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		[inNewton sendEvent:kTResult value:noErr];
+	};
+	NCMockEventHandler ignore = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) { };
+
+	// toolkit
+	handlers[@(kTOK)] = ignore;
+	handlers[@(kTCode)] = ok;
+	handlers[@(kTObject)] = ok;
+	handlers[@(kTExecute)] = ok;
+	handlers[@(kTSetTimeout)] = ok;
+	handlers[@(kTLoadPackage)] = ok;
+	handlers[@(kTDeletePackage)] = ok;
+	handlers[@(kTTerminate)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		[inNewton sendEvent:kTTerminate data:nil];
+		[inNewton disconnect];
+	};
+
+	// dock
+	handlers[@(kDHello)] = ignore;
+	handlers[@(kDDisconnect)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		[inNewton disconnect];
+	};
+
+	handlers[@(kDSetCurrentSoup)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		// soup name is a nul-terminated UniChar string
+		const UniChar * s = (const UniChar *)inData.bytes;
+		NSUInteger len = 0, maxLen = inData.length / sizeof(UniChar);
+		while (len < maxLen && s[len] != 0)
+			++len;
+		NSString * name = [[NSString alloc] initWithBytes:s length:len * sizeof(UniChar) encoding:NSUTF16BigEndianStringEncoding];
+		if (inNewton.soups[name] == nil)
+			inNewton.soups[name] = [[NSMutableDictionary alloc] init];
+		inNewton->currentSoup = name;
+		[inNewton sendEvent:kDResult value:noErr];
+	};
+
+	handlers[@(kDGetSoupIDs)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		NSMutableDictionary<NSNumber *, NSData *> * soup = inNewton.soups[inNewton->currentSoup];
+		if (soup == nil) {
+			[inNewton sendEvent:kDResult value:kDockErrBadCurrentSoup];
+			return;
+		}
+		NSArray<NSNumber *> * ids = [soup.allKeys sortedArrayUsingSelector:@selector(compare:)];
+		NSMutableData * reply = [NSMutableData dataWithCapacity:(1 + ids.count) * sizeof(int32_t)];
+		int32_t value = CANONICAL_LONG((int32_t)ids.count);
+		[reply appendBytes:&value length:sizeof(value)];
+		for (NSNumber * entryId in ids) {
+			value = CANONICAL_LONG(entryId.intValue);
+			[reply appendBytes:&value length:sizeof(value)];
+		}
+		[inNewton sendEvent:kDSoupIDs data:reply];
+	};
+
+	handlers[@(kDReturnEntry)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		NSData * entry = inNewton.soups[inNewton->currentSoup][@(LongAt(inData, 0))];
+		if (entry)
+			[inNewton sendEvent:kDEntry data:entry];
+		else
+			[inNewton sendEvent:kDResult value:kDockErrEntryNotFound];
+	};
+
+	handlers[@(kDAddEntry)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		NSMutableDictionary<NSNumber *, NSData *> * soup = inNewton.soups[inNewton->currentSoup];
+		NSData * entry;
+		if (soup == nil)
+			[inNewton sendEvent:kDResult value:kDockErrBadCurrentSoup];
+		else if ((entry = EntryWithId(inData, inNewton->nextEntryId)) == nil)
+			[inNewton sendEvent:kDResult value:kDockErrBadEntry];
+		else {
+			int32_t entryId = inNewton->nextEntryId++;
+			soup[@(entryId)] = entry;
+			[inNewton sendEvent:kDAddedID value:entryId];
+		}
+	};
+
+	handlers[@(kDChangedEntry)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		NSMutableDictionary<NSNumber *, NSData *> * soup = inNewton.soups[inNewton->currentSoup];
+		NSNumber * entryId = @(EntryId(inData));
+		if (soup == nil)
+			[inNewton sendEvent:kDResult value:kDockErrBadCurrentSoup];
+		else if (soup[entryId] == nil)
+			[inNewton sendEvent:kDResult value:kDockErrEntryNotFound];
+		else {
+			soup[entryId] = inData;
+			[inNewton sendEvent:kDResult value:noErr];
+		}
+	};
+
+	handlers[@(kDDeleteEntries)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		NSMutableDictionary<NSNumber *, NSData *> * soup = inNewton.soups[inNewton->currentSoup];
+		if (soup == nil) {
+			[inNewton sendEvent:kDResult value:kDockErrBadCurrentSoup];
+			return;
+		}
+		for (int32_t i = 1, count = LongAt(inData, 0); i <= count; ++i)
+			[soup removeObjectForKey:@(LongAt(inData, i))];
+		[inNewton sendEvent:kDResult value:noErr];
+	};
+
+	handlers[@(kDEmptySoup)] = ^(NCMockNewton * inNewton, EventType inTag, NSData * inData) {
+		NSMutableDictionary<NSNumber *, NSData *> * soup = inNewton.soups[inNewton->currentSoup];
+		[soup removeAllObjects];
+		[inNewton sendEvent:kDResult value:soup ? noErr : kDockErrBadCurrentSoup];
+	};
+}
+
+
+#pragma mark Receiving
+/* -----------------------------------------------------------------------------
+	Unframe received data.
+	Frames with a bad FCS are discarded; the desktop’s T401 timer will have
+	it resend.
+	Args:		inBuf				data read from the link
+				inLength			its length
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)receive:(const unsigned char *)inBuf length:(size_t)inLength {
+	for ( ; inLength > 0; --inLength) {
+		unsigned char ch = *inBuf++;
+		switch (rState) {
+		case 0:
+			if (ch == chSYN)
+				rState = 1;
+			break;
+		case 1:
+			rState = (ch == chDLE) ? 2 : 0;
+			break;
+		case 2:
+			if (ch == chSTX) {
+				rFrame.length = 0;
+				[rFCS reset];
+				rState = 3;
+			} else
+				rState = 0;
+			break;
+		case 3:
+			if (ch == chDLE)
+				rState = 4;
+			else {
+				[rFrame appendBytes:&ch length:1];
+				[rFCS computeCRC:ch];
+			}
+			break;
+		case 4:
+			if (ch == chETX) {
+				[rFCS computeCRC:ch];
+				rState = 5;
+			} else {
+				if (ch == chDLE) {
+					// escaped DLE
+					[rFrame appendBytes:&ch length:1];
+					[rFCS computeCRC:ch];
+				}
+				rState = 3;
+			}
+			break;
+		case 5:
+			rFCS0 = ch;
+			rState = 6;
+			break;
+		case 6:
+			rState = 0;
+			if (rFCS0 == [rFCS get:0] && ch == [rFCS get:1])
+				[self processFrame];
+			else
+				_badFramesReceived++;
+			break;
+		}
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Process a received frame.
+----------------------------------------------------------------------------- */
+
+- (void)processFrame {
+	const unsigned char * frame = (const unsigned char *)rFrame.bytes;
+	NSUInteger frameLen = rFrame.length;
+	if (frameLen < 2 || frameLen < 1 + frame[0]) {
+		_badFramesReceived++;
+		return;
+	}
+	_framesReceived++;
+
+	switch (frame[1]) {
+	case kLRFrameType:
+		// the desktop has answered our link request -- confirm it
+		[self xmitLA];
+		if (!_isLinkUp) {
+			_isLinkUp = YES;
+			if (eventId == kDockEventId) {
+				int32_t version = CANONICAL_LONG(kDockProtocolVersion);
+				[self sendEvent:kDRequestToDock data:[NSData dataWithBytes:&version length:sizeof(version)]];
+			} else
+				[self sendEvent:kTConnect data:nil];
+		}
+		break;
+
+	case kLTFrameType: {
+		unsigned char seq = frame[2];
+		unsigned int headerLen = 1 + frame[0];
+		// a resend of the last frame must not be rebuffered
+		if (seq != rSequence) {
+			rSequence = seq;
+			[rData appendBytes:frame + headerLen length:frameLen - headerLen];
+		}
+		if ([self roll:self.dropAckRate])
+			_acksDropped++;
+		else
+			[self xmitLA];
+		[self receiveEvents];
+		}
+		break;
+
+	case kLAFrameType:
+		if (isACKPending) {
+			if (frame[2] == wSequence && frame[3] != 0) {
+				isACKPending = NO;
+				wFrame = nil;
+				[self xmitLT];
+			} else {
+				// NAK, or ack of an earlier frame -- resend
+				_framesResent++;
+				[self writeFrame:wFrame];
+			}
+		}
+		break;
+
+	case kLDFrameType:
+		_isLinkUp = NO;
+		isACKPending = NO;
+		wFrame = nil;
+		wData.length = 0;
+		break;
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Despatch whole events from the received data to their handlers.
+----------------------------------------------------------------------------- */
+
+- (void)receiveEvents {
+	while (rData.length >= sizeof(DockEventHeader)) {
+		const uint32_t * header = (const uint32_t *)rData.bytes;
+		if (CANONICAL_LONG(header[0]) != kNewtEventClass) {
+			// lost sync -- there’s no recovering from that
+			NSLog(@"-[NCMockNewton receiveEvents] bad event header; discarding %lu bytes", (unsigned long)rData.length);
+			rData.length = 0;
+			break;
+		}
+		EventId evtId = CANONICAL_LONG(header[1]);
+		EventType tag = CANONICAL_LONG(header[2]);
+		uint32_t length = CANONICAL_LONG(header[3]);
+		if (length == kIndeterminateLength)
+			length = 0;
+		NSUInteger eventLength = sizeof(DockEventHeader) + LONGALIGN(length);
+		if (rData.length < eventLength)
+			break;
+
+		NSData * data = [rData subdataWithRange:NSMakeRange(sizeof(DockEventHeader), length)];
+		[rData replaceBytesInRange:NSMakeRange(0, eventLength) withBytes:NULL length:0];
+
+		eventId = evtId;
+		NCMockEventHandler handler = handlers[@(tag)];
+		if (handler)
+			handler(self, tag, data);
+		else
+			NSLog(@"-[NCMockNewton receiveEvents] unhandled event '%c%c%c%c'", (tag >> 24) & 0xFF, (tag >> 16) & 0xFF, (tag >> 8) & 0xFF, tag & 0xFF);
+	}
+}
+
+
+#pragma mark Sending
+/* -----------------------------------------------------------------------------
+	Acknowledge the last LT frame received.
+----------------------------------------------------------------------------- */
+
+- (void)xmitLA {
+	const unsigned char laFrameHeader[] = { 3, kLAFrameType, rSequence, 1 };
+	[self writeFrame:[self frame:laFrameHeader data:NULL length:0]];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Send the next packet of event data, if the last has been acknowledged.
+----------------------------------------------------------------------------- */
+
+- (void)xmitLT {
+	if (!_isLinkUp || isACKPending || wData.length == 0)
+		return;
+
+	NSUInteger count = MIN(wData.length, (NSUInteger)kMNPPacketSize);
+	const unsigned char ltFrameHeader[] = { 2, kLTFrameType, ++wSequence };
+	wFrame = [self frame:ltFrameHeader data:(const unsigned char *)wData.bytes length:count];
+	[wData replaceBytesInRange:NSMakeRange(0, count) withBytes:NULL length:0];
+
+	isACKPending = YES;
+	[self writeFrame:wFrame];
+	[self startAckTimer:wSequence];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Resend an LT frame if it’s not acknowledged in time -- the desktop might
+	have discarded it (eg because we corrupted it).
+	Args:		inSequence		sequence number of the frame
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)startAckTimer:(unsigned char)inSequence {
+	NCMockNewton *__weak weakself = self;
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)((kAckTimeout + self.latency) * NSEC_PER_SEC)), queue, ^{
+		NCMockNewton * newton = weakself;
+		if (newton && newton->isACKPending && newton->wSequence == inSequence) {
+			newton->_framesResent++;
+			[newton writeFrame:newton->wFrame];
+			[newton startAckTimer:inSequence];
+		}
+	});
+}
+
+
+/* -----------------------------------------------------------------------------
+	Frame a packet: SYN DLE STX, header and data with DLE escaped,
+	DLE ETX, FCS.
+	Args:		inHeader			frame header; first byte is its length
+				inBuf				packet data
+				inLength			its length
+	Return:	the frame
+----------------------------------------------------------------------------- */
+
+- (NSData *)frame:(const unsigned char *)inHeader data:(const unsigned char *)inBuf length:(NSUInteger)inLength {
+	NSMutableData * frame = [NSMutableData dataWithCapacity:kMNPFrameSize];
+	CRC16 * fcs = [[CRC16 alloc] init];
+	const unsigned char frameStart[] = { chSYN, chDLE, chSTX };
+	[frame appendBytes:frameStart length:sizeof(frameStart)];
+
+	const unsigned char * p[2] = { inHeader, inBuf };
+	NSUInteger len[2] = { 1 + (NSUInteger)inHeader[0], inBuf ? inLength : 0 };
+	for (int part = 0; part < 2; ++part) {
+		for (NSUInteger i = 0; i < len[part]; ++i) {
+			unsigned char ch = p[part][i];
+			[fcs computeCRC:ch];
+			if (ch == chDLE)
+				[frame appendBytes:&ch length:1];
+			[frame appendBytes:&ch length:1];
+		}
+	}
+
+	[fcs computeCRC:chETX];
+	const unsigned char frameEnd[] = { chDLE, chETX, [fcs get:0], [fcs get:1] };
+	[frame appendBytes:frameEnd length:sizeof(frameEnd)];
+	return frame;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Write a frame to the link, injecting faults as required.
+	Since latency is the same for every frame, frames still arrive in order.
+----------------------------------------------------------------------------- */
+
+- (void)writeFrame:(NSData *)inFrame {
+	NSData * frame = inFrame;
+	if ([self roll:self.crcErrorRate]) {
+		NSMutableData * badFrame = [inFrame mutableCopy];
+		((unsigned char *)badFrame.mutableBytes)[badFrame.length - 1] ^= 0xFF;
+		frame = badFrame;
+		_crcErrorsInjected++;
+	}
+	_framesSent++;
+
+	if (self.latency > 0.0) {
+		NCMockNewton *__weak weakself = self;
+		dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.latency * NSEC_PER_SEC)), queue, ^{
+			[weakself write:frame];
+		});
+	} else
+		[self write:frame];
+}
+
+
+- (void)write:(NSData *)inData {
+	const char * p = (const char *)inData.bytes;
+	size_t remaining = inData.length;
+	while (newtonfd >= 0 && remaining > 0) {
+		ssize_t count = write(newtonfd, p, remaining);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			NSLog(@"-[NCMockNewton write:] error %d", errno);
+			break;
+		}
+		p += count;
+		remaining -= count;
+	}
+}
+
+@end
+
+
+/* -----------------------------------------------------------------------------
+	M o c k N e w t o n E n d p o i n t
+----------------------------------------------------------------------------- */
+
+@implementation MockNewtonEndpoint
+
++ (BOOL)isAvailable {
+	return [NSUserDefaults.standardUserDefaults boolForKey:kMockNewtonPref];
+}
+
+
+- (id)init {
+	if (self = [super init]) {
+		_newton = [[NCMockNewton alloc] init];
+	}
+	return self;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Open the link to the mock Newton, and have it connect to us.
+----------------------------------------------------------------------------- */
+
+- (NCError)listen {
+	NCError err;
+	if ((err = [self.newton open]) == noErr) {
+		_rfd = _wfd = self.newton.fd;
+		[self.newton startAs:kToolkitEventId];
+	}
+	return err;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Disconnect.
+	There’s no tty to restore.
+----------------------------------------------------------------------------- */
+
+- (NCError)close {
+	if (isLive) {
+		[super xmitLD];
+	}
+	if (self.rfd >= 0) {
+		close(self.rfd);
+		_rfd = _wfd = -1;
+	}
+	[self.newton close];
+	return noErr;
+}
+
+@end
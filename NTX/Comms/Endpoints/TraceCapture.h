@@ -0,0 +1,93 @@
+/*
+	File:		TraceCapture.h
+
+	Contains:	Binary capture of raw link traffic, and its replay.
+					The I/O loop copies each chunk it reads or writes, with a
+					timestamp, into a ring; a background queue writes the ring to a
+					compact file. The I/O loop never waits: if the ring is full the
+					chunk is dropped (and counted).
+					A capture can be replayed through an endpoint’s readPage:into: to
+					profile and regression-test the receive path offline.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "Endpoint.h"
+
+#define kCaptureOn 1
+
+#define kTraceRingSize		(256*1024)
+#define kTraceMagic			'NTXC'
+#define kTraceVersion		1
+
+typedef enum
+{
+	kTraceRx,
+	kTraceTx
+} NCTraceDirection;
+
+
+/* -----------------------------------------------------------------------------
+	File format, in host byte order.
+	A file header, then a record header + data for each chunk.
+----------------------------------------------------------------------------- */
+
+typedef struct
+{
+	uint32_t		magic;
+	uint32_t		version;
+	uint32_t		timebaseNumer;		// mach_timebase_info of the capturing machine
+	uint32_t		timebaseDenom;
+	uint64_t		startTime;			// mach_absolute_time()
+} NCTraceFileHeader;
+
+typedef struct __attribute__((packed))
+{
+	uint64_t		time;					// mach_absolute_time() ticks since startTime
+	uint32_t		info;					// direction << 31 | data length
+} NCTraceRecordHeader;
+
+#define kTraceDirectionShift	31
+#define kTraceLengthMask		0x7FFFFFFF
+
+
+/* -----------------------------------------------------------------------------
+	N C T r a c e C a p t u r e
+	Each endpoint owns its own capture, so there is one producer per ring:
+	record:data:length: must only be called from that endpoint’s I/O loop.
+	If writing the file fails, the capture stops there: the file is closed, and
+	chunks recorded after that are dropped.
+----------------------------------------------------------------------------- */
+
+@interface NCTraceCapture : NSObject
+
+@property(nonatomic,readonly) NSURL * url;
+@property(nonatomic,readonly) NSUInteger droppedRecords;
+@property(nonatomic,readonly) int writeError;				// errno of the write that failed, if any
+
++ (NCTraceCapture *)captureInFolder:(NSString *)inFolder;
+- (id)initWithURL:(NSURL *)inURL;
+- (void)record:(NCTraceDirection)inDirection data:(const void *)inData length:(NSUInteger)inLength;
+- (void)close;
+
+@end
+
+
+/* -----------------------------------------------------------------------------
+	N C T r a c e R e p l a y
+	Received chunks are fed through readPage:into: as readDispatchSource
+	would; transmitted chunks are skipped.
+----------------------------------------------------------------------------- */
+
+@interface NCTraceReplay : NSObject
+
+@property(nonatomic,readonly) BOOL isValid;
+@property(nonatomic,readonly) NSUInteger recordsReplayed;
+@property(nonatomic,readonly) NSUInteger bytesReplayed;		// raw, as read from the fd
+@property(nonatomic,readonly) NSUInteger bytesUnframed;		// as passed to the stream
+@property(nonatomic,readonly) double receiveTime;				// seconds spent in readPage:into:
+
+- (id)initWithURL:(NSURL *)inURL;
+- (NCError)replayInto:(NCEndpoint *)inEndpoint stream:(id<NTXStreamProtocol>)inStream realTime:(BOOL)inRealTime;
+
+@end
@@ -0,0 +1,342 @@
+/*
+	File:		TraceCapture.m
+
+	Contains:	Binary capture of raw link traffic, and its replay.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "TraceCapture.h"
+
+#include <stdatomic.h>
+#include <mach/mach_time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// how often the ring is written to file, in milliseconds
+#define kTraceFlushInterval	100
+
+
+/* -----------------------------------------------------------------------------
+	Write all of a buffer, however many write() calls it takes.
+	Args:		inFd
+				inData
+				inLength
+	Return:	0, or errno
+----------------------------------------------------------------------------- */
+
+static int
+WriteAll(int inFd, const void * inData, size_t inLength)
+{
+	const unsigned char * p = (const unsigned char *)inData;
+	while (inLength > 0) {
+		ssize_t count = write(inFd, p, inLength);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		p += count;
+		inLength -= count;
+	}
+	return 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+	N C T r a c e C a p t u r e
+	head and tail are running byte counts; their difference is the amount in
+	the ring. Only the producer advances head, only the writer advances tail.
+----------------------------------------------------------------------------- */
+
+@implementation NCTraceCapture
+{
+	int fd;
+	uint64_t startTime;
+	dispatch_queue_t writeQueue;
+	dispatch_source_t flushTimer;
+	dispatch_source_t flushSignal;		// nudges the writer when the ring is filling up
+
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+	_Atomic NSUInteger dropped;
+	unsigned char ring[kTraceRingSize];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Start a capture in a new, timestamped, file.
+	Args:		inFolder			path of folder for capture files
+	Return:	the capture; nil if it could not be created
+----------------------------------------------------------------------------- */
+
++ (NCTraceCapture *)captureInFolder:(NSString *)inFolder {
+	NSDateFormatter * formatter = [[NSDateFormatter alloc] init];
+	formatter.dateFormat = @"yyyyMMdd-HHmmss";
+	NSString * filename = [NSString stringWithFormat:@"NTX-%@.ntxtrace", [formatter stringFromDate:[NSDate date]]];
+	NSURL * folder = [NSURL fileURLWithPath:inFolder.stringByExpandingTildeInPath isDirectory:YES];
+	[NSFileManager.defaultManager createDirectoryAtURL:folder withIntermediateDirectories:YES attributes:nil error:NULL];
+	return [[NCTraceCapture alloc] initWithURL:[folder URLByAppendingPathComponent:filename]];
+}
+
+
+- (id)initWithURL:(NSURL *)inURL {
+	if (self = [super init]) {
+		_url = inURL;
+		const char * path = inURL.fileSystemRepresentation;
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
+			NSLog(@"Error creating capture file %s - %s (%d).", path, strerror(errno), errno);
+			return nil;
+		}
+
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		startTime = mach_absolute_time();
+		NCTraceFileHeader header = { kTraceMagic, kTraceVersion, timebase.numer, timebase.denom, startTime };
+		int err;
+		if ((err = WriteAll(fd, &header, sizeof(header))) != 0) {
+			NSLog(@"Error writing capture file %s - %s (%d).", path, strerror(err), err);
+			close(fd);
+			unlink(path);
+			return nil;
+		}
+
+		atomic_init(&head, 0);
+		atomic_init(&tail, 0);
+		atomic_init(&dropped, 0);
+
+		writeQueue = dispatch_queue_create("com.newton.connection.capture", DISPATCH_QUEUE_SERIAL);
+		NCTraceCapture *__weak weakself = self;
+
+		flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, writeQueue);
+		dispatch_source_set_timer(flushTimer, DISPATCH_TIME_NOW, kTraceFlushInterval * NSEC_PER_MSEC, kTraceFlushInterval * NSEC_PER_MSEC / 4);
+		dispatch_source_set_event_handler(flushTimer, ^{ [weakself flush]; });
+		dispatch_resume(flushTimer);
+
+		flushSignal = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, writeQueue);
+		dispatch_source_set_event_handler(flushSignal, ^{ [weakself flush]; });
+		dispatch_resume(flushSignal);
+	}
+	return self;
+}
+
+
+- (void)dealloc {
+	[self close];
+}
+
+
+- (NSUInteger)droppedRecords {
+	return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Copy bytes into the ring at a running offset, wrapping as necessary.
+----------------------------------------------------------------------------- */
+
+- (void)copyToRing:(uint64_t)inOffset from:(const void *)inData length:(NSUInteger)inLength {
+	NSUInteger index = (NSUInteger)(inOffset % kTraceRingSize);
+	NSUInteger spaceAfter = kTraceRingSize - index;
+	if (inLength <= spaceAfter) {
+		memcpy(ring + index, inData, inLength);
+	} else {
+		memcpy(ring + index, inData, spaceAfter);
+		memcpy(ring, (const unsigned char *)inData + spaceAfter, inLength - spaceAfter);
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Record a chunk of link traffic.
+	This is on the I/O path, so it’s just a couple of copies; it never blocks.
+	Args:		inDirection		rx or tx
+				inData			the chunk
+				inLength			its length
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)record:(NCTraceDirection)inDirection data:(const void *)inData length:(NSUInteger)inLength {
+	NCTraceRecordHeader header;
+	NSUInteger recordLength = sizeof(header) + inLength;
+	uint64_t h = atomic_load_explicit(&head, memory_order_relaxed);
+	uint64_t used = h - atomic_load_explicit(&tail, memory_order_acquire);
+	if (used + recordLength > kTraceRingSize) {
+		atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	header.time = mach_absolute_time() - startTime;
+	header.info = ((uint32_t)inDirection << kTraceDirectionShift) | ((uint32_t)inLength & kTraceLengthMask);
+	[self copyToRing:h from:&header length:sizeof(header)];
+	[self copyToRing:h + sizeof(header) from:inData length:inLength];
+	atomic_store_explicit(&head, h + recordLength, memory_order_release);
+
+	if (used + recordLength > kTraceRingSize / 2) {
+		dispatch_source_merge_data(flushSignal, 1);
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Write the ring to file.
+	Runs on the write queue. Once a write has failed the file is closed and the
+	ring is left to fill, so later chunks are dropped and counted.
+----------------------------------------------------------------------------- */
+
+- (void)flush {
+	uint64_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+	uint64_t h = atomic_load_explicit(&head, memory_order_acquire);
+	if (h == t || fd < 0) {
+		return;
+	}
+	NSUInteger index = (NSUInteger)(t % kTraceRingSize);
+	NSUInteger length = (NSUInteger)(h - t);
+	NSUInteger spaceAfter = kTraceRingSize - index;
+	int err;
+	if (length <= spaceAfter) {
+		err = WriteAll(fd, ring + index, length);
+	} else if ((err = WriteAll(fd, ring + index, spaceAfter)) == 0) {
+		err = WriteAll(fd, ring, length - spaceAfter);
+	}
+	if (err != 0) {
+		NSLog(@"Error writing capture %@ - %s (%d); capture stopped.", self.url.lastPathComponent, strerror(err), err);
+		_writeError = err;
+		close(fd);
+		fd = -1;
+		return;
+	}
+	atomic_store_explicit(&tail, h, memory_order_release);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Finish the capture: write whatever remains in the ring and close the file.
+----------------------------------------------------------------------------- */
+
+- (void)close {
+	if (flushTimer) {
+		dispatch_source_cancel(flushTimer);
+		dispatch_source_cancel(flushSignal);
+		flushTimer = nil;
+		flushSignal = nil;
+		dispatch_sync(writeQueue, ^{
+			[self flush];
+			if (self->fd >= 0 && close(self->fd) < 0 && self->_writeError == 0) {
+				self->_writeError = errno;
+				NSLog(@"Error closing capture %@ - %s (%d).", self.url.lastPathComponent, strerror(errno), errno);
+			}
+			self->fd = -1;
+		});
+		NSUInteger droppedCount = self.droppedRecords;
+		if (droppedCount > 0) {
+			NSLog(@"Capture %@: %lu chunks dropped", self.url.lastPathComponent, (unsigned long)droppedCount);
+		}
+	}
+}
+
+@end
+
+
+/* -----------------------------------------------------------------------------
+	N C T r a c e R e p l a y
+----------------------------------------------------------------------------- */
+
+@implementation NCTraceReplay
+{
+	NSData * capture;
+}
+
+
+- (id)initWithURL:(NSURL *)inURL {
+	if (self = [super init]) {
+		capture = [NSData dataWithContentsOfURL:inURL options:NSDataReadingMappedIfSafe error:NULL];
+		const NCTraceFileHeader * header = (const NCTraceFileHeader *)capture.bytes;
+		_isValid = capture.length >= sizeof(NCTraceFileHeader)
+				  && header->magic == kTraceMagic
+				  && header->version == kTraceVersion;
+	}
+	return self;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Replay the capture.
+	Args:		inEndpoint		endpoint whose receive path we exercise
+				inStream			where unframed data goes; may be nil
+				inRealTime		YES => chunks arrive with their original timing
+									NO  => as fast as possible
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+- (NCError)replayInto:(NCEndpoint *)inEndpoint stream:(id<NTXStreamProtocol>)inStream realTime:(BOOL)inRealTime {
+	if (!self.isValid) {
+		return kNCInvalidFile;
+	}
+
+	const NCTraceFileHeader * header = (const NCTraceFileHeader *)capture.bytes;
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+
+	NCBuffer * page = [[NCBuffer alloc] init];
+	NSMutableData * data = [[NSMutableData alloc] init];
+	const unsigned char * p = (const unsigned char *)capture.bytes + sizeof(NCTraceFileHeader);
+	const unsigned char * end = (const unsigned char *)capture.bytes + capture.length;
+	uint64_t startTime = mach_absolute_time();
+	uint64_t receiveTicks = 0;
+	NCError err = noErr;
+
+	_recordsReplayed = 0;
+	_bytesReplayed = 0;
+	_bytesUnframed = 0;
+
+	while (err == noErr && p + sizeof(NCTraceRecordHeader) <= end) {
+		NCTraceRecordHeader record;
+		memcpy(&record, p, sizeof(record));
+		p += sizeof(record);
+		NSUInteger length = record.info & kTraceLengthMask;
+		if (p + length > end) {
+			// capture was cut short
+			break;
+		}
+		const unsigned char * chunk = p;
+		p += length;
+		if ((record.info >> kTraceDirectionShift) != kTraceRx) {
+			continue;
+		}
+
+		if (inRealTime) {
+			// convert capture ticks to ours
+			uint64_t ns = record.time * header->timebaseNumer / header->timebaseDenom;
+			mach_wait_until(startTime + ns * timebase.denom / timebase.numer);
+		}
+
+		// feed the chunk through the endpoint a page at a time, as readDispatchSource does
+		for (NSUInteger offset = 0; err == noErr && offset < length; ) {
+			unsigned int count = [page fill:(unsigned int)MIN(length - offset, (NSUInteger)page.freeSpace) from:chunk + offset];
+			offset += count;
+			[data setLength:0];
+			uint64_t t0 = mach_absolute_time();
+			err = [inEndpoint readPage:page into:data];
+			receiveTicks += mach_absolute_time() - t0;
+			if (err == noErr && data.length > 0) {
+				_bytesUnframed += data.length;
+				[inStream addData:data];
+			}
+		}
+		_recordsReplayed++;
+		_bytesReplayed += length;
+	}
+
+	_receiveTime = (double)receiveTicks * timebase.numer / timebase.denom / NSEC_PER_SEC;
+	return err;
+}
+
+
+- (NSString *)description {
+	return [NSString stringWithFormat:@"%lu chunks, %lu bytes replayed -> %lu bytes unframed in %.3fs (%.2f MB/s)",
+				(unsigned long)self.recordsReplayed, (unsigned long)self.bytesReplayed, (unsigned long)self.bytesUnframed,
+				self.receiveTime, self.receiveTime > 0.0 ? self.bytesReplayed / self.receiveTime / (1024.0*1024.0) : 0.0];
+}
+
+@end
@@ -0,0 +1,62 @@
+/*
+	File:		EventDispatch.h
+
+	Contains:	Dock event dispatch table.
+					Maps a dock event tag to the component that handles it and the
+					handler method’s implementation, resolved once at registration --
+					so dispatching an event needs no string or selector lookup.
+
+					Not yet part of the NTX target, along with the dock session that
+					uses it, so this has not been compiled.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__EVENTDISPATCH_H)
+#define __EVENTDISPATCH_H 1
+
+#import <Foundation/Foundation.h>
+#import <objc/runtime.h>
+#import "DockEvent.h"
+#include <vector>
+
+/* --- Handler for one event, with its latency statistics --- */
+
+struct EventHandler
+{
+	EventType	tag;
+	id				component;		// not retained; NCSession’s eventHandlers dictionary owns it
+	SEL			selector;
+	IMP			method;
+
+	uint64_t		count;
+	uint64_t		totalTime;		// mach_absolute_time() units
+	uint64_t		maxTime;
+};
+
+
+/* -----------------------------------------------------------------------------
+	C E v e n t D i s p a t c h T a b l e
+	Handlers are kept sorted by tag, so a lookup is a binary search of a small
+	contiguous array. It grows as components register.
+----------------------------------------------------------------------------- */
+
+class CEventDispatchTable
+{
+public:
+					CEventDispatchTable();
+
+	bool			add(EventType inTag, id inComponent);
+	EventHandler *	find(EventType inTag);
+	bool			dispatch(NCDockEvent * inEvent);
+
+	void			resetStatistics(void);
+	void			logStatistics(void) const;
+
+	static EventType	tagFromString(NSString * inTag);
+
+private:
+	std::vector<EventHandler>	fHandler;
+};
+
+#endif	/* __EVENTDISPATCH_H */
@@ -0,0 +1,164 @@
+/*
+	File:		EventDispatch.mm
+
+	Contains:	Dock event dispatch table.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "EventDispatch.h"
+#import <mach/mach_time.h>
+
+typedef void (*EventHandlerProcPtr)(id, SEL, NCDockEvent *);
+
+
+/* -----------------------------------------------------------------------------
+	C E v e n t D i s p a t c h T a b l e
+----------------------------------------------------------------------------- */
+
+CEventDispatchTable::CEventDispatchTable()
+{
+	fHandler.reserve(32);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Make an event tag from its four-character string.
+	Args:		inTag			eg @"dres"
+	Return:	event tag
+----------------------------------------------------------------------------- */
+
+EventType
+CEventDispatchTable::tagFromString(NSString * inTag)
+{
+	EventType tag = 0;
+	for (NSUInteger i = 0; i < 4; i++)
+		tag = (tag << 8) | (i < inTag.length ? ([inTag characterAtIndex: i] & 0xFF) : ' ');
+	return tag;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Add a handler, keeping the table sorted by tag.
+	The component must implement do_<tag>: -- we look up its implementation now.
+	A later registration for the same tag replaces the earlier one.
+	Args:		inTag				event tag
+				inComponent		the component that handles it
+	Return:	true => added
+				false => the component doesn’t implement do_<tag>:
+----------------------------------------------------------------------------- */
+
+bool
+CEventDispatchTable::add(EventType inTag, id inComponent)
+{
+	char cmd[4] = { (char)(inTag >> 24), (char)(inTag >> 16), (char)(inTag >> 8), (char)inTag };
+	SEL selector = NSSelectorFromString([NSString stringWithFormat: @"do_%.4s:", cmd]);
+	// methodForSelector: would give us the forwarding IMP for a missing method
+	if (![inComponent respondsToSelector: selector])
+		return false;
+	IMP method = [inComponent methodForSelector: selector];
+
+	NSUInteger i;
+	for (i = 0; i < fHandler.size() && fHandler[i].tag < inTag; i++)
+		;
+	if (i == fHandler.size() || fHandler[i].tag != inTag)
+		fHandler.insert(fHandler.begin() + i, EventHandler());
+	EventHandler * handler = &fHandler[i];
+	handler->tag = inTag;
+	handler->component = inComponent;
+	handler->selector = selector;
+	handler->method = method;
+	handler->count = handler->totalTime = handler->maxTime = 0;
+	return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find the handler for an event.
+	Args:		inTag				event tag
+	Return:	the handler, NULL if no component handles the event
+----------------------------------------------------------------------------- */
+
+EventHandler *
+CEventDispatchTable::find(EventType inTag)
+{
+	NSUInteger lo = 0, hi = fHandler.size();
+	while (lo < hi) {
+		NSUInteger mid = (lo + hi) / 2;
+		if (fHandler[mid].tag < inTag)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < fHandler.size() && fHandler[lo].tag == inTag) ? &fHandler[lo] : NULL;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Despatch an event to its handler, timing it.
+	A handler may register another component, which can grow the table and
+	move its entries; so we call through copies and find the entry again
+	afterwards to record the time.
+	Args:		inEvent
+	Return:	true => the event was handled
+----------------------------------------------------------------------------- */
+
+bool
+CEventDispatchTable::dispatch(NCDockEvent * inEvent)
+{
+	EventType tag = inEvent.tag;
+	EventHandler * handler = find(tag);
+	if (handler == NULL)
+		return false;
+	id component = handler->component;
+	SEL selector = handler->selector;
+	EventHandlerProcPtr method = (EventHandlerProcPtr)handler->method;
+
+	uint64_t start = mach_absolute_time();
+	method(component, selector, inEvent);
+	uint64_t elapsed = mach_absolute_time() - start;
+
+	// don’t charge the time to a component that replaced this one meanwhile
+	handler = find(tag);
+	if (handler == NULL || handler->component != component)
+		return true;
+	handler->count++;
+	handler->totalTime += elapsed;
+	if (handler->maxTime < elapsed)
+		handler->maxTime = elapsed;
+	return true;
+}
+
+
+void
+CEventDispatchTable::resetStatistics(void)
+{
+	for (NSUInteger i = 0; i < fHandler.size(); i++)
+		fHandler[i].count = fHandler[i].totalTime = fHandler[i].maxTime = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Log the count, mean and max handling time of each event received.
+	Args:		--
+	Return:	--
+----------------------------------------------------------------------------- */
+
+void
+CEventDispatchTable::logStatistics(void) const
+{
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	for (NSUInteger i = 0; i < fHandler.size(); i++) {
+		const EventHandler * handler = &fHandler[i];
+		if (handler->count > 0) {
+			EventType tag = handler->tag;
+			double toMicroseconds = (double)timebase.numer / (double)timebase.denom / 1000.0;
+			NSLog(@"%c%c%c%c: %llu events, mean %.1fµs, max %.1fµs",
+					(tag >> 24) & 0xFF, (tag >> 16) & 0xFF, (tag >> 8) & 0xFF, tag & 0xFF,
+					handler->count,
+					handler->totalTime * toMicroseconds / handler->count,
+					handler->maxTime * toMicroseconds);
+		}
+	}
+}
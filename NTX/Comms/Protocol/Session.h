@@ -15,6 +15,9 @@
 #import "DockEvent.h"
 #import "DockErrors.h"
 #import "DES.h"
+#import "SoupMirror.h"
+#import "SyncJournal.h"
+#import "EventDispatch.h"
 
 /* --- NCSession error numbers --- */
 
@@ -43,12 +46,17 @@
 	NCDockEventQueue * dockEventQueue;
 
 //	event handlers
-	NSMutableDictionary * eventHandlers;
+	NSMutableDictionary * eventHandlers;	// owns the components
+	CEventDispatchTable eventTable;			// despatches to them
 	dispatch_queue_t tickleQ;
    dispatch_source_t tickleTimer;
 	BOOL isProtocolActive;
 	int tHexade;
 	int tDelta;
+
+//	desktop mirrors of soups, keyed by store and soup name
+	NSMutableDictionary * soupMirrors;
+	NSString * currentStoreKey;
 }
 @property (assign) BOOL isProtocolActive;
 
@@ -63,6 +71,7 @@
 - (void)			stopTickler;
 - (void)			waitForEvent;
 - (void)			doDockEventLoop;
+- (void)			logEventStatistics;
 - (void)			doEvent: (EventType) inCmd;
 - (void)			doEvent: (EventType) inCmd data: (const void *) inData length: (unsigned int) inLength;
 - (void)			setDesktopControl: (int) inCmd;
@@ -128,12 +137,34 @@
 
 - (Ref)			getEntry: (int) inUniqueId;
 - (Ref)			getEntryIds;
+- (Ref)			getChangedEntryIds;
+
+/* --- Soup archives --- */
+
+- (NewtonErr)	exportSoup: (RefArg) inSoupName
+							to: (NSURL *) inURL;
+- (NewtonErr)	importSoup: (NSURL *) inURL;
 
 /* --- Cursor functions --- */
 
 - (NCCursor *)	query: (RefArg) inSoupName
 					 spec: (RefArg) inQuerySpec;
 
+/* --- Soup mirrors --- */
+
+- (NCSoupMirror *)	mirrorSoup: (RefArg) inSoupName;
+- (Ref)			cachedQuery: (RefArg) inSoupName
+							spec: (RefArg) inQuerySpec;
+- (void)			removeMirrors;
+
+/* --- Delta sync --- */
+
+- (NewtonErr)	syncSoup: (RefArg) inSoupName
+					 entries: (RefArg) ioEntries
+					 journal: (NCSyncJournal *) ioJournal
+				  conflicts: (RefArg) outConflicts
+						stats: (SyncStats *) outStats;
+
 /* --- Package loading --- */
 
 - (void)			sendPackage: (NSURL *) inURL
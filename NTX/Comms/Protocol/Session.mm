@@ -14,7 +14,10 @@
 #import "NCXPlugIn.h"
 #import "NCXErrors.h"
 #import "PlugInUtilities.h"
+#import "SoupArchive.h"
+#import "BufferPipe.h"
 #import "Newton/PackageParts.h"
+#include <unordered_set>
 
 
 /* -----------------------------------------------------------------------------
@@ -39,6 +42,7 @@ DeclareException(exBadArgs, exRootException);
 @interface NCSession (Private)
 - (void) postDisconnectionNotification: (NCError) inErr;
 - (void) stopDockEvents;
+- (Ref) entryIdsFromEvent: (NCDockEvent *) inEvt;
 @end
 
 
@@ -68,6 +72,9 @@ DeclareException(exBadArgs, exRootException);
 		isProtocolActive = NO;
 		tHexade = 0;
 		tDelta = 0;
+
+		soupMirrors = [[NSMutableDictionary alloc] init];
+		currentStoreKey = nil;
 	}
 	return self;
 }
@@ -77,6 +84,8 @@ DeclareException(exBadArgs, exRootException);
 {
 	[self stopDockEvents];
 	[eventHandlers release], eventHandlers = nil;	// will release components retained by the dictionary
+	[soupMirrors release], soupMirrors = nil;
+	[currentStoreKey release], currentStoreKey = nil;
 	[super dealloc];
 }
 
@@ -94,6 +103,8 @@ DeclareException(exBadArgs, exRootException);
 	// stop tickling, close the endpoint
 	[self stopTickler];
 	[dockEventQueue release], dockEventQueue = nil;
+	// next time we might be talking to a different Newton
+	[self removeMirrors];
 }
 
 
@@ -108,6 +119,8 @@ DeclareException(exBadArgs, exRootException);
 
 /*------------------------------------------------------------------------------
 	Register a dock event handler component.
+	A tag the component has no do_<tag>: method for is logged and registered
+	neither in the table nor in eventHandlers, so the two always agree.
 	Args:		inComponent
 	Return:	--
 ------------------------------------------------------------------------------*/
@@ -118,7 +131,10 @@ DeclareException(exBadArgs, exRootException);
 	NSAssert(tags != nil && [tags count] > 0, @"no event ids to register");
 	for (NSString * tag in tags)
 	{
-		[eventHandlers setObject: inComponent forKey: tag];	// dictionary retains component
+		if (eventTable.add(CEventDispatchTable::tagFromString(tag), inComponent))
+			[eventHandlers setObject: inComponent forKey: tag];	// dictionary retains component
+		else
+			NSLog(@"%@ does not handle dock event '%@'", [inComponent class], tag);
 	}
 }
 
@@ -220,17 +236,12 @@ DeclareException(exBadArgs, exRootException);
 //		switch (evt.tag), or…
 		if (evt)
 		{
-			NSString * cmd = [evt command];
-
-			id evtHandler = [eventHandlers objectForKey: cmd];
-			if (evtHandler)
+			if (eventTable.find(evt.tag))
 			{
-				SEL tag = NSSelectorFromString([NSString stringWithFormat: @"do_%@:", cmd]);
-				NSAssert([evtHandler respondsToSelector: tag], @"evtHandler does not handle command");
 				// stop sending kDHello while transaction in progress
 				[self resetTickler: kNoTimeout];
 				isProtocolActive = YES;
-				[evtHandler performSelector: tag withObject: evt];
+				eventTable.dispatch(evt);
 			}
 			[evt release];
 		}
@@ -239,6 +250,18 @@ DeclareException(exBadArgs, exRootException);
 }
 
 
+/*------------------------------------------------------------------------------
+	Log how long each kind of event took to handle.
+	Args:		--
+	Return:	--
+------------------------------------------------------------------------------*/
+
+- (void) logEventStatistics
+{
+	eventTable.logStatistics();
+}
+
+
 /*------------------------------------------------------------------------------
 	Newton has disconnected -- post a notification for the dock controller
 	to pick up.
@@ -555,12 +578,17 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 - (NewtonErr) setCurrentStore: (RefArg) inStore
 								 info: (BOOL) inSetStoreInfo
 {
+	NSString * storeKey;
 	if (ISNIL(inStore))
 	{
 		[self sendEvent: kDSetStoreToDefault];
+		storeKey = @"";
 	}
 	else
 	{
+		RefVar signature(GetFrameSlot(inStore, SYMA(signature)));
+		storeKey = [NSString stringWithFormat: @"%@:%ld", MakeNSString(GetFrameSlot(inStore, SYMA(name))), ISINT(signature) ? (long)RVALUE(signature) : 0L];
+
 		RefVar store(AllocateFrame());
 		SetFrameSlot(store, SYMA(name), GetFrameSlot(inStore, SYMA(name)));
 		SetFrameSlot(store, SYMA(kind), GetFrameSlot(inStore, SYMA(kind)));
@@ -570,6 +598,9 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 
 		[self sendEvent: kDSetCurrentStore ref: store];
 	}
+	// mirrors are kept per store, so switching back and forth costs nothing
+	[currentStoreKey release];
+	currentStoreKey = [storeKey retain];
 	return [self receiveResult];
 }
 
@@ -665,7 +696,6 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 {
 	RefVar soupName(DeepClone(inSoupName));
 	uint32_t soupNameLen = Length(soupName);
-	unsigned int alignedSoupNameLen = ALIGN(soupNameLen,4);
 	UniChar * s = (UniChar *) BinaryData(soupName);
 #if defined(hasByteSwapping)
 	UniChar * ss = s;
@@ -673,28 +703,21 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 		*ss++ = BYTE_SWAP_SHORT(*ss);
 #endif
 
-	unsigned int soupIndexLen = FlattenRefSize(inSoupIndex);
-	unsigned int numOfBytes = sizeof(soupNameLen) + alignedSoupNameLen + soupIndexLen;
-	CPtrPipe pipe;
-
 	// Event parms:
 	//		long		soup name length
 	//		char[]	soup name					aligned x4
 	//		Ref		soup indexes
-	char * parms = (char *) malloc(numOfBytes);
+	CBufferPipe parms;
 	// append name length
-	*(uint32_t *)parms = CANONICAL_LONG(soupNameLen);
+	uint32_t nameLen = CANONICAL_LONG(soupNameLen);
+	parms.writeChunk(&nameLen, sizeof(nameLen), false);
 	// append name, aligned on 4-bytes
-	memcpy(parms + sizeof(soupNameLen), s, soupNameLen);
-	int delta = alignedSoupNameLen - soupNameLen;
-	if (delta > 0)
-		memset(parms + sizeof(soupNameLen) + soupNameLen, 0, delta);
+	parms.writeChunk(s, soupNameLen, false);
+	parms.align(4);
 	// append indexes
-	pipe.init(parms + sizeof(soupNameLen) + alignedSoupNameLen, soupIndexLen, NO, nil);
-	FlattenRef(inSoupIndex, pipe);
+	FlattenRef(inSoupIndex, parms);
 
-	[self sendEvent: kDCreateSoup data: parms length: numOfBytes];
-	free(parms);
+	[self sendEvent: kDCreateSoup data: parms.data() length: parms.size()];
 
 	return [self receiveResult];	// kDResult?
 }
@@ -732,6 +755,7 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 
 - (NewtonErr) emptySoup
 {
+	[self removeMirrors];
 	[self sendEvent: kDEmptySoup];
 	return [self receiveResult];
 }
@@ -745,6 +769,7 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 
 - (NewtonErr) deleteSoup
 {
+	[self removeMirrors];
 	[self sendEvent: kDDeleteSoup];
 	return [self receiveResult];
 }
@@ -932,17 +957,33 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 	newton_try
 	{
 		NCDockEvent * evt = [self sendEvent: kDGetSoupIDs expecting: kDSoupIDs];
+		entryIds = [self entryIdsFromEvent: evt];
+	}
+	newton_catch_all
+	{
+		entryIds = NILREF;
+	}
+	end_try;
+
+	return entryIds;
+}
 
-		// data are longs; number of ids followed by the ids
-		int32_t * idArray = (int32_t *)evt.data;
-		ArrayIndex	numOfIds = CANONICAL_LONG(*idArray);
-		idArray++;
 
-		entryIds = MakeArray(numOfIds);
-		for (ArrayIndex i = 0; i < numOfIds; i++, idArray++)
-		{
-			SetArraySlot(entryIds, i, CANONICAL_LONG(*idArray));
-		}
+/*------------------------------------------------------------------------------
+	Return the ids of entries in the currently set soup that have changed
+	since the time set by -setLastSyncTime:.
+	Args:		--
+	Return:	array ref
+------------------------------------------------------------------------------*/
+
+- (Ref) getChangedEntryIds
+{
+	RefVar entryIds;
+
+	newton_try
+	{
+		NCDockEvent * evt = [self sendEvent: kDGetChangedIDs expecting: kDSoupIDs];
+		entryIds = [self entryIdsFromEvent: evt];
 	}
 	newton_catch_all
 	{
@@ -954,6 +995,129 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 }
 
 
+/*------------------------------------------------------------------------------
+	Helper: make an array of entry ids from a kDSoupIDs event.
+	Args:		inEvt
+	Return:	array ref
+------------------------------------------------------------------------------*/
+
+- (Ref) entryIdsFromEvent: (NCDockEvent *) inEvt
+{
+	// data are longs; number of ids followed by the ids
+	int32_t * idArray = (int32_t *)inEvt.data;
+	ArrayIndex	numOfIds = CANONICAL_LONG(*idArray);
+	idArray++;
+
+	RefVar entryIds(MakeArray(numOfIds));
+	for (ArrayIndex i = 0; i < numOfIds; i++, idArray++)
+	{
+		SetArraySlot(entryIds, i, MAKEINT(CANONICAL_LONG(*idArray)));
+	}
+	return entryIds;
+}
+
+
+#pragma mark Soup Archives
+/*------------------------------------------------------------------------------
+	Export a soup to an archive file.
+	Each entry is written to the archive as soon as it arrives, so a soup of
+	any size is exported in constant memory.
+	Args:		inSoupName
+				inURL				archive file
+	Return:	error code
+------------------------------------------------------------------------------*/
+
+- (NewtonErr) exportSoup: (RefArg) inSoupName to: (NSURL *) inURL
+{
+	NewtonErr err;
+	if ((err = [self setCurrentSoup: inSoupName]) != noErr)
+		return err;
+
+	RefVar desc(AllocateFrame());
+	SetFrameSlot(desc, SYMA(name), inSoupName);
+	SetFrameSlot(desc, SYMA(indexes), [self getSoupIndexes]);
+	SetFrameSlot(desc, SYMA(info), [self getSoupInfo]);
+	newton_try
+	{
+		// a file that can’t be created throws here, and is reported like any other error
+		CSoupArchiveWriter archive(inURL.fileSystemRepresentation, desc);
+		unwind_protect
+		{
+			RefVar entryIds([self getEntryIds]);
+			ArrayIndex count = ISNIL(entryIds) ? 0 : Length(entryIds);
+			for (ArrayIndex i = 0; i < count; i++)
+			{
+				archive.addEntry([self getEntry: RVALUE(GetArraySlot(entryIds, i))]);
+			}
+			archive.close();
+		}
+		on_unwind
+		{
+			// longjmp skips the destructor
+			archive.discard();
+		}
+		end_unwind;
+	}
+	newton_catch_all
+	{
+		err = (NewtonErr)(long)CurrentException()->data;
+	}
+	end_try;
+
+	return err;
+}
+
+
+/*------------------------------------------------------------------------------
+	Import a soup from an archive file.
+	The soup is created if necessary. Entries are read from the archive one at
+	a time as they are added.
+	Args:		inURL				archive file
+	Return:	error code
+------------------------------------------------------------------------------*/
+
+- (NewtonErr) importSoup: (NSURL *) inURL
+{
+	NewtonErr err = noErr;
+	newton_try
+	{
+		// a file that isn’t an archive throws here, and is reported like any other error
+		CSoupArchiveReader archive(inURL.fileSystemRepresentation);
+		unwind_protect
+		{
+			RefVar desc(archive.description());
+			RefVar soupName(GetFrameSlot(desc, SYMA(name)));
+			if ([self setCurrentSoup: soupName] != noErr)
+			{
+				if ((err = [self createSoup: soupName index: GetFrameSlot(desc, SYMA(indexes))]) == noErr
+				&&  (err = [self setCurrentSoup: soupName]) == noErr)
+					err = [self setSoupInfo: GetFrameSlot(desc, SYMA(info))];
+			}
+
+			RefVar entry;
+			while (err == noErr && NOTNIL(entry = archive.nextEntry()))
+			{
+				// the Newton assigns new ids
+				RemoveSlot(entry, SYMA(_uniqueId));
+				err = [self addEntry: entry];
+			}
+		}
+		on_unwind
+		{
+			archive.discard();
+		}
+		end_unwind;
+	}
+	newton_catch_all
+	{
+		err = (NewtonErr)(long)CurrentException()->data;
+	}
+	end_try;
+
+	return err;
+}
+
+
 #pragma mark Cursor
 /*------------------------------------------------------------------------------
 	Query a soup.
@@ -974,6 +1138,270 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 }
 
 
+#pragma mark Soup Mirrors
+/*------------------------------------------------------------------------------
+	Return an up-to-date desktop mirror of a soup on the current store.
+	The first time, every entry is fetched. After that the Newton is asked on
+	every call which entries have changed since the last refresh -- whether by
+	us or on the Newton itself -- and only those are fetched; the full id list
+	tells us what has been deleted.
+	Args:		inSoupName
+	Return:	the mirror, nil if the soup can’t be set
+------------------------------------------------------------------------------*/
+
+- (NCSoupMirror *) mirrorSoup: (RefArg) inSoupName
+{
+	NSString * key = [NSString stringWithFormat: @"%@/%@", currentStoreKey ? currentStoreKey : @"", MakeNSString(inSoupName)];
+	NCSoupMirror * mirror = [soupMirrors objectForKey: key];
+
+	if ([self setCurrentSoup: inSoupName] != noErr)
+		return nil;
+
+	// note the time before fetching anything so we can’t miss a change
+	uint32_t syncTime = [self setLastSyncTime: mirror ? mirror.syncTime : 0] - tHexade * kLengthOfHexade;
+	RefVar changedIds;
+	if (mirror == nil)
+	{
+		mirror = [[NCSoupMirror alloc] initWithIndexes: [self getSoupIndexes]];
+		[soupMirrors setObject: mirror forKey: key];
+		[mirror release];
+	}
+	else
+		changedIds = [self getChangedEntryIds];
+	RefVar entryIds([self getEntryIds]);
+	if (ISNIL(entryIds))
+		return nil;
+	if (ISNIL(changedIds))
+		changedIds = entryIds;
+	mirror.syncTime = syncTime;
+
+	[mirror retainEntryIds: entryIds];
+	ArrayIndex count = Length(changedIds);
+	RefVar changedEntries(MakeArray(count));
+	for (ArrayIndex i = 0; i < count; i++)
+	{
+		SetArraySlot(changedEntries, i, [self getEntry: RVALUE(GetArraySlot(changedIds, i))]);
+	}
+	[mirror updateEntries: changedEntries];
+	return mirror;
+}
+
+
+/*------------------------------------------------------------------------------
+	Query a soup using its desktop mirror.
+	Args:		inSoupName
+				inQuerySpec
+	Return:	array of entries (shared with the mirror -- clone to modify)
+				nil => the query needs the Newton; use -query:spec:
+------------------------------------------------------------------------------*/
+
+- (Ref) cachedQuery: (RefArg) inSoupName spec: (RefArg) inQuerySpec
+{
+	VALIDARG(IsString(inSoupName));
+	VALIDARG(ISNIL(inQuerySpec) || IsFrame(inQuerySpec));
+
+	NCSoupMirror * mirror = [self mirrorSoup: inSoupName];
+	if (mirror == nil || ![mirror canAnswer: inQuerySpec])
+		return NILREF;
+	return [mirror query: inQuerySpec];
+}
+
+
+/*------------------------------------------------------------------------------
+	Forget all mirrors. Entries we write are picked up as changes on the next
+	refresh, but a soup that is emptied or deleted (and maybe recreated with
+	different indexes) must be mirrored afresh.
+	Args:		--
+	Return:	--
+------------------------------------------------------------------------------*/
+
+- (void) removeMirrors
+{
+	[soupMirrors removeAllObjects];
+}
+
+
+#pragma mark Delta Sync
+/*------------------------------------------------------------------------------
+	Synchronize the desktop copy of a soup with the Newton.
+	The journal records every entry as of the last sync, so we only fetch
+	entries the Newton reports changed since then, and only send entries whose
+	content hash differs from the journal’s. Deletions are sent in one
+	batch. If an entry changed on both sides, the Newton’s version replaces
+	the desktop’s in ioEntries, and the desktop’s is handed back in
+	outConflicts so the caller can merge it or offer it to the user.
+	Args:		inSoupName
+				ioEntries		array of desktop entries
+									entries without a _uniqueId are added to the soup
+									entries deleted from the array are deleted from the soup
+				ioJournal		journal of the last sync; updated
+				outConflicts	array to which the desktop version of each conflicting
+									entry is added; may be nil
+				outStats			what was done; may be NULL
+	Return:	error code
+------------------------------------------------------------------------------*/
+
+- (NewtonErr) syncSoup: (RefArg) inSoupName entries: (RefArg) ioEntries journal: (NCSyncJournal *) ioJournal conflicts: (RefArg) outConflicts stats: (SyncStats *) outStats
+{
+	VALIDARG(IsArray(ioEntries));
+	VALIDARG(ISNIL(outConflicts) || IsArray(outConflicts));
+
+	SyncStats stats;
+	memset(&stats, 0, sizeof(stats));
+	NewtonErr err;
+	if ((err = [self setCurrentSoup: inSoupName]) != noErr)
+		return err;
+
+	// note the time before fetching anything so we can’t miss a change
+	uint32_t syncTime = [self setLastSyncTime: ioJournal.lastSyncTime] - tHexade * kLengthOfHexade;
+	RefVar changedIds(ioJournal.count > 0 ? [self getChangedEntryIds] : [self getEntryIds]);
+	RefVar entryIds([self getEntryIds]);
+	if (ISNIL(changedIds) || ISNIL(entryIds))
+		return kDockErrProtocolError;
+
+	std::unordered_set<int32_t> onNewton;
+	onNewton.reserve(Length(entryIds));
+	for (CSlotIterator iter(entryIds); !iter.done(); iter.next())
+		onNewton.insert(RVALUE(iter.value()));
+
+	std::unordered_map<int32_t, ArrayIndex> desktopSlot;
+	RefVar entry;
+	for (CSlotIterator iter(ioEntries); !iter.done(); iter.next())
+	{
+		entry = iter.value();
+		RefVar uid(GetFrameSlot(entry, SYMA(_uniqueId)));
+		if (ISINT(uid))
+			desktopSlot[RVALUE(uid)] = iter.index();
+	}
+
+	// Newton -> desktop: changed entries
+	std::unordered_set<int32_t> fetched;
+	ArrayIndex count = Length(changedIds);
+	for (ArrayIndex i = 0; i < count; i++)
+	{
+		entry = [self getEntry: RVALUE(GetArraySlot(changedIds, i))];
+		if (!IsFrame(entry))
+			continue;
+		int32_t uid = RVALUE(GetFrameSlot(entry, SYMA(_uniqueId)));
+		std::unordered_map<int32_t, ArrayIndex>::iterator found = desktopSlot.find(uid);
+		if (found != desktopSlot.end())
+		{
+			RefVar desktopEntry(GetArraySlot(ioEntries, found->second));
+			if ([ioJournal recordFor: uid] != NULL && [ioJournal isChanged: desktopEntry] && HashEntry(desktopEntry) != HashEntry(entry))
+			{
+				if (NOTNIL(outConflicts))
+					AddArraySlot(outConflicts, desktopEntry);
+				stats.conflicts++;
+			}
+			SetArraySlot(ioEntries, found->second, entry);
+		}
+		else
+		{
+			desktopSlot[uid] = Length(ioEntries);
+			AddArraySlot(ioEntries, entry);
+		}
+		[ioJournal setEntry: entry];
+		fetched.insert(uid);
+		stats.fetched++;
+	}
+
+	// entries in the journal that have gone from either side
+	std::vector<int32_t> journalIds;
+	journalIds.reserve(ioJournal.count);
+	std::vector<int32_t> * journalIdsPtr = &journalIds;
+	[ioJournal enumerateEntryIds: ^(int32_t inUniqueId) { journalIdsPtr->push_back(inUniqueId); }];
+
+	std::unordered_set<ArrayIndex> removedSlots;
+	RefVar deletedIds(MakeArray(0));
+	for (std::vector<int32_t>::iterator uid = journalIds.begin(); uid != journalIds.end(); ++uid)
+	{
+		std::unordered_map<int32_t, ArrayIndex>::iterator found = desktopSlot.find(*uid);
+		if (onNewton.find(*uid) == onNewton.end())
+		{
+			// deleted on the Newton
+			if (found != desktopSlot.end())
+			{
+				removedSlots.insert(found->second);
+				desktopSlot.erase(found);
+				stats.removed++;
+			}
+			[ioJournal removeEntryId: *uid];
+		}
+		else if (found == desktopSlot.end())
+		{
+			// deleted on the desktop
+			AddArraySlot(deletedIds, MAKEINT(*uid));
+			[ioJournal removeEntryId: *uid];
+		}
+	}
+
+	// desktop -> Newton: changed and new entries
+	RefVar changedEntries(MakeArray(0));
+	RefVar newEntries(MakeArray(0));
+	for (CSlotIterator iter(ioEntries); !iter.done(); iter.next())
+	{
+		if (removedSlots.find(iter.index()) != removedSlots.end())
+			continue;
+		entry = iter.value();
+		RefVar uid(GetFrameSlot(entry, SYMA(_uniqueId)));
+		if (!ISINT(uid))
+			AddArraySlot(newEntries, entry);
+		else if (fetched.find(RVALUE(uid)) == fetched.end() && [ioJournal isChanged: entry])
+			AddArraySlot(changedEntries, entry);
+	}
+
+	newton_try
+	{
+		if (err == noErr && Length(deletedIds) > 0)
+		{
+			err = [self deleteEntryIdList: deletedIds];
+			stats.deleted = Length(deletedIds);
+		}
+		for (CSlotIterator iter(changedEntries); err == noErr && !iter.done(); iter.next())
+		{
+			entry = iter.value();
+			if ((err = [self changeEntry: entry]) == noErr)
+			{
+				[ioJournal setEntry: entry];
+				stats.changed++;
+			}
+		}
+		for (CSlotIterator iter(newEntries); err == noErr && !iter.done(); iter.next())
+		{
+			entry = iter.value();
+			// addEntry: gives the entry its _uniqueId and _modTime
+			if ((err = [self addEntry: entry]) == noErr)
+			{
+				[ioJournal setEntry: entry];
+				stats.added++;
+			}
+		}
+	}
+	newton_catch_all
+	{
+		err = (NewtonErr)(long)CurrentException()->data;
+	}
+	end_try;
+
+	// compact the desktop entries
+	if (!removedSlots.empty())
+	{
+		ArrayIndex dst = 0, numOfEntries = Length(ioEntries);
+		for (ArrayIndex src = 0; src < numOfEntries; src++)
+			if (removedSlots.find(src) == removedSlots.end())
+				SetArraySlot(ioEntries, dst++, GetArraySlot(ioEntries, src));
+		SetLength(ioEntries, dst);
+	}
+
+	// if anything failed, next time we’ll look again at everything since the last good sync
+	if (err == noErr)
+		ioJournal.lastSyncTime = syncTime;
+	if (outStats)
+		*outStats = stats;
+	return err;
+}
+
+
 #pragma mark Packages
 /*------------------------------------------------------------------------------
 	Send a package.
@@ -1092,22 +1520,14 @@ NSLog(@"-[NCSession receiveEvent:] nil event");
 	ASSERT(inName != NULL);
 
 	RefVar name(MakeSymbol(inName));
-	unsigned int nameSize = FlattenRefSize(name);
-	unsigned int argsSize = FlattenRefSize(inArgs);
-	unsigned int numOfBytes = nameSize + argsSize;
-	CPtrPipe pipe;
 
 	// Event parms:
 	//		Ref	function/method name
 	//		Ref	function/method args
-	char * parms = (char *) malloc(numOfBytes);
-//memset(parms, 0, numOfBytes);
-	pipe.init(parms, nameSize, NO, nil);
-	FlattenRef(name, pipe);
-	pipe.init(parms + nameSize, argsSize, NO, nil);
-	FlattenRef(inArgs, pipe);
-	[self sendEvent: inCmd length: kIndeterminateLength data: parms length: numOfBytes];
-	free(parms);
+	CBufferPipe parms;
+	FlattenRef(name, parms);
+	FlattenRef(inArgs, parms);
+	[self sendEvent: inCmd length: kIndeterminateLength data: parms.data() length: parms.size()];
 
 	NCDockEvent * evt = [self receiveEvent: kDAnyEvent];
 	if (evt.tag == kDCallResult)
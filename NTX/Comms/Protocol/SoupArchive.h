@@ -0,0 +1,94 @@
+/*
+	File:		SoupArchive.h
+
+	Contains:	On-disk archive of soup entries, for bulk backup and restore.
+					An archive is a header, a soup description record, then one
+					record per entry. Each record is its length followed by the
+					flattened (NSOF) object, padded to a long boundary.
+					Entries are written as they arrive and read back one at a time
+					straight off the mapped file, so neither side ever holds the
+					whole soup in memory.
+					Not yet part of the NTX target, along with the dock session that
+					uses it, so this has not been compiled.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__SOUPARCHIVE_H)
+#define __SOUPARCHIVE_H 1
+
+#include "NewtonKit.h"
+#include "MappedFilePipe.h"
+
+#define kSoupArchiveSignature	'NSOA'
+#define kSoupArchiveVersion	1
+
+struct SoupArchiveHeader
+{
+	uint32_t		signature;
+	uint32_t		version;
+	uint32_t		numOfEntries;
+	uint32_t		reserved;
+};
+
+
+/* -----------------------------------------------------------------------------
+	C S o u p A r c h i v e W r i t e r
+	The description is a frame: {name:, indexes:, info:}
+	The entry count in the header is filled in by close(), which must be
+	called -- otherwise the archive is incomplete. Throws exPipe if the file
+	can’t be created or written. As with CMappedFilePipe, call discard() in an
+	on_unwind clause to release the file if an exception abandons the writer.
+----------------------------------------------------------------------------- */
+
+class CSoupArchiveWriter
+{
+public:
+				CSoupArchiveWriter(const char * inFilename, RefArg inDescription);
+
+	void		addEntry(RefArg inEntry);
+	void		close(void);
+	void		discard(void);
+
+	ArrayIndex	count(void) const;
+
+private:
+	void		writeRecord(const void * inData, size_t inLength);
+
+	CMappedFilePipe	fPipe;
+	ArrayIndex			fNumOfEntries;
+};
+
+inline ArrayIndex	CSoupArchiveWriter::count(void) const { return fNumOfEntries; }
+inline void			CSoupArchiveWriter::discard(void) { fPipe.discard(); }
+
+
+/* -----------------------------------------------------------------------------
+	C S o u p A r c h i v e R e a d e r
+	Throws exPipe if the file is not a soup archive. Call discard() in an
+	on_unwind clause to release the file if an exception abandons the reader.
+----------------------------------------------------------------------------- */
+
+class CSoupArchiveReader
+{
+public:
+				CSoupArchiveReader(const char * inFilename);
+
+	Ref		description(void);
+	Ref		nextEntry(void);		// NILREF at end of archive
+	void		discard(void);
+
+	ArrayIndex	count(void) const;
+
+private:
+	Ref		readRecord(void);
+
+	CMappedFilePipe	fPipe;
+	ArrayIndex			fNumOfEntries;
+	ArrayIndex			fIndex;
+};
+
+inline ArrayIndex	CSoupArchiveReader::count(void) const { return fNumOfEntries; }
+inline void			CSoupArchiveReader::discard(void) { fPipe.discard(); }
+
+#endif	/* __SOUPARCHIVE_H */
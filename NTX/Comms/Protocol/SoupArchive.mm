@@ -0,0 +1,173 @@
+/*
+	File:		SoupArchive.mm
+
+	Contains:	On-disk archive of soup entries, for bulk backup and restore.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "SoupArchive.h"
+#import "BufferPipe.h"
+
+
+/* -----------------------------------------------------------------------------
+	C S o u p A r c h i v e W r i t e r
+----------------------------------------------------------------------------- */
+
+CSoupArchiveWriter::CSoupArchiveWriter(const char * inFilename, RefArg inDescription)
+	:	fPipe(inFilename, "w"), fNumOfEntries(0)
+{
+	// the caller never gets a writer to discard if we throw
+	unwind_protect
+	{
+		SoupArchiveHeader header;
+		header.signature = CANONICAL_LONG(kSoupArchiveSignature);
+		header.version = CANONICAL_LONG(kSoupArchiveVersion);
+		header.numOfEntries = 0;
+		header.reserved = 0;
+		fPipe.writeChunk(&header, sizeof(header), false);
+
+		CBufferPipe desc;
+		FlattenRef(inDescription, desc);
+		writeRecord(desc.data(), desc.size());
+	}
+	on_unwind
+	{
+		if (unwind_failed())
+			fPipe.discard();
+	}
+	end_unwind;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Add an entry to the archive.
+	Args:		inEntry			soup entry frame
+	Return:	--
+----------------------------------------------------------------------------- */
+
+void
+CSoupArchiveWriter::addEntry(RefArg inEntry)
+{
+	CBufferPipe entry;
+	FlattenRef(inEntry, entry);
+	writeRecord(entry.data(), entry.size());
+	fNumOfEntries++;
+}
+
+
+void
+CSoupArchiveWriter::writeRecord(const void * inData, size_t inLength)
+{
+	uint32_t length = CANONICAL_LONG(inLength);
+	fPipe.writeChunk(&length, sizeof(length), false);
+	fPipe.writeChunk(inData, inLength, false);
+	size_t delta = inLength & 3;
+	if (delta != 0) {
+		uint32_t padding = 0;
+		fPipe.writeChunk(&padding, 4 - delta, false);
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Fill in the entry count, write everything out and close the file.
+	Throws exPipe if the file can’t be written.
+	Args:		--
+	Return:	--
+----------------------------------------------------------------------------- */
+
+void
+CSoupArchiveWriter::close(void)
+{
+	long endOfArchive = fPipe.writePosition();
+	uint32_t numOfEntries = CANONICAL_LONG(fNumOfEntries);
+	fPipe.writeSeek(offsetof(SoupArchiveHeader, numOfEntries), SEEK_SET);
+	fPipe.writeChunk(&numOfEntries, sizeof(numOfEntries), false);
+	fPipe.writeSeek(endOfArchive, SEEK_SET);
+	NewtonErr err = fPipe.close();
+	if (err)
+		ThrowErr(exPipe, err);
+}
+
+
+/* -----------------------------------------------------------------------------
+	C S o u p A r c h i v e R e a d e r
+----------------------------------------------------------------------------- */
+
+CSoupArchiveReader::CSoupArchiveReader(const char * inFilename)
+	:	fPipe(inFilename, "r"), fNumOfEntries(0), fIndex(0)
+{
+	// the caller never gets a reader to discard if we throw
+	unwind_protect
+	{
+		size_t size = sizeof(SoupArchiveHeader);
+		const SoupArchiveHeader * header = (const SoupArchiveHeader *)fPipe.readSpan(size);
+		if (size < sizeof(SoupArchiveHeader)
+		||  CANONICAL_LONG(header->signature) != kSoupArchiveSignature
+		||  CANONICAL_LONG(header->version) != kSoupArchiveVersion)
+			ThrowErr(exPipe, kOSErrBadParameters);
+		fNumOfEntries = CANONICAL_LONG(header->numOfEntries);
+
+		// skip the description; we can always come back for it
+		size = sizeof(uint32_t);
+		const uint32_t * length = (const uint32_t *)fPipe.readSpan(size);
+		if (size < sizeof(uint32_t))
+			ThrowErr(exPipe, kOSErrBadParameters);
+		fPipe.readSeek(ALIGN(CANONICAL_LONG(*length), 4), SEEK_CUR);
+	}
+	on_unwind
+	{
+		if (unwind_failed())
+			fPipe.discard();
+	}
+	end_unwind;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the soup description.
+	Args:		--
+	Return:	frame
+----------------------------------------------------------------------------- */
+
+Ref
+CSoupArchiveReader::description(void)
+{
+	long offset = fPipe.readPosition();
+	fPipe.readSeek(sizeof(SoupArchiveHeader), SEEK_SET);
+	RefVar desc(readRecord());
+	fPipe.readSeek(offset, SEEK_SET);
+	return desc;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the next entry in the archive.
+	Args:		--
+	Return:	soup entry frame, NILREF at end of archive
+----------------------------------------------------------------------------- */
+
+Ref
+CSoupArchiveReader::nextEntry(void)
+{
+	if (fIndex >= fNumOfEntries)
+		return NILREF;
+	fIndex++;
+	return readRecord();
+}
+
+
+Ref
+CSoupArchiveReader::readRecord(void)
+{
+	size_t size = sizeof(uint32_t);
+	const uint32_t * length = (const uint32_t *)fPipe.readSpan(size);
+	if (size < sizeof(uint32_t))
+		ThrowErr(exPipe, kOSErrBadParameters);
+	// don’t rely on UnflattenRef() to leave the pipe at the end of the record
+	long endOfRecord = fPipe.readPosition() + ALIGN(CANONICAL_LONG(*length), 4);
+	RefVar obj(UnflattenRef(fPipe));
+	fPipe.readSeek(endOfRecord, SEEK_SET);
+	return obj;
+}
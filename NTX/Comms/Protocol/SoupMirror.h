@@ -0,0 +1,75 @@
+/*
+	File:		SoupMirror.h
+
+	Contains:	Desktop-side mirror of a Newton soup.
+					Entries are kept by _uniqueId, with local indexes matching the
+					soup’s own, so simple queries can be answered without driving a
+					cursor on the Newton one entry at a time.
+					Not yet part of the NTX target, along with the dock session that
+					uses it, so this has not been compiled.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <Foundation/Foundation.h>
+#import "NewtonKit.h"
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+typedef std::basic_string<UniChar> UniString;
+
+/* --- Index key: numeric or string --- */
+
+struct SoupIndexKey
+{
+	double		num;
+	UniString	str;
+	ArrayIndex	slot;			// of the entry in the mirror
+};
+
+/* --- Local equivalent of a soup index --- */
+
+struct SoupIndex
+{
+	RefStruct	path;
+	bool			isString;
+	bool			isValid;		// keys are sorted and up to date
+	std::vector<SoupIndexKey>	keys;
+};
+
+
+/* -----------------------------------------------------------------------------
+	N C S o u p M i r r o r
+	Index order is rebuilt lazily, on the first query after entries change.
+	Queries can be answered locally if they use only indexPath (a single-slot
+	index), begin/end keys and words. Anything that needs a NewtonScript test
+	function has to go to the Newton.
+	A mirror knows only what it was told at its last refresh; the session
+	refreshes it from the Newton’s changed entry ids before every query.
+	String keys are compared with the desktop’s collation, which need not be
+	the store’s, so a string index can’t answer a query bounded by keys.
+----------------------------------------------------------------------------- */
+
+@interface NCSoupMirror : NSObject
+{
+	RefStruct entries;				// array; slots of removed entries are nil
+	std::unordered_map<int32_t, ArrayIndex>	slotOfId;
+	std::vector<ArrayIndex>	freeSlots;
+	std::vector<SoupIndex>	indexes;
+
+	uint32_t syncTime;
+}
+@property (assign) uint32_t syncTime;	// Newton time at the last refresh
+@property (readonly) NSUInteger count;
+
+- (id)		initWithIndexes: (RefArg) inIndexes;
+
+- (void)		updateEntries: (RefArg) inEntries;
+- (void)		retainEntryIds: (RefArg) inEntryIds;
+- (Ref)		entry: (int) inUniqueId;
+
+- (BOOL)		canAnswer: (RefArg) inQuerySpec;
+- (Ref)		query: (RefArg) inQuerySpec;
+
+@end
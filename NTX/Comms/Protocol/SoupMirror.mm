@@ -0,0 +1,509 @@
+/*
+	File:		SoupMirror.mm
+
+	Contains:	Desktop-side mirror of a Newton soup.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "SoupMirror.h"
+#import <NTK/UStringUtils.h>
+#include <algorithm>
+
+
+/* -----------------------------------------------------------------------------
+	Fold a string for comparison: the Newton sorts strings without regard to
+	case or diacritics.
+	Args:		inStr			string object
+				outStr		folded copy
+	Return:	--
+----------------------------------------------------------------------------- */
+
+static void
+FoldString(RefArg inStr, UniString & outStr)
+{
+	ArrayIndex len = Length(inStr) / sizeof(UniChar);
+	const UniChar * s = GetUString(inStr);
+	if (len > 0 && s[len-1] == kEndOfString)
+		len--;
+	outStr.assign(s, len);
+	if (len > 0)
+		UpperCaseNoDiacriticsText(&outStr[0], len);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Make an index key from a slot value.
+	String keys are kept as they are and compared with CompareUnicodeText(),
+	the Newton’s own collation; but that uses the desktop’s sorting table,
+	which need not be the one the store’s index was built with.
+	Args:		inValue		slot value
+				inIsString	the index is on strings (or symbols)
+				outKey		the key
+	Return:	true => value is of the index’s type
+----------------------------------------------------------------------------- */
+
+static bool
+MakeKey(RefArg inValue, bool inIsString, SoupIndexKey & outKey)
+{
+	outKey.num = 0.0;
+	outKey.str.clear();
+	if (inIsString) {
+		if (IsString(inValue)) {
+			ArrayIndex len = Length(inValue) / sizeof(UniChar);
+			const UniChar * s = GetUString(inValue);
+			if (len > 0 && s[len-1] == kEndOfString)
+				len--;
+			outKey.str.assign(s, len);
+		} else if (IsSymbol(inValue)) {
+			for (const char * s = SymbolName(inValue); *s; s++)
+				outKey.str.push_back(toupper((unsigned char)*s));
+		} else
+			return false;
+	} else {
+		if (ISINT(inValue))
+			outKey.num = RVALUE(inValue);
+		else if (IsReal(inValue))
+			outKey.num = CDouble(inValue);
+		else if (IsChar(inValue))
+			outKey.num = RefToUniChar(inValue);
+		else
+			return false;
+	}
+	return true;
+}
+
+
+static bool
+KeyLess(const SoupIndexKey & a, const SoupIndexKey & b)
+{
+	if (a.num != b.num)
+		return a.num < b.num;
+	return CompareUnicodeText(a.str.data(), a.str.length(), b.str.data(), b.str.length()) < 0;
+}
+
+
+static bool
+IdLess(const std::pair<int32_t, ArrayIndex> & a, const std::pair<int32_t, ArrayIndex> & b)
+{
+	return a.first < b.first;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Collect the folded text of every string in an entry, for words queries.
+	Args:		inObj			entry, or an object within it
+				ioText		text so far
+				inDepth		guard against very deep (or circular) structures
+	Return:	--
+----------------------------------------------------------------------------- */
+
+static void
+CollectText(RefArg inObj, UniString & ioText, int inDepth)
+{
+	if (IsString(inObj)) {
+		UniString str;
+		FoldString(inObj, str);
+		ioText.push_back(' ');
+		ioText.append(str);
+	} else if (inDepth < 8 && (IsFrame(inObj) || IsArray(inObj))) {
+		RefVar item;
+		for (CSlotIterator iter(inObj); !iter.done(); iter.next()) {
+			item = iter.value();
+			CollectText(item, ioText, inDepth + 1);
+		}
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Does every word begin a word in the text?
+	Args:		inText			folded entry text
+				inWords			folded query words
+				inEntireWords	words must match entire words
+	Return:	true => entry matches
+----------------------------------------------------------------------------- */
+
+static bool
+MatchWords(const UniString & inText, const std::vector<UniString> & inWords, bool inEntireWords)
+{
+	for (std::vector<UniString>::const_iterator w = inWords.begin(); w != inWords.end(); ++w) {
+		bool isFound = false;
+		for (size_t pos = inText.find(*w); pos != UniString::npos && !isFound; pos = inText.find(*w, pos + 1)) {
+			size_t end = pos + w->length();
+			isFound = (pos == 0 || !IsAlphaNumeric(inText[pos-1]))
+					 && (!inEntireWords || end == inText.length() || !IsAlphaNumeric(inText[end]));
+		}
+		if (!isFound)
+			return false;
+	}
+	return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+	N C S o u p M i r r o r
+----------------------------------------------------------------------------- */
+
+@implementation NCSoupMirror
+
+@synthesize syncTime;
+
+/* -----------------------------------------------------------------------------
+	Initialize.
+	Args:		inIndexes		soup indexes as returned by -getSoupIndexes
+	Return:	self
+----------------------------------------------------------------------------- */
+
+- (id) initWithIndexes: (RefArg) inIndexes
+{
+	if (self = [super init])
+	{
+		entries = MakeArray(0);
+		syncTime = 0;
+
+		// we can only use single-slot indexes
+		if (IsArray(inIndexes))
+		{
+			RefVar indexSpec;
+			for (CSlotIterator iter(inIndexes); !iter.done(); iter.next())
+			{
+				indexSpec = iter.value();
+				RefVar path(GetFrameSlot(indexSpec, SYMA(path)));
+				RefVar type(GetFrameSlot(indexSpec, SYMA(type)));
+				if (EQRef(GetFrameSlot(indexSpec, SYMA(structure)), SYMA(slot)) && IsSymbol(path))
+				{
+					SoupIndex index;
+					index.path = path;
+					index.isString = EQRef(type, SYMA(string)) || EQRef(type, SYMA(symbol));
+					index.isValid = false;
+					indexes.push_back(index);
+				}
+			}
+		}
+	}
+	return self;
+}
+
+
+- (NSUInteger) count
+{
+	return slotOfId.size();
+}
+
+
+/* -----------------------------------------------------------------------------
+	Add or replace entries.
+	Args:		inEntries		array of soup entries
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void) updateEntries: (RefArg) inEntries
+{
+	RefVar entry;
+	for (CSlotIterator iter(inEntries); !iter.done(); iter.next())
+	{
+		entry = iter.value();
+		RefVar uid(GetFrameSlot(entry, SYMA(_uniqueId)));
+		if (!ISINT(uid))
+			continue;
+		std::unordered_map<int32_t, ArrayIndex>::iterator found = slotOfId.find(RVALUE(uid));
+		if (found != slotOfId.end())
+			SetArraySlot(entries, found->second, entry);
+		else
+		{
+			ArrayIndex slot;
+			if (freeSlots.empty())
+			{
+				slot = Length(entries);
+				AddArraySlot(entries, entry);
+			}
+			else
+			{
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+				SetArraySlot(entries, slot, entry);
+			}
+			slotOfId[RVALUE(uid)] = slot;
+		}
+	}
+	for (std::vector<SoupIndex>::iterator index = indexes.begin(); index != indexes.end(); ++index)
+		index->isValid = false;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Remove entries that are no longer in the soup.
+	Args:		inEntryIds		array of ids of all entries in the soup
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void) retainEntryIds: (RefArg) inEntryIds
+{
+	std::unordered_map<int32_t, ArrayIndex> retained;
+	retained.reserve(Length(inEntryIds));
+	for (CSlotIterator iter(inEntryIds); !iter.done(); iter.next())
+	{
+		std::unordered_map<int32_t, ArrayIndex>::iterator found = slotOfId.find(RVALUE(iter.value()));
+		if (found != slotOfId.end())
+		{
+			retained.insert(*found);
+			slotOfId.erase(found);
+		}
+	}
+	if (slotOfId.empty())
+	{
+		slotOfId.swap(retained);
+		return;
+	}
+	// whatever’s left has been deleted
+	for (std::unordered_map<int32_t, ArrayIndex>::iterator removed = slotOfId.begin(); removed != slotOfId.end(); ++removed)
+	{
+		SetArraySlot(entries, removed->second, RA(NILREF));
+		freeSlots.push_back(removed->second);
+	}
+	slotOfId.swap(retained);
+	for (std::vector<SoupIndex>::iterator index = indexes.begin(); index != indexes.end(); ++index)
+		index->isValid = false;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return an entry.
+	Args:		inUniqueId		entry id
+	Return:	the entry, NILREF if it’s not in the mirror
+----------------------------------------------------------------------------- */
+
+- (Ref) entry: (int) inUniqueId
+{
+	std::unordered_map<int32_t, ArrayIndex>::iterator found = slotOfId.find(inUniqueId);
+	return found != slotOfId.end() ? GetArraySlot(entries, found->second) : NILREF;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find the local index for an index path.
+	Args:		inPath			index path
+	Return:	the index, NULL if there isn’t one
+----------------------------------------------------------------------------- */
+
+- (SoupIndex *) indexFor: (RefArg) inPath
+{
+	for (std::vector<SoupIndex>::iterator index = indexes.begin(); index != indexes.end(); ++index)
+		if (EQRef(index->path, inPath))
+			return &*index;
+	return NULL;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Bring an index up to date.
+	Entries without a value of the index’s type aren’t in the index, as on the
+	Newton.
+	Args:		ioIndex
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void) sortIndex: (SoupIndex *) ioIndex
+{
+	ioIndex->keys.clear();
+	ioIndex->keys.reserve(slotOfId.size());
+	RefVar value;
+	SoupIndexKey key;
+	for (std::unordered_map<int32_t, ArrayIndex>::iterator e = slotOfId.begin(); e != slotOfId.end(); ++e)
+	{
+		value = GetFrameSlot(GetArraySlot(entries, e->second), ioIndex->path);
+		if (MakeKey(value, ioIndex->isString, key))
+		{
+			key.slot = e->second;
+			ioIndex->keys.push_back(key);
+		}
+	}
+	std::stable_sort(ioIndex->keys.begin(), ioIndex->keys.end(), KeyLess);
+	ioIndex->isValid = true;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Can a query be answered locally?
+	Begin/end keys must be numeric keys of a numeric index or, without an
+	indexPath, integers bounding the _uniqueId order. Our string order need
+	not be the store’s, so the entries between two string keys could differ
+	from the Newton’s: string indexes can’t be bounded.
+	Args:		inQuerySpec
+	Return:	YES => -query: can answer it from the entries as they were at the
+				last refresh
+----------------------------------------------------------------------------- */
+
+- (BOOL) canAnswer: (RefArg) inQuerySpec
+{
+	if (ISNIL(inQuerySpec))
+		return YES;
+	if (!IsFrame(inQuerySpec))
+		return NO;
+
+	RefVar tag;
+	for (CSlotIterator iter(inQuerySpec); !iter.done(); iter.next())
+	{
+		tag = iter.tag();
+		if (EQRef(tag, SYMA(type)))
+		{
+			RefVar type(iter.value());
+			if (NOTNIL(type) && !EQRef(type, SYMA(index)) && !EQRef(type, SYMA(words)))
+				return NO;
+		}
+		else if (EQRef(tag, SYMA(indexPath)))
+		{
+			RefVar path(iter.value());
+			if ([self indexFor: path] == NULL)
+				return NO;
+		}
+		else if (EQRef(tag, SYMA(words)))
+		{
+			RefVar words(iter.value());
+			if (IsArray(words))
+			{
+				for (CSlotIterator w(words); !w.done(); w.next())
+					if (!IsString(w.value()))
+						return NO;
+			}
+			else if (!IsString(words))
+				return NO;
+		}
+		// validTest, indexValidTest, tagSpec &c need the Newton
+		else if (!EQRef(tag, SYMA(beginKey)) && !EQRef(tag, SYMA(endKey))
+			  &&  !EQRef(tag, SYMA(beginExclKey)) && !EQRef(tag, SYMA(endExclKey))
+			  &&  !EQRef(tag, SYMA(entireWords)))
+			return NO;
+	}
+
+	RefVar path(GetFrameSlot(inQuerySpec, SYMA(indexPath)));
+	SoupIndex * index = NOTNIL(path) ? [self indexFor: path] : NULL;
+	Ref boundTags[4] = { SYMA(beginKey), SYMA(beginExclKey), SYMA(endKey), SYMA(endExclKey) };
+	SoupIndexKey key;
+	RefVar bound;
+	for (int i = 0; i < 4; ++i)
+	{
+		bound = GetFrameSlot(inQuerySpec, boundTags[i]);
+		if (NOTNIL(bound) && (index ? index->isString || !MakeKey(bound, false, key) : !ISINT(bound)))
+			return NO;
+	}
+	return YES;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Answer a query.
+	The entries are those in the mirror -- clone any you want to modify.
+	Args:		inQuerySpec		must pass -canAnswer:
+	Return:	array of entries in query order
+----------------------------------------------------------------------------- */
+
+- (Ref) query: (RefArg) inQuerySpec
+{
+	// candidate entry slots, in order
+	std::vector<ArrayIndex> slots;
+	SoupIndex * index = NULL;
+	if (NOTNIL(inQuerySpec))
+	{
+		RefVar path(GetFrameSlot(inQuerySpec, SYMA(indexPath)));
+		index = [self indexFor: path];
+	}
+	if (index)
+	{
+		if (!index->isValid)
+			[self sortIndex: index];
+		std::vector<SoupIndexKey>::iterator begin = index->keys.begin(), end = index->keys.end();
+		SoupIndexKey key;
+		RefVar bound;
+		if (NOTNIL(bound = GetFrameSlot(inQuerySpec, SYMA(beginKey))) && MakeKey(bound, index->isString, key))
+			begin = std::lower_bound(begin, end, key, KeyLess);
+		else if (NOTNIL(bound = GetFrameSlot(inQuerySpec, SYMA(beginExclKey))) && MakeKey(bound, index->isString, key))
+			begin = std::upper_bound(begin, end, key, KeyLess);
+		if (NOTNIL(bound = GetFrameSlot(inQuerySpec, SYMA(endKey))) && MakeKey(bound, index->isString, key))
+			end = std::upper_bound(begin, end, key, KeyLess);
+		else if (NOTNIL(bound = GetFrameSlot(inQuerySpec, SYMA(endExclKey))) && MakeKey(bound, index->isString, key))
+			end = std::lower_bound(begin, end, key, KeyLess);
+		for ( ; begin < end; ++begin)
+			slots.push_back(begin->slot);
+	}
+	else
+	{
+		// no index => _uniqueId order, bounded by integer keys
+		typedef std::vector<std::pair<int32_t, ArrayIndex> > IdVector;
+		IdVector byId(slotOfId.begin(), slotOfId.end());
+		std::sort(byId.begin(), byId.end(), IdLess);
+		IdVector::iterator begin = byId.begin(), end = byId.end();
+		if (NOTNIL(inQuerySpec))
+		{
+			std::pair<int32_t, ArrayIndex> key(0, 0);
+			RefVar bound;
+			if (ISINT(bound = GetFrameSlot(inQuerySpec, SYMA(beginKey))))
+			{
+				key.first = RVALUE(bound);
+				begin = std::lower_bound(begin, end, key, IdLess);
+			}
+			else if (ISINT(bound = GetFrameSlot(inQuerySpec, SYMA(beginExclKey))))
+			{
+				key.first = RVALUE(bound);
+				begin = std::upper_bound(begin, end, key, IdLess);
+			}
+			if (ISINT(bound = GetFrameSlot(inQuerySpec, SYMA(endKey))))
+			{
+				key.first = RVALUE(bound);
+				end = std::upper_bound(begin, end, key, IdLess);
+			}
+			else if (ISINT(bound = GetFrameSlot(inQuerySpec, SYMA(endExclKey))))
+			{
+				key.first = RVALUE(bound);
+				end = std::lower_bound(begin, end, key, IdLess);
+			}
+		}
+		slots.reserve(end - begin);
+		for ( ; begin < end; ++begin)
+			slots.push_back(begin->second);
+	}
+
+	// filter on words
+	std::vector<UniString> words;
+	if (NOTNIL(inQuerySpec))
+	{
+		RefVar wordSpec(GetFrameSlot(inQuerySpec, SYMA(words)));
+		UniString word;
+		if (IsString(wordSpec))
+		{
+			FoldString(wordSpec, word);
+			words.push_back(word);
+		}
+		else if (IsArray(wordSpec))
+		{
+			RefVar w;
+			for (CSlotIterator iter(wordSpec); !iter.done(); iter.next())
+			{
+				w = iter.value();
+				FoldString(w, word);
+				words.push_back(word);
+			}
+		}
+	}
+	bool entireWords = NOTNIL(inQuerySpec) && NOTNIL(GetFrameSlot(inQuerySpec, SYMA(entireWords)));
+
+	RefVar result(MakeArray(0));
+	RefVar entry;
+	UniString text;
+	for (std::vector<ArrayIndex>::iterator slot = slots.begin(); slot != slots.end(); ++slot)
+	{
+		entry = GetArraySlot(entries, *slot);
+		if (!words.empty())
+		{
+			text.clear();
+			CollectText(entry, text, 0);
+			if (!MatchWords(text, words, entireWords))
+				continue;
+		}
+		AddArraySlot(result, entry);
+	}
+	return result;
+}
+
+@end
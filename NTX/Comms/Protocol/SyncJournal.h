@@ -0,0 +1,64 @@
+/*
+	File:		SyncJournal.h
+
+	Contains:	Per-soup change journal for delta sync.
+					Records, for every entry as of the last sync, its _modTime and
+					a hash of its content -- so the next sync can tell what changed
+					on either side without comparing whole entries.
+					Not yet part of the NTX target, along with the dock session that
+					uses it, so this has not been compiled.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <Foundation/Foundation.h>
+#import "NewtonKit.h"
+#include <unordered_map>
+
+#define kSyncJournalSignature	'NSJN'
+#define kSyncJournalVersion	1
+
+struct SyncJournalRecord
+{
+	uint32_t		modTime;
+	uint64_t		hash;
+};
+
+/* --- What a sync did --- */
+
+struct SyncStats
+{
+	ArrayIndex	added;			// to the Newton
+	ArrayIndex	changed;
+	ArrayIndex	deleted;
+	ArrayIndex	fetched;			// from the Newton
+	ArrayIndex	removed;
+	ArrayIndex	conflicts;		// changed on both sides; the Newton wins, the desktop’s is returned
+};
+
+extern uint64_t	HashEntry(RefArg inEntry);
+
+
+/* -----------------------------------------------------------------------------
+	N C S y n c J o u r n a l
+----------------------------------------------------------------------------- */
+
+@interface NCSyncJournal : NSObject
+{
+	std::unordered_map<int32_t, SyncJournalRecord> records;
+	uint32_t lastSyncTime;
+}
+@property (assign) uint32_t lastSyncTime;	// Newton time at the last sync
+@property (readonly) NSUInteger count;
+
+- (id)		initWithContentsOfURL: (NSURL *) inURL;
+- (BOOL)		writeToURL: (NSURL *) inURL;
+
+- (const SyncJournalRecord *) recordFor: (int32_t) inUniqueId;
+- (void)		setEntry: (RefArg) inEntry;
+- (void)		removeEntryId: (int32_t) inUniqueId;
+- (BOOL)		isChanged: (RefArg) inEntry;
+
+- (void)		enumerateEntryIds: (void (^)(int32_t inUniqueId)) inBlock;
+
+@end
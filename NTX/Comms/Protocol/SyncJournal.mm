@@ -0,0 +1,191 @@
+/*
+	File:		SyncJournal.mm
+
+	Contains:	Per-soup change journal for delta sync.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "SyncJournal.h"
+#import "BufferPipe.h"
+
+/* --- Journal file format --- */
+
+struct SyncJournalHeader
+{
+	uint32_t		signature;
+	uint32_t		version;
+	uint32_t		lastSyncTime;
+	uint32_t		count;
+};
+
+struct SyncJournalFileRecord
+{
+	int32_t		uniqueId;
+	uint32_t		modTime;
+	uint64_t		hash;
+};
+
+
+/* -----------------------------------------------------------------------------
+	Hash the content of an entry.
+	_modTime is excluded: the Newton updates it whenever we change an entry,
+	and that alone shouldn’t make it look as if the entry changed again.
+	Args:		inEntry			soup entry frame
+	Return:	64-bit FNV-1a hash of the flattened entry
+----------------------------------------------------------------------------- */
+
+uint64_t
+HashEntry(RefArg inEntry)
+{
+	RefVar entry(inEntry);
+	if (FrameHasSlot(entry, SYMA(_modTime))) {
+		entry = Clone(inEntry);
+		RemoveSlot(entry, SYMA(_modTime));
+	}
+	CBufferPipe pipe;
+	FlattenRef(entry, pipe);
+
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	const unsigned char * p = (const unsigned char *)pipe.data();
+	for (size_t i = pipe.size(); i > 0; i--, p++) {
+		hash ^= *p;
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+
+/* -----------------------------------------------------------------------------
+	N C S y n c J o u r n a l
+----------------------------------------------------------------------------- */
+
+@implementation NCSyncJournal
+
+@synthesize lastSyncTime;
+
+/* -----------------------------------------------------------------------------
+	Initialize from a journal file.
+	Args:		inURL			journal file; nil => empty journal
+	Return:	self -- an empty journal if the file can’t be read
+----------------------------------------------------------------------------- */
+
+- (id) initWithContentsOfURL: (NSURL *) inURL
+{
+	if (self = [super init])
+	{
+		lastSyncTime = 0;
+
+		NSData * data = inURL ? [NSData dataWithContentsOfURL: inURL options: NSDataReadingMappedIfSafe error: nil] : nil;
+		if (data.length >= sizeof(SyncJournalHeader))
+		{
+			const SyncJournalHeader * header = (const SyncJournalHeader *)data.bytes;
+			if (header->signature == kSyncJournalSignature
+			&&  header->version == kSyncJournalVersion
+			&&  data.length >= sizeof(SyncJournalHeader) + header->count * sizeof(SyncJournalFileRecord))
+			{
+				lastSyncTime = header->lastSyncTime;
+				records.reserve(header->count);
+				const SyncJournalFileRecord * r = (const SyncJournalFileRecord *)(header + 1);
+				for (ArrayIndex i = 0; i < header->count; i++, r++)
+				{
+					SyncJournalRecord record = { r->modTime, r->hash };
+					records[r->uniqueId] = record;
+				}
+			}
+		}
+	}
+	return self;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Save the journal.
+	The file is desktop-only, so it’s in native byte order.
+	Args:		inURL			journal file
+	Return:	YES => saved
+----------------------------------------------------------------------------- */
+
+- (BOOL) writeToURL: (NSURL *) inURL
+{
+	NSMutableData * data = [NSMutableData dataWithLength: sizeof(SyncJournalHeader) + records.size() * sizeof(SyncJournalFileRecord)];
+	SyncJournalHeader * header = (SyncJournalHeader *)data.mutableBytes;
+	header->signature = kSyncJournalSignature;
+	header->version = kSyncJournalVersion;
+	header->lastSyncTime = lastSyncTime;
+	header->count = (uint32_t)records.size();
+	SyncJournalFileRecord * r = (SyncJournalFileRecord *)(header + 1);
+	for (std::unordered_map<int32_t, SyncJournalRecord>::iterator iter = records.begin(); iter != records.end(); ++iter, r++)
+	{
+		r->uniqueId = iter->first;
+		r->modTime = iter->second.modTime;
+		r->hash = iter->second.hash;
+	}
+	return [data writeToURL: inURL atomically: YES];
+}
+
+
+- (NSUInteger) count
+{
+	return records.size();
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the journal record for an entry.
+	Args:		inUniqueId
+	Return:	the record, NULL if the entry wasn’t there at the last sync
+----------------------------------------------------------------------------- */
+
+- (const SyncJournalRecord *) recordFor: (int32_t) inUniqueId
+{
+	std::unordered_map<int32_t, SyncJournalRecord>::const_iterator found = records.find(inUniqueId);
+	return found != records.end() ? &found->second : NULL;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Record an entry as synced.
+	Args:		inEntry			soup entry frame with _uniqueId
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void) setEntry: (RefArg) inEntry
+{
+	RefVar uid(GetFrameSlot(inEntry, SYMA(_uniqueId)));
+	RefVar modTime(GetFrameSlot(inEntry, SYMA(_modTime)));
+	if (ISINT(uid))
+	{
+		SyncJournalRecord record = { ISINT(modTime) ? (uint32_t)RVALUE(modTime) : 0, HashEntry(inEntry) };
+		records[RVALUE(uid)] = record;
+	}
+}
+
+
+- (void) removeEntryId: (int32_t) inUniqueId
+{
+	records.erase(inUniqueId);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Has an entry changed since it was recorded?
+	Args:		inEntry			soup entry frame
+	Return:	YES => changed, or not in the journal
+----------------------------------------------------------------------------- */
+
+- (BOOL) isChanged: (RefArg) inEntry
+{
+	RefVar uid(GetFrameSlot(inEntry, SYMA(_uniqueId)));
+	const SyncJournalRecord * record = ISINT(uid) ? [self recordFor: RVALUE(uid)] : NULL;
+	return record == NULL || record->hash != HashEntry(inEntry);
+}
+
+
+- (void) enumerateEntryIds: (void (^)(int32_t inUniqueId)) inBlock
+{
+	for (std::unordered_map<int32_t, SyncJournalRecord>::iterator iter = records.begin(); iter != records.end(); ++iter)
+		inBlock(iter->first);
+}
+
+@end
@@ -19,6 +19,7 @@
 #import "AppDelegate.h"
 #import "LayoutViewController.h"
 #import "Utilities.h"
+#import "ProtoRegistry.h"
 #import "NTK/Globals.h"
 #import "MacRsrcTypes.h"
 
@@ -41,7 +42,6 @@
 	N T X T e m p l a t e D e s c r i p t o r
 	An item in the hierarchical list of view templates.
 ----------------------------------------------------------------------------- */
-extern const char * FilenameFromFSSpec(void * inFSpec, ArrayIndex inLen);
 
 @implementation NTXTemplateDescriptor
 
@@ -76,8 +76,7 @@ extern const char * FilenameFromFSSpec(void * inFSpec, ArrayIndex inLen);
 		vwTemplate = GetFrameSlot(vwTemplate, MakeSymbol("__ntTemplate"));
 		// might want to assert that vwTemplate.__ntDataType = "USER"
 		RefVar value(GetFrameSlot(vwTemplate, SYMA(value)));
-		const char * filename = FilenameFromFSSpec(BinaryData(value), Length(value));
-		return [NSString stringWithCString:filename encoding:NSMacOSRomanStringEncoding];
+		return FilenameFromFSSpec(BinaryData(value), Length(value));
 	}
 	return [NSString stringWithUTF8String:SymbolName(vwTemplate)];
 }
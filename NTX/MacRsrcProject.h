@@ -13,17 +13,13 @@
 
 /* -----------------------------------------------------------------------------
 	N T X R s r c F i l e
+	Both forks are mapped, not read -- unless the resource fork can only be
+	had as an extended attribute, when it is copied. The data fork is read
+	sequentially; the resource fork (or the AppleDouble file holding it) is
+	indexed by type and id when the file is opened.
 ----------------------------------------------------------------------------- */
 
 @interface NTXRsrcFile : NSObject
-{
-	FILE * fref;
-	int rsrcLen;
-	char * rsrcImage;
-	char * rsrcData;
-	RsrcMap * rsrcMap;
-	RsrcList * rsrcTypeList;
-}
 @property(copy) NSURL * url;
 @property(readonly) int read4Bytes;
 @property(readonly) int read2Bytes;
@@ -40,5 +36,9 @@
 ----------------------------------------------------------------------------- */
 
 @interface NTXRsrcProject : NTXRsrcFile
+@property(readonly) NSArray<NSDictionary *> * items;		// { url:, type: } in build order
+@property(readonly) NSUInteger mainLayout;					// index into items; NSNotFound if none
 @property(readonly) Ref projectRef;
+
+- (BOOL)readItems;
 @end
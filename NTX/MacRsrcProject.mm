@@ -8,15 +8,21 @@
 
 #import <sys/xattr.h>
 #include <sys/attr.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <libkern/OSByteOrder.h>
+#include <unordered_map>
 
 #import <CoreServices/CoreServices.h>
 
 #import "MacRsrcProject.h"
 #import "ProjectTypes.h"
 #import "Utilities.h"
-
-extern Ref	MakeStringOfLength(const UniChar * str, ArrayIndex numChars);
+#import "MappedFilePipe.h"
+#import "ProtoRegistry.h"
+#import "TextConvert.h"
 
 
 /*------------------------------------------------------------------------------
@@ -30,7 +36,9 @@ MakeStringFromPString(const uint8_t * str)
 {
 	ArrayIndex strLen = *str;
 	RefVar	obj(AllocateBinary(SYMA(string), (strLen + 1) * sizeof(UniChar)));
-	ConvertToUnicode(str+1, (UniChar *) BinaryData(obj), strLen);
+	UniChar * s = (UniChar *) BinaryData(obj);
+	MacRomanToUniChar(str+1, strLen, s);
+	s[strLen] = kEndOfString;
 	return obj;
 }
 
@@ -45,13 +53,13 @@ MakeStringFromPString(const uint8_t * str)
 Ref
 MakeStringFromUTF8String(const char * inStr)
 {
-	UniChar str16[256];
-	NSString * str = [NSString stringWithUTF8String:inStr];
-	NSInteger strLen = str.length;
-	if (strLen > 255)
-		strLen = 255;
-	[str getCharacters:str16 range:NSMakeRange(0,strLen)];
-	return MakeStringOfLength(str16, strLen);
+	size_t len = strlen(inStr);
+	ArrayIndex strLen = (ArrayIndex)UTF8ToUniChar((const uint8_t *)inStr, len, NULL);
+	RefVar	obj(AllocateBinary(SYMA(string), (strLen + 1) * sizeof(UniChar)));
+	UniChar * s = (UniChar *) BinaryData(obj);
+	UTF8ToUniChar((const uint8_t *)inStr, len, s);
+	s[strLen] = kEndOfString;
+	return obj;
 }
 
 
@@ -93,29 +101,6 @@ FileTypeCode(const char * inPath)
 }
 
 
-const char *
-FilenameFromFSSpec(void * inFSpec, ArrayIndex inLen)
-{
-	const char * filename;
-	if (inLen == sizeof(FSSpecX)) {
-		// we have a filespec
-		FSSpecX * fsspec = (FSSpecX *)inFSpec;
-		filename = (const char *)&fsspec->name[0];
-	} else {
-		// this is an alias
-		FSAliasX * alias = (FSAliasX *)inFSpec;
-		filename = (const char *)&alias->fileName[0];
-	}
-	// convert pascal -> c string
-	static char cstr[64];
-	size_t filenameLen = filename[0];
-	strncpy(cstr, filename+1, filenameLen);
-	cstr[filenameLen] = 0;
-	return cstr;
-	// caller must copy this if necessary
-}
-
-
 Ref
 MakePoint(VPoint const& vpt)
 {
@@ -168,98 +153,249 @@ ReadLayoutSettings(NSURL * url)
 
 
 #pragma mark - NTXRsrcFile
+/* -----------------------------------------------------------------------------
+	Map a file, read-only.
+	Args:		inPath		the file
+				outLen		its length
+	Return:	the mapping; NULL if the file doesn’t exist or is empty
+----------------------------------------------------------------------------- */
+
+static const char *
+MapFile(const char * inPath, size_t * outLen)
+{
+	const char * image = NULL;
+	*outLen = 0;
+	int fd = open(inPath, O_RDONLY);
+	if (fd >= 0) {
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void * p = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				image = (const char *)p;
+				*outLen = (size_t)info.st_size;
+			}
+		}
+		close(fd);
+	}
+	return image;
+}
+
+
 /* -----------------------------------------------------------------------------
 	N T X R s r c F i l e
 	An object to read legacy Mac project resource data.
 ----------------------------------------------------------------------------- */
 @implementation NTXRsrcFile
+{
+	// the data fork, and where we are reading it
+	const char * dataImage;
+	size_t dataLen;
+	size_t dataOffset;
+	// the mapped resource fork -- or AppleDouble file that contains it
+	const char * rsrcMapping;
+	size_t rsrcMappingLen;
+	// or, if neither can be mapped, a copy of the resource fork
+	char * rsrcCopy;
+	// the resource fork within that mapping, or the copy
+	const char * rsrcImage;
+	size_t rsrcLen;
+	// resource data, and where each resource is in it
+	const char * rsrcData;
+	size_t rsrcDataLen;
+	std::unordered_map<uint64_t, uint32_t> rsrcIndex;
+}
 
 - (id)initWithURL:(NSURL *)inURL {
 	if (self = [super init]) {
-		rsrcImage = NULL;
-		rsrcData = NULL;
 		self.url = inURL;
 
 		const char * filePath = self.url.fileSystemRepresentation;
-		// get size of resource fork
-		rsrcLen = getxattr(filePath, XATTR_RESOURCEFORK_NAME, NULL, 0, 0, 0);
-		if (rsrcLen == 0) {
-			return nil;
+		dataImage = MapFile(filePath, &dataLen);
+		dataOffset = 0;
+
+		// the resource fork is accessible as a file in its own right...
+		rsrcMapping = MapFile([self.url.path stringByAppendingPathComponent:@"..namedfork/rsrc"].fileSystemRepresentation, &rsrcMappingLen);
+		if (rsrcMapping) {
+			rsrcImage = rsrcMapping;
+			rsrcLen = rsrcMappingLen;
+		} else {
+			// ...unless it has been split off into an AppleDouble file
+			NSURL * appleDoubleURL = [self.url.URLByDeletingLastPathComponent URLByAppendingPathComponent:[@"._" stringByAppendingString:self.url.lastPathComponent]];
+			rsrcMapping = MapFile(appleDoubleURL.fileSystemRepresentation, &rsrcMappingLen);
+			[self findAppleDoubleResourceFork];
 		}
-		fref = fopen(filePath, "rb");
-		if (fref == NULL) {
+		if (rsrcImage == NULL) {
+			// ...and if we can’t map it, the extended attribute can still be read
+			ssize_t len = getxattr(filePath, XATTR_RESOURCEFORK_NAME, NULL, 0, 0, 0);
+			if (len > 0 && (rsrcCopy = (char *)malloc(len)) != NULL) {
+				len = getxattr(filePath, XATTR_RESOURCEFORK_NAME, rsrcCopy, len, 0, 0);
+				if (len > 0) {
+					rsrcImage = rsrcCopy;
+					rsrcLen = (size_t)len;
+				}
+			}
+		}
+		if (dataImage == NULL && rsrcImage == NULL) {
 			return nil;
 		}
+		[self indexResources];
 	}
 	return self;
 }
 
 - (void)dealloc {
-	if (rsrcImage) {
-		free(rsrcImage), rsrcImage = NULL;
+	if (dataImage) {
+		munmap((void *)dataImage, dataLen), dataImage = NULL;
+	}
+	if (rsrcMapping) {
+		munmap((void *)rsrcMapping, rsrcMappingLen), rsrcMapping = NULL;
+	}
+	if (rsrcCopy) {
+		free(rsrcCopy), rsrcCopy = NULL;
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find the resource fork entry in a mapped AppleDouble file.
+----------------------------------------------------------------------------- */
+
+- (void)findAppleDoubleResourceFork {
+	rsrcImage = NULL;
+	rsrcLen = 0;
+	if (rsrcMappingLen < sizeof(AppleDoubleHeader)) {
+		return;
+	}
+	const AppleDoubleHeader * header = (const AppleDoubleHeader *)rsrcMapping;
+	if (ntohl(header->magic) != kAppleDoubleMagic) {
+		return;
+	}
+	const AppleDoubleEntry * entry = (const AppleDoubleEntry *)(rsrcMapping + sizeof(AppleDoubleHeader));
+	for (int i = 0, count = ntohs(header->numOfEntries); i < count; ++i, ++entry) {
+		if ((const char *)(entry + 1) > rsrcMapping + rsrcMappingLen) {
+			break;
+		}
+		if (ntohl(entry->entryID) == kAppleDoubleResourceForkID) {
+			size_t offset = ntohl(entry->offset);
+			size_t length = ntohl(entry->length);
+			if (offset + length <= rsrcMappingLen) {
+				rsrcImage = rsrcMapping + offset;
+				rsrcLen = length;
+			}
+			break;
+		}
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Walk the resource map once, indexing each resource by type and id.
+	Offsets in the map are checked against the fork so a damaged file can’t
+	take us outside it.
+----------------------------------------------------------------------------- */
+
+static inline uint64_t
+RsrcKey(OSType inType, uint16_t inNumber)
+{
+	return ((uint64_t)inType << 16) | inNumber;
+}
+
+- (void)indexResources {
+	if (rsrcLen < sizeof(RsrcHeader)) {
+		return;
+	}
+	const RsrcHeader * header = (const RsrcHeader *)rsrcImage;
+	size_t dataStart = ntohl(header->dataOffset);
+	size_t mapStart = ntohl(header->mapOffset);
+	if (dataStart > rsrcLen || mapStart + sizeof(RsrcMap) > rsrcLen) {
+		return;
 	}
-	if (fref) {
-		fclose(fref), fref = NULL;
+	rsrcData = rsrcImage + dataStart;
+	rsrcDataLen = MIN((size_t)ntohl(header->dataLength), rsrcLen - dataStart);
+
+	const char * rsrcEnd = rsrcImage + rsrcLen;
+	const RsrcMap * rsrcMap = (const RsrcMap *)(rsrcImage + mapStart);
+	const RsrcList * typeList = (const RsrcList *)((const char *)rsrcMap + ntohs(rsrcMap->typeListOffset));
+	if ((const char *)typeList + sizeof(RsrcList) > rsrcEnd) {
+		return;
+	}
+	// counts are stored -1
+	uint16_t numOfTypes = ntohs(typeList->count) + 1;
+	const RsrcItem * r = typeList->item;
+	for (int i = 0; i < numOfTypes && (const char *)(r + 1) <= rsrcEnd; ++i, ++r) {
+		OSType type = ntohl(r->type);
+		uint16_t numOfRsrcs = ntohs(r->count) + 1;
+		const RsrcRef * rr = (const RsrcRef *)((const char *)typeList + ntohs(r->offset));
+		for (int j = 0; j < numOfRsrcs && (const char *)(rr + 1) <= rsrcEnd; ++j, ++rr) {
+			// first of any duplicates wins, as it did when we searched linearly
+			rsrcIndex.emplace(RsrcKey(type, ntohs(rr->id)), ntohl(rr->offset) & kRsrcOffsetMask);
+		}
 	}
 }
 
 
+/* -----------------------------------------------------------------------------
+	Read big-endian values from the data fork.
+	Reading past the end yields zeroes.
+----------------------------------------------------------------------------- */
+
 - (int)read4Bytes {
-	uint32_t v;
-	fread(&v, 1, 4, fref);
-	return ntohl(v);
+	if (dataOffset + 4 > dataLen) {
+		dataOffset = dataLen;
+		return 0;
+	}
+	uint32_t v = OSReadBigInt32(dataImage, dataOffset);
+	dataOffset += 4;
+	return v;
 }
 
 
 - (int)read2Bytes {
-	uint16_t v;
-	fread(&v, 1, 2, fref);
-	return ntohs(v);
+	if (dataOffset + 2 > dataLen) {
+		dataOffset = dataLen;
+		return 0;
+	}
+	uint16_t v = OSReadBigInt16(dataImage, dataOffset);
+	dataOffset += 2;
+	return v;
 }
 
 
 - (int)readByte {
-	uint8_t v;
-	fread(&v, 1, 1, fref);
-	return v;
+	if (dataOffset + 1 > dataLen) {
+		return 0;
+	}
+	return (uint8_t)dataImage[dataOffset++];
 }
 
 - (void)read:(NSUInteger)inCount into:(char *)inBuffer {
-	fread(inBuffer, 1, inCount, fref);
+	NSUInteger count = MIN(inCount, dataLen - dataOffset);
+	memcpy(inBuffer, dataImage + dataOffset, count);
+	memset(inBuffer + count, 0, inCount - count);
+	dataOffset += count;
 }
 
 
-// will have to do byte-swapping in here
+/* -----------------------------------------------------------------------------
+	Return a resource.
+	Args:		inType		resource type
+				inNumber		resource id
+	Return:	pointer to the resource’s length-prefixed data, in place; callers
+				must do any byte-swapping
+				NULL => no such resource
+----------------------------------------------------------------------------- */
+
 - (void *)readResource:(OSType)inType number:(uint16_t)inNumber {
-	if (rsrcImage == NULL) {
-		// allocate sufficient length
-		rsrcImage = (char *)malloc(rsrcLen);
-		// Read the resource fork image
-		getxattr(self.url.fileSystemRepresentation, XATTR_RESOURCEFORK_NAME, rsrcImage, rsrcLen, 0, 0);
-
-		// point to the resource map
-		rsrcMap = (RsrcMap *)(rsrcImage + ntohl(((RsrcHeader *)rsrcImage)->mapOffset));
-		// point to the typelist
-		rsrcTypeList = (RsrcList *)((char *)rsrcMap + ntohs(rsrcMap->typeListOffset));
-		// point to the resource data
-		rsrcData = rsrcImage + ntohl(((RsrcHeader *)rsrcImage)->dataOffset);
+	auto iter = rsrcIndex.find(RsrcKey(inType, inNumber));
+	if (iter == rsrcIndex.end()) {
+		return NULL;
 	}
-
-	// walk the resource type list
-	RsrcItem * r = rsrcTypeList->item;
-	for (int i = 0, icount = ntohs(rsrcTypeList->count); i <= icount; ++i, ++r) {
-		if (ntohl(r->type) == inType) {
-			// we have resources of the required type
-			RsrcRef * rr = (RsrcRef *)((char *)rsrcTypeList + ntohs(r->offset));
-			for (int j = 0, jcount = ntohs(r->count); j <= jcount; j++, rr++) {
-				if (ntohs(rr->id) == inNumber) {
-					// we have a resource with the required number
-					return rsrcData + ntohl(rr->offset);
-				}
-			}
-		}
+	size_t offset = iter->second;
+	if (offset + sizeof(RsrcData) > rsrcDataLen
+	||  offset + sizeof(RsrcData) + ntohl(((const RsrcData *)(rsrcData + offset))->dataLength) > rsrcDataLen) {
+		return NULL;
 	}
-	return NULL;
+	return (void *)(rsrcData + offset);
 }
 
 @end
@@ -276,7 +412,6 @@ ReadLayoutSettings(NSURL * url)
 	if (self = [super initWithURL:inURL]) {
 		ULong format = self.read4Bytes;
 		if (format != 103) {
-			fclose(fref), fref = NULL;
 			return nil;
 		}
 	}
@@ -284,6 +419,79 @@ ReadLayoutSettings(NSURL * url)
 }
 
 
+/* -----------------------------------------------------------------------------
+	Map a Mac file type to project item type.
+----------------------------------------------------------------------------- */
+
+static int
+ItemTypeFromFileType(uint32_t inFileType)
+{
+	switch (inFileType) {
+	case 'FLFM':
+	case 'PRTO':
+		return kLayoutFileType;
+	case 'TIFF':
+		return kBitmapFileType;
+	case 'SND ':
+		return kSoundFileType;
+	case 'TEXT':
+		return kScriptFileType;
+	case 'PKG ':
+		return kPackageFileType;
+	case 'STRM':
+		return kStreamFileType;
+	case 'CODE':
+		return kNativeCodeFileType;
+	case 'rsrc':
+		return kResourceFileType;
+	}
+	return 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read the project items from the data fork.
+	This creates no NewtonScript objects, so unlike -projectRef it can be
+	called on any thread.
+	Args:		--
+	Return:	YES => the project has settings too
+----------------------------------------------------------------------------- */
+
+- (BOOL)readItems {
+	if (self.items == nil) {
+		// assume files are in the same folder as the project -- we could try to find them but frankly life’s too short
+		NSURL * basePath = [self.url URLByDeletingLastPathComponent];
+
+		// read the data fork which contains the project items
+		ArrayIndex itemCount = self.read2Bytes;
+		ArrayIndex sortOrder = self.read4Bytes;	// ignored -- we use only build order
+
+		NSMutableArray * fileItems = [[NSMutableArray alloc] initWithCapacity:itemCount];
+		for (ArrayIndex i = 0; i < itemCount; ++i) {
+			// read aliases
+			char fsData[KByte];
+			ULong itemLen = self.read4Bytes;
+			if (itemLen > KByte) {
+				itemLen = KByte;
+				printf("ALIAS BUFFER OVERFLOW!\n");
+			}
+			[self read:itemLen into:fsData];
+			NSString * filename = FilenameFromFSSpec(fsData, itemLen);
+			if (filename) {
+				NSURL * fileURL = [basePath URLByAppendingPathComponent:filename];
+				int fileType = ItemTypeFromFileType(FileTypeCode(fileURL.fileSystemRepresentation));
+				[fileItems addObject:@{ @"url":fileURL, @"type":[NSNumber numberWithInt:fileType] }];
+			}
+		}
+		ArrayIndex mainLayout = self.read2Bytes;	// 1-based -- applies to specified sort order, not necessarily build order
+																// so should sort fileItems to get this right
+		_mainLayout = (mainLayout != 0 && --mainLayout < fileItems.count) ? mainLayout : NSNotFound;
+		_items = fileItems;
+	}
+	return [self readResource:'PJPF' number:9999] != NULL;
+}
+
+
 /* -----------------------------------------------------------------------------
 	Import Mac project.
 	Convert resource/data forks to project frame ref.
@@ -294,15 +502,9 @@ ReadLayoutSettings(NSURL * url)
 - (Ref)projectRef {
 	//	stream in default project settings
 	NSURL * url = [NSBundle.mainBundle URLForResource: @"CanonicalProject" withExtension: @"newtonstream"];
-	CStdIOPipe pipe(url.fileSystemRepresentation, "r");
-	RefVar proj(UnflattenRef(pipe));
-
-	// assume files are in the same folder as the project -- we could try to find them but frankly life’s too short
-	NSURL * basePath = [self.url URLByDeletingLastPathComponent];
+	RefVar proj(UnflattenFile(url.fileSystemRepresentation));
 
-	// read the data fork which contains the project items
-	ArrayIndex itemCount = self.read2Bytes;
-	ArrayIndex sortOrder = self.read4Bytes;	// ignored -- we use only build order
+	[self readItems];
 
 	RefVar projItems(GetFrameSlot(proj, MakeSymbol("projectItems")));
 
@@ -310,67 +512,27 @@ ReadLayoutSettings(NSURL * url)
 	RefVar protoFileRef(AllocateFrame());
 	SetClass(protoFileRef, MakeSymbol("fileReference"));
 	SetFrameSlot(protoFileRef, MakeSymbol("fullPath"), RA(NILREF));
-	for (ArrayIndex i = 0; i < itemCount; ++i) {
-		// read aliases -- add to projectRef.projectItems.items
-		char fsData[KByte];
-		ULong itemLen = self.read4Bytes;
-		if (itemLen > KByte) {
-			itemLen = KByte;
-			printf("ALIAS BUFFER OVERFLOW!\n");
-		}
-		[self read:itemLen into:fsData];
-		const char * filename = FilenameFromFSSpec(fsData, itemLen);
-		if (filename) {
-			const char * filePath = [[basePath URLByAppendingPathComponent:[NSString stringWithCString:filename encoding:NSMacOSRomanStringEncoding]] fileSystemRepresentation];
-			int fileType = 0;
-			//convert to index
-			switch (FileTypeCode(filePath)) {
-			case 'FLFM':
-			case 'PRTO':
-				fileType = kLayoutFileType;
-				break;
-			case 'TIFF':
-				fileType = kBitmapFileType;
-				break;
-			case 'SND ':
-				fileType = kSoundFileType;
-				break;
-			case 'TEXT':
-				fileType = kScriptFileType;
-				break;
-			case 'PKG ':
-				fileType = kPackageFileType;
-				break;
-			case 'STRM':
-				fileType = kStreamFileType;
-				break;
-			case 'CODE':
-				fileType = kNativeCodeFileType;
-				break;
-			case 'rsrc':
-				fileType = kResourceFileType;
-				break;
-			}
-
-			SetFrameSlot(protoFileRef, MakeSymbol("fullPath"), MakeStringFromUTF8String(filePath));	// filePath is UTF8 encoded which MakeStringFromCString() can’t really handle
-
-			RefVar fileItem(AllocateFrame());
-			SetFrameSlot(fileItem, MakeSymbol("file"), Clone(protoFileRef));
-			SetFrameSlot(fileItem, SYMA(type), MAKEINT(fileType));
-			AddArraySlot(fileItems, fileItem);
-		}
+	for (NSDictionary * item in self.items) {
+		NSURL * fileURL = item[@"url"];
+		SetFrameSlot(protoFileRef, MakeSymbol("fullPath"), MakeStringFromUTF8String(fileURL.fileSystemRepresentation));	// filePath is UTF8 encoded which MakeStringFromCString() can’t really handle
+
+		RefVar fileItem(AllocateFrame());
+		SetFrameSlot(fileItem, MakeSymbol("file"), Clone(protoFileRef));
+		SetFrameSlot(fileItem, SYMA(type), MAKEINT([item[@"type"] intValue]));
+		AddArraySlot(fileItems, fileItem);
 	}
-	ArrayIndex mainLayout = self.read2Bytes;	// 1-based -- applies to specified sort order, not necessarily build order
-															// so should sort fileItems to get this right
-	if (mainLayout != 0 && --mainLayout < Length(fileItems)) {
-		RefVar mainItem(GetArraySlot(fileItems, mainLayout));
+	if (self.mainLayout != NSNotFound) {
+		RefVar mainItem(GetArraySlot(fileItems, self.mainLayout));
 		SetFrameSlot(mainItem, MakeSymbol("isMainLayout"), TRUEREF);
 	}
 	SetFrameSlot(projItems, MakeSymbol("items"), fileItems);
 
 	// read the resource fork which contains the project settings
 	RsrcPJPF * rsrc = (RsrcPJPF *)[self readResource:'PJPF' number:9999];
-// XFAIL(rsrc == NULL)
+	if (rsrc == NULL) {
+		// no settings -- leave the defaults
+		return proj;
+	}
 
 	// set up the settings frames
 	RefVar projectSettings(GetFrameSlot(proj, MakeSymbol("projectSettings")));
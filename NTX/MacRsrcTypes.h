@@ -72,6 +72,32 @@ bit 2 resPreload
 bit 1 resChanged
 bit 0 (reserved)
 */
+// the low 24 bits of RsrcRef.offset; the high byte is the attributes
+#define kRsrcOffsetMask		0x00FFFFFF
+
+
+/* -----------------------------------------------------------------------------
+	AppleDouble header file -- ._<name> -- as written when a file with a
+	resource fork is copied to a volume that doesn’t support forks.
+----------------------------------------------------------------------------- */
+
+#define kAppleDoubleMagic				0x00051607
+#define kAppleDoubleResourceForkID	2
+
+struct AppleDoubleHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	char		filler[16];
+	uint16_t	numOfEntries;
+}__attribute__((packed));
+
+struct AppleDoubleEntry
+{
+	uint32_t	entryID;
+	uint32_t	offset;
+	uint32_t	length;
+}__attribute__((packed));
 
 struct RsrcPJPF
 {
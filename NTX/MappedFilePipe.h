@@ -0,0 +1,90 @@
+/*
+	File:		MappedFilePipe.h
+
+	Contains:	A file pipe for NSOF I/O, replacing CStdIOPipe.
+					Files opened for reading are memory-mapped so reads are simple
+					copies out of the page cache (or no copy at all, via readSpan).
+					Files opened for writing accumulate output in a large aligned
+					buffer that is written with as few write() calls as possible.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__MAPPEDFILEPIPE_H)
+#define __MAPPEDFILEPIPE_H 1
+
+#include "NewtonKit.h"
+
+#define kMappedPipeWriteBufSize (1*MByte)
+
+
+/* -----------------------------------------------------------------------------
+	C M a p p e d F i l e P i p e
+	Construct with the same arguments as CStdIOPipe: a filename and an fopen()
+	style mode -- "r" to read, "w" to write. Throws exPipe if the file can’t
+	be opened.
+	Buffered output is written by flushWrite() and close(), which report
+	errors. Output must be closed explicitly: the destructor releases the file
+	and buffer but discards anything still buffered, and logs that it did.
+	Call discard() to abandon output deliberately.
+	Newton exceptions unwind with longjmp, which skips destructors, so a pipe
+	that might be abandoned by an exception must be released in an on_unwind
+	clause with discard() -- or use UnflattenFile() / FlattenToFile(), which
+	do that.
+----------------------------------------------------------------------------- */
+
+class CMappedFilePipe : public CPipe
+{
+public:
+				CMappedFilePipe(const char * inFilename, const char * inMode);
+				~CMappedFilePipe();
+
+	long		readSeek(long inOffset, int inSelector);
+	long		readPosition(void) const;
+	long		writeSeek(long inOffset, int inSelector);
+	long		writePosition(void) const;
+	void		readChunk(void * outBuf, size_t & ioSize, bool & outEOF);
+	void		writeChunk(const void * inBuf, size_t inSize, bool inFlush);
+	void		flushRead(void);
+	void		flushWrite(void);
+	void		reset(void);
+	void		overflow();
+	void		underflow(long, bool&);
+
+	const char *	readSpan(size_t & ioSize);
+	size_t		size(void) const;
+	void			setSyncOnClose(bool inSync);
+	NewtonErr	close(void);
+	void			discard(void);
+
+private:
+	NewtonErr	spill(void);
+
+	int			fFile;
+	bool			fIsWriting;
+	bool			fSyncOnClose;
+	// reading
+	const char *	fMap;
+	bool			fIsMapped;		// else fMap was malloc’d
+	size_t		fSize;
+	size_t		fOffset;
+	// writing
+	char *		fBuf;
+	size_t		fBufCount;
+	size_t		fFileOffset;	// file position of fBuf[0]
+};
+
+inline size_t	CMappedFilePipe::size(void) const { return fSize; }
+inline void		CMappedFilePipe::setSyncOnClose(bool inSync) { fSyncOnClose = inSync; }
+
+
+/* -----------------------------------------------------------------------------
+	Read or write a whole file of NSOF, releasing the pipe whether or not an
+	exception is thrown. Both throw exPipe if the file can’t be opened or
+	written.
+----------------------------------------------------------------------------- */
+
+extern Ref		UnflattenFile(const char * inFilename);
+extern void		FlattenToFile(RefArg inObj, const char * inFilename, bool inSync = false);
+
+#endif	/* __MAPPEDFILEPIPE_H */
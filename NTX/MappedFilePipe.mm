@@ -0,0 +1,367 @@
+/*
+	File:		MappedFilePipe.mm
+
+	Contains:	A file pipe for NSOF I/O, replacing CStdIOPipe.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "MappedFilePipe.h"
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+
+/* -----------------------------------------------------------------------------
+	C M a p p e d F i l e P i p e
+----------------------------------------------------------------------------- */
+
+CMappedFilePipe::CMappedFilePipe(const char * inFilename, const char * inMode)
+	:	fFile(-1), fIsWriting(inMode[0] == 'w'), fSyncOnClose(false),
+		fMap(NULL), fIsMapped(false), fSize(0), fOffset(0),
+		fBuf(NULL), fBufCount(0), fFileOffset(0)
+{
+	if (fIsWriting) {
+		fFile = open(inFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fFile < 0)
+			ThrowErr(exPipe, kOSErrItemNotFound);
+		if (posix_memalign((void **)&fBuf, getpagesize(), kMappedPipeWriteBufSize) != 0) {
+			::close(fFile);
+			ThrowErr(exPipe, kOSErrNoMemory);
+		}
+
+	} else {
+		struct stat info;
+		fFile = open(inFilename, O_RDONLY);
+		if (fFile < 0)
+			ThrowErr(exPipe, kOSErrItemNotFound);
+		if (fstat(fFile, &info) == 0)
+			fSize = info.st_size;
+		if (fSize > 0) {
+			void * map = mmap(NULL, fSize, PROT_READ, MAP_PRIVATE, fFile, 0);
+			if (map != MAP_FAILED) {
+				madvise(map, fSize, MADV_SEQUENTIAL);
+				fMap = (const char *)map;
+				fIsMapped = true;
+			} else {
+				// can’t map it (not a regular file?) so read it all in
+				char * buf = (char *)malloc(fSize);
+				size_t count = 0;
+				if (buf) {
+					ssize_t amtRead;
+					while (count < fSize && (amtRead = read(fFile, buf + count, fSize - count)) > 0)
+						count += amtRead;
+				}
+				if (count < fSize) {
+					if (buf)
+						free(buf);
+					::close(fFile);
+					ThrowErr(exPipe, buf ? ioErr : kOSErrNoMemory);
+				}
+				fMap = buf;
+			}
+		}
+	}
+}
+
+
+CMappedFilePipe::~CMappedFilePipe()
+{
+	// output that was never close()d is lost -- that’s a bug in the caller, so say so
+	if (fIsWriting && fFile >= 0 && fBufCount > 0)
+		NSLog(@"CMappedFilePipe destroyed without close(): %lu buffered bytes discarded", (unsigned long)fBufCount);
+	discard();
+}
+
+
+/* -----------------------------------------------------------------------------
+	Write whatever’s buffered, sync if asked to, and close the file.
+	Args:		--
+	Return:	error code -- the first error encountered
+----------------------------------------------------------------------------- */
+
+NewtonErr
+CMappedFilePipe::close(void)
+{
+	NewtonErr err = noErr;
+	if (fFile >= 0 && fIsWriting) {
+		err = spill();
+		if (err == noErr && fSyncOnClose) {
+#if defined(F_FULLFSYNC)
+			if (fcntl(fFile, F_FULLFSYNC) != 0)
+#endif
+				if (fsync(fFile) != 0)
+					err = ioErr;
+		}
+		int fd = fFile;
+		fFile = -1;
+		if (::close(fd) != 0 && err == noErr)
+			err = ioErr;
+	}
+	discard();
+	return err;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Release the file and buffers without writing anything more.
+	Safe to call more than once.
+----------------------------------------------------------------------------- */
+
+void
+CMappedFilePipe::discard(void)
+{
+	if (fBuf) {
+		free(fBuf);
+		fBuf = NULL;
+		fBufCount = 0;
+	}
+	if (fMap) {
+		if (fIsMapped)
+			munmap((void *)fMap, fSize);
+		else
+			free((void *)fMap);
+		fMap = NULL;
+		fSize = fOffset = 0;
+	}
+	if (fFile >= 0) {
+		::close(fFile);
+		fFile = -1;
+	}
+}
+
+
+#pragma mark Reading
+/* -----------------------------------------------------------------------------
+	Read from the mapped file.
+----------------------------------------------------------------------------- */
+
+void
+CMappedFilePipe::readChunk(void * outBuf, size_t & ioSize, bool & outEOF)
+{
+	const char * p = readSpan(ioSize);
+	if (ioSize > 0)
+		memcpy(outBuf, p, ioSize);
+	outEOF = (fOffset >= fSize);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return a pointer to the next bytes in the file, without copying them.
+	The pointer is valid for the lifetime of the pipe.
+	Args:		ioSize		number of bytes wanted; on return, number available
+	Return:	pointer to file data
+----------------------------------------------------------------------------- */
+
+const char *
+CMappedFilePipe::readSpan(size_t & ioSize)
+{
+	const char * p = fMap + fOffset;
+	if (ioSize > fSize - fOffset)
+		ioSize = fSize - fOffset;
+	fOffset += ioSize;
+	return p;
+}
+
+
+long
+CMappedFilePipe::readSeek(long inOffset, int inSelector)
+{
+	if (inSelector == SEEK_CUR)
+		inOffset += fOffset;
+	else if (inSelector == SEEK_END)
+		inOffset += fSize;
+	if (inOffset < 0 || (size_t)inOffset > fSize)
+		ThrowErr(exPipe, kOSErrBadParameters);
+	fOffset = inOffset;
+	return fOffset;
+}
+
+
+long
+CMappedFilePipe::readPosition(void) const
+{
+	return fOffset;
+}
+
+
+void
+CMappedFilePipe::flushRead(void)
+{ }
+
+
+void
+CMappedFilePipe::underflow(long inSize, bool & outEOF)
+{
+	outEOF = (fOffset >= fSize);
+}
+
+
+#pragma mark Writing
+/* -----------------------------------------------------------------------------
+	Write the buffered bytes to the file.
+	Args:		--
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+NewtonErr
+CMappedFilePipe::spill(void)
+{
+	size_t count = 0;
+	while (count < fBufCount) {
+		ssize_t amtWritten = pwrite(fFile, fBuf + count, fBufCount - count, fFileOffset + count);
+		if (amtWritten < 0) {
+			if (errno == EINTR)
+				continue;
+			return ioErr;
+		}
+		count += amtWritten;
+	}
+	fFileOffset += fBufCount;
+	fBufCount = 0;
+	return noErr;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Buffer output. We deliberately ignore inFlush: the whole point is to write
+	the file in as few calls as possible -- flushWrite() or close() write
+	whatever’s left.
+----------------------------------------------------------------------------- */
+
+void
+CMappedFilePipe::writeChunk(const void * inBuf, size_t inSize, bool inFlush)
+{
+	if (!fIsWriting || fFile < 0)
+		ThrowErr(exPipe, kOSErrBadParameters);
+
+	if (fBufCount + inSize > kMappedPipeWriteBufSize) {
+		if (spill() != noErr)
+			ThrowErr(exPipe, ioErr);
+		if (inSize >= kMappedPipeWriteBufSize) {
+			// too big to buffer: write it directly
+			ssize_t amtWritten;
+			const char * p = (const char *)inBuf;
+			while (inSize > 0) {
+				amtWritten = pwrite(fFile, p, inSize, fFileOffset);
+				if (amtWritten < 0) {
+					if (errno == EINTR)
+						continue;
+					ThrowErr(exPipe, ioErr);
+				}
+				p += amtWritten;
+				inSize -= amtWritten;
+				fFileOffset += amtWritten;
+			}
+			return;
+		}
+	}
+	memcpy(fBuf + fBufCount, inBuf, inSize);
+	fBufCount += inSize;
+}
+
+
+void
+CMappedFilePipe::flushWrite(void)
+{
+	if (fIsWriting && spill() != noErr)
+		ThrowErr(exPipe, ioErr);
+}
+
+
+long
+CMappedFilePipe::writeSeek(long inOffset, int inSelector)
+{
+	if (!fIsWriting)
+		ThrowErr(exPipe, kOSErrBadParameters);
+	flushWrite();
+	// we always pwrite() at fFileOffset, so the file’s own position is irrelevant
+	off_t pos = inOffset;
+	if (inSelector == SEEK_CUR)
+		pos += fFileOffset;
+	else if (inSelector == SEEK_END)
+		pos += lseek(fFile, 0, SEEK_END);
+	if (pos < 0)
+		ThrowErr(exPipe, kOSErrBadParameters);
+	fFileOffset = pos;
+	return fFileOffset;
+}
+
+
+long
+CMappedFilePipe::writePosition(void) const
+{
+	return fFileOffset + fBufCount;
+}
+
+
+void
+CMappedFilePipe::overflow()
+{
+	flushWrite();
+}
+
+
+void
+CMappedFilePipe::reset(void)
+{
+	if (fIsWriting)
+		writeSeek(0, SEEK_SET);
+	else
+		fOffset = 0;
+}
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	Unflatten the object in a file.
+	Args:		inFilename
+	Return:	the object
+----------------------------------------------------------------------------- */
+
+Ref
+UnflattenFile(const char * inFilename)
+{
+	RefVar obj;
+	CMappedFilePipe pipe(inFilename, "r");
+	unwind_protect
+	{
+		obj = UnflattenRef(pipe);
+	}
+	on_unwind
+	{
+		pipe.discard();
+	}
+	end_unwind;
+	return obj;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Flatten an object to a file.
+	Args:		inObj
+				inFilename
+				inSync		sync the file to disk before closing it
+	Return:	--
+----------------------------------------------------------------------------- */
+
+void
+FlattenToFile(RefArg inObj, const char * inFilename, bool inSync)
+{
+	CMappedFilePipe pipe(inFilename, "w");
+	pipe.setSyncOnClose(inSync);
+	unwind_protect
+	{
+		FlattenRef(inObj, pipe);
+		NewtonErr err = pipe.close();
+		if (err)
+			ThrowErr(exPipe, err);
+	}
+	on_unwind
+	{
+		pipe.discard();
+	}
+	end_unwind;
+}
@@ -33,6 +33,9 @@
 @property(readonly) int layoutType;
 + (void)startBuild;
 + (void)finishBuild;
+
+// build a layout twice and count template cache compiles; run by NTXBenchmarks
++ (NSDictionary *)benchmarkBuilding:(NSURL *)inURL;
 @end
 
 
@@ -102,7 +105,15 @@
 ----------------------------------------------------------------------------- */
 
 @interface NTXStreamDocument : NTXDocument
-@property(readonly) NSAttributedString * text;
+@property(readonly) BOOL isComplete;			// all lines have been printed at some time
+@property(readonly) NSUInteger numOfLines;	// printed so far, unless complete
+@property(readonly) NSUInteger estimatedNumOfLines;	// in the whole stream
+
+- (NSString *)linesFrom:(NSUInteger)inLine count:(NSUInteger)inCount;
+- (NSUInteger)lineOfObject:(NSUInteger)inObject;
+
+// time printing -- a sample stream is made if it doesn’t exist; run by NTXBenchmarks
++ (NSDictionary *)benchmarkPrinting:(NSURL *)inURL;
 @end
 
 
@@ -110,6 +121,24 @@
 	N T X N a t i v e C o d e D o c u m e n t
 ----------------------------------------------------------------------------- */
 
+/* -----------------------------------------------------------------------------
+	A native code document unflattens its module once, and reading, building
+	and exporting all share it until the file changes.
+	unflattens counts calls to UnflattenRef(); rebuilding an unchanged project
+	should add only hits.
+----------------------------------------------------------------------------- */
+
+struct NativeCodeCacheStats
+{
+	ULong		hits;			// file unchanged
+	ULong		hashHits;	// file touched, but content unchanged
+	ULong		unflattens;
+	uint64_t	bytesRead;
+};
+
+extern NativeCodeCacheStats	gNativeCodeCacheStats;
+
+
 @interface NTXNativeCodeDocument : NTXDocument
 @property(readonly) NSString * name;
 @property(readonly) NSString * cpu;
@@ -117,5 +146,8 @@
 @property(readonly) NSString * relocations;
 @property(readonly) NSString * debugFile;
 @property(readonly) NSAttributedString * entryPoints;
+
+// build every module in a folder repeatedly; run by NTXBenchmarks
++ (NSDictionary *)benchmarkBuilding:(NSURL *)inFolder;
 @end
 
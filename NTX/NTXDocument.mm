@@ -9,15 +9,26 @@
 #import "NTXDocument.h"
 #import "ProjectTypes.h"
 #import "Utilities.h"
+#import "MappedFilePipe.h"
+#import "SlotCache.h"
+#import "TemplateCache.h"
+#import "ProtoRegistry.h"
+#import "StreamPrinter.h"
 #import "NTK/Funcs.h"
 #import "NTK/Globals.h"
 
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <libkern/OSByteOrder.h>
+
 extern void DefConst(const char * inSym, RefArg inVal);
 extern "C" Ref FIntern(RefArg inRcvr, RefArg inStr);
 
 
 extern NSNumberFormatter * gNumberFormatter;
 extern NSDateFormatter * gDateFormatter;
+extern NSString * const NTXLayoutFileType;
+extern NSString * const NTXCodeFileType;
 
 #define kSecondsSince1904 2082844800
 
@@ -206,62 +217,6 @@ CUserProtoList::indexFor(RefArg fSpec) {
 }
 
 ----------------------------------------------------------------------------- */
-extern const char * FilenameFromFSSpec(void * inFSpec, ArrayIndex inLen);
-extern Ref MakeString(NSString * str);
-
-@interface UserProtoList : NSObject
-{
-	ArrayIndex index;
-	// each element in userProtos is a frame { path:<binary object>, name:<string>, object:<user proto>}
-	// and we only need the index in case the frame gets sorted
-	RefStruct userProtos;
-}
-- (void)addObject:(RefArg)inObj for:(NSURL *)inFSpec;
-- (Ref)objectFor:(RefArg)inFSpec;
-@end
-
-
-@implementation UserProtoList
-
-- (id)init {
-	if (self = [super init]) {
-		index = 0;
-		userProtos = MakeArray(0);
-	}
-	return self;
-}
-
-- (void)dealloc {
-	userProtos = nil;
-}
-
-- (void)addObject:(RefArg)inObj for:(NSURL *)inFSpec {
-	RefVar item(AllocateFrame());
-	// only save the filename from the URL
-	RefVar upfs(MakeString(inFSpec.lastPathComponent));
-	SetFrameSlot(item, SYMA(path), upfs);
-	SetFrameSlot(item, SYMA(object), inObj);
-	AddArraySlot(userProtos, item);
-	++index;
-}
-
-
-- (Ref)objectFor:(RefArg)fSpec {
-	const char * filename = FilenameFromFSSpec(BinaryData(fSpec), Length(fSpec));
-	FOREACH(userProtos, proto)
-		RefVar upfs(GetFrameSlot(proto, SYMA(path)));
-		const char * upfilename = BinaryData(ASCIIString(upfs));
-		if (strcmp(filename, upfilename) == 0) {
-			return GetFrameSlot(proto, SYMA(object));
-		}
-	END_FOREACH
-	printf("USER PROTO NOT FOUND!");
-	return NILREF;
-}
-
-@end
-
-
 #import "LayoutViewController.h"
 
 @interface NTXLayoutDocument ()
@@ -304,8 +259,7 @@ Ref ReadLayoutSettings(NSURL * url);
 	NewtonErr err = noErr;
 	newton_try
 	{
-		CStdIOPipe pipe(url.fileSystemRepresentation, "r");
-		_layoutRef = UnflattenRef(pipe);
+		_layoutRef = UnflattenFile(url.fileSystemRepresentation);
 
 		RefVar templateHierarchy(GetFrameSlot(self.layoutRef, MakeSymbol("templateHierarchy")));
 		if (ISNIL(templateHierarchy)) {
@@ -349,8 +303,7 @@ Ref ReadLayoutSettings(NSURL * url);
 			_layoutRef = GetFrameSlot(self.layoutRef, MakeSymbol("templateHierarchy"));
 		}
 #endif
-		CStdIOPipe pipe(url.fileSystemRepresentation, "w");
-		FlattenRef(self.layoutRef, pipe);
+		FlattenToFile(self.layoutRef, url.fileSystemRepresentation);
 	}
 	newton_catch_all
 	{
@@ -370,6 +323,9 @@ Ref ReadLayoutSettings(NSURL * url);
 ----------------------------------------------------------------------------- */
 extern Ref ParseString(RefArg inStr);
 
+// compiled slot source persists from one build to the next
+static CTemplateCache * fgTemplateCache = NULL;
+
 Ref
 AddStepForm(RefArg parent, RefArg child) {
 	RefVar childArraySym(fgUseStepChildren? SYMA(stepChildren) : SYMA(viewChildren));
@@ -404,7 +360,7 @@ StepDeclare(RefArg parent, RefArg child, RefArg tag) {
 	if (NOTNIL(script)) {
 		script = GetFrameSlot(script, SYMA(value));
 		RemoveSlot(slots, SYMA(beforeScript));
-		RefVar codeBlock(ParseString(script));
+		RefVar codeBlock(fgTemplateCache->compile(script));
 		if (NOTNIL(codeBlock)) {
 			InterpretBlock(codeBlock, RA(NILREF));
 		}
@@ -416,10 +372,14 @@ StepDeclare(RefArg parent, RefArg child, RefArg tag) {
 		RemoveSlot(slots, SYMA(afterScript));
 	}
 
+	// slot frames in a layout file share maps, so cache where their value and type slots are
+	static CSlotAccessor valueSlot(SYMA(value));
+	static CSlotAccessor dataTypeSlot(MakeSymbol("__ntDataType"));
+
 	RefVar regularSlot, proto, userProto, viewClass, stepChildren;
 	FOREACH_WITH_TAG(slots, tag, slot)
-		RefVar value(GetFrameSlot(slot, SYMA(value)));
-		RefVar type(GetFrameSlot(slot, MakeSymbol("__ntDataType")));
+		RefVar value(valueSlot.get(slot));
+		RefVar type(dataTypeSlot.get(slot));
 		CDataPtr typeData(ASCIIString(type));
 		const char * typeStr = (const char *)typeData;
 		int selector = (typeStr[0] << 24) + (typeStr[1] << 16) + (typeStr[2] << 8) + typeStr[3];
@@ -440,8 +400,13 @@ StepDeclare(RefArg parent, RefArg child, RefArg tag) {
 		default:
 			switch (selector) {
 			case 'EVAL':
+				{
+				RefVar codeBlock(fgTemplateCache->compile(value));
+				regularSlot = InterpretBlock(codeBlock, RA(NILREF));
+				}
+				break;
 			case 'SCPT':
-				regularSlot = InterpretBlock(ParseString(value), RA(NILREF));
+				regularSlot = fgTemplateCache->evaluateFunction(value);
 				break;
 			case 'TEXT':
 			case 'NUMB':
@@ -488,7 +453,7 @@ StepDeclare(RefArg parent, RefArg child, RefArg tag) {
 
 	// afterScript
 	if (NOTNIL(script)) {
-		RefVar codeBlock(ParseString(script));
+		RefVar codeBlock(fgTemplateCache->compile(script));
 		if (NOTNIL(codeBlock)) {
 			InterpretBlock(codeBlock, RA(NILREF));
 		}
@@ -520,14 +485,18 @@ StepDeclare(RefArg parent, RefArg child, RefArg tag) {
 
 static ArrayIndex fgUserProtoSequenceNumber, fgAnonymousViewSequenceNumber;
 static bool fgUseStepChildren;
-static UserProtoList * fgUserProtoList = nil;
+static NTXProtoRegistry * fgUserProtoList = nil;
 + (void)startBuild {
 	// for export
 	fgUserProtoSequenceNumber = 0;
 	fgAnonymousViewSequenceNumber = 0;
 	// for build
 	fgUseStepChildren = NOTNIL(GetGlobalConstant(MakeSymbol("kUseStepChildren")));
-	fgUserProtoList = [[UserProtoList alloc] init];
+	fgUserProtoList = [[NTXProtoRegistry alloc] init];
+	if (fgTemplateCache == NULL) {
+		fgTemplateCache = new CTemplateCache;
+	}
+	fgTemplateCache->beginBuild();
 }
 
 
@@ -554,6 +523,48 @@ static UserProtoList * fgUserProtoList = nil;
 }
 
 
+/* -----------------------------------------------------------------------------
+	Benchmark building a layout.
+	The layout is built twice, as two project builds would. The first build
+	compiles every script; the second should find them all in the template
+	cache and add no compiles.
+	Args:		inURL			layout file
+	Return:	{ first: {...}, second: {...} }
+----------------------------------------------------------------------------- */
+
+static NSDictionary *
+TemplateStatsSince(const TemplateCacheStats & inStart, const SlotCacheStats & inSlotStart, CFAbsoluteTime inStartTime)
+{
+	return @{ @"hits":[NSNumber numberWithUnsignedInt:gTemplateCacheStats.hits - inStart.hits],
+				 @"compiles":[NSNumber numberWithUnsignedInt:gTemplateCacheStats.compiles - inStart.compiles],
+				 @"evaluationsSkipped":[NSNumber numberWithUnsignedInt:gTemplateCacheStats.evaluationsSkipped - inStart.evaluationsSkipped],
+				 @"flushes":[NSNumber numberWithUnsignedInt:gTemplateCacheStats.flushes - inStart.flushes],
+				 @"slotHits":[NSNumber numberWithUnsignedInt:gSlotCacheStats.hits - inSlotStart.hits],
+				 @"slotMisses":[NSNumber numberWithUnsignedInt:gSlotCacheStats.misses - inSlotStart.misses],
+				 @"ms":@((CFAbsoluteTimeGetCurrent() - inStartTime) * 1000.0) };
+}
+
+
++ (NSDictionary *)benchmarkBuilding:(NSURL *)inURL {
+	NTXLayoutDocument * layout = [[NTXLayoutDocument alloc] initWithContentsOfURL:inURL ofType:NTXLayoutFileType error:NULL];
+	if (layout == nil)
+		return nil;
+
+	NSMutableDictionary * results = [[NSMutableDictionary alloc] init];
+	NSArray * passes = @[@"first", @"second"];
+	for (NSString * pass in passes) {
+		TemplateCacheStats start = gTemplateCacheStats;
+		SlotCacheStats slotStart = gSlotCacheStats;
+		CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+		[NTXLayoutDocument startBuild];
+		[layout build];
+		[NTXLayoutDocument finishBuild];
+		results[pass] = TemplateStatsSince(start, slotStart, startTime);
+	}
+	return results;
+}
+
+
 /* -----------------------------------------------------------------------------
 	Export our layout.
 
@@ -609,10 +620,12 @@ static UserProtoList * fgUserProtoList = nil;
 		RemoveSlot(slots, SYMA(afterScript));
 	}
 	fprintf(fp, "%s :=\n    {", (char *)nameStr);
+	static CSlotAccessor valueSlot(SYMA(value));
+	static CSlotAccessor dataTypeSlot(MakeSymbol("__ntDataType"));
 	ArrayIndex index = 0, count = Length(slots);
 	FOREACH_WITH_TAG(slots, tag, slot)
-		RefVar value(GetFrameSlot(slot, SYMA(value)));
-		RefVar type(GetFrameSlot(slot, MakeSymbol("__ntDataType")));
+		RefVar value(valueSlot.get(slot));
+		RefVar type(dataTypeSlot.get(slot));
 		CDataPtr typeData(ASCIIString(type));
 		const char * typeStr = (const char *)typeData;
 		int selector = (typeStr[0] << 24) + (typeStr[1] << 16) + (typeStr[2] << 8) + typeStr[3];
@@ -843,8 +856,18 @@ static UserProtoList * fgUserProtoList = nil;
 	N T X S t r e a m D o c u m e n t
 	A Newton Streamed Object File (NSOF) object.
 	Read-only.
+	Stream files can be large, so we don’t unflatten and print the whole
+	object; a CStreamPrinter prints just the lines the view shows.
 ----------------------------------------------------------------------------- */
 @implementation NTXStreamDocument
+{
+	CStreamPrinter * printer;
+}
+
+- (void)dealloc {
+	delete printer;
+}
+
 
 - (NSString *) storyboardName {
 	return @"Stream";
@@ -856,35 +879,194 @@ static UserProtoList * fgUserProtoList = nil;
 
 
 /* -----------------------------------------------------------------------------
-	Read NSOF stream file from disk.
-	Create UI representation.
+	Open NSOF stream file.
+	Nothing is printed until the view asks for it.
 ----------------------------------------------------------------------------- */
 
 - (BOOL)readFromURL:(NSURL *)url ofType:(NSString *)typeName error:(NSError *__autoreleasing *)outError {
-	NewtonErr err = noErr;
-	NSString * txt = nil;
-	newton_try
-	{
-		CStdIOPipe pipe(url.fileSystemRepresentation, "r");
-		RefVar stream(UnflattenRef(pipe));
-		txt = PrintObject(stream);
+	CStreamPrinter * newPrinter = new CStreamPrinter;
+	NewtonErr err = newPrinter->open(url.fileSystemRepresentation);
+	if (err) {
+		delete newPrinter;
+		if (outError)
+			*outError = [NSError errorWithDomain: NSOSStatusErrorDomain code: ioErr userInfo: nil];
+		return NO;
 	}
-	newton_catch_all
-	{
-		err = (NewtonErr)(long)CurrentException()->data;;
-		txt = @"Not a stream file!";
+	delete printer;
+	printer = newPrinter;
+	return YES;
+}
+
+
+- (BOOL)isComplete {
+	return printer && printer->isComplete();
+}
+
+- (NSUInteger)numOfLines {
+	return printer ? printer->numOfLines() : 0;
+}
+
+- (NSUInteger)estimatedNumOfLines {
+	return printer ? printer->estimatedNumOfLines() : 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return lines of the printed stream.
+	Args:		inLine		first line
+				inCount		number of lines
+	Return:	the lines, each terminated by newline; fewer at the end of the stream
+----------------------------------------------------------------------------- */
+
+- (NSString *)linesFrom:(NSUInteger)inLine count:(NSUInteger)inCount {
+	std::string text;
+	if (printer)
+		printer->print((ArrayIndex)inLine, (ArrayIndex)inCount, text);
+	return [[NSString alloc] initWithBytes:text.data() length:text.length() encoding:NSUTF8StringEncoding];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the line on which an object is printed.
+	Args:		inObject		object number; the root object is 0, and the rest are
+								numbered in the order they are printed
+	Return:	line number; NSNotFound if there is no such object
+----------------------------------------------------------------------------- */
+
+- (NSUInteger)lineOfObject:(NSUInteger)inObject {
+	ArrayIndex line = printer ? printer->lineOfObject((ArrayIndex)inObject) : kIndexNotFound;
+	return line == kIndexNotFound ? NSNotFound : line;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Benchmark printing.
+	Reports how long the first screenful takes, how long to print everything,
+	and how long to go back to a line or object already passed -- and peak
+	memory use, which should be about the size of the stream (it’s mapped)
+	rather than a multiple of it.
+	Args:		inURL			stream file; if it doesn’t exist a 100MB sample is
+								written there
+	Return:	results
+----------------------------------------------------------------------------- */
+#define kBenchmarkStreamSize	(100*MByte)
+#define kBenchmarkWindowLines	100
+
+static void
+WriteXLong(FILE * inFP, ULong inValue)
+{
+	if (inValue < 0xFF) {
+		fputc(inValue, inFP);
+	} else {
+		uint32_t bigValue = OSSwapHostToBigInt32(inValue);
+		fputc(0xFF, inFP);
+		fwrite(&bigValue, sizeof(bigValue), 1, inFP);
 	}
-	end_try;
+}
 
-	// set text field with that string
-	_text = [[NSAttributedString alloc] initWithString:txt
-														 attributes:@{ NSFontAttributeName:[NSFont fontWithName:@"Menlo" size:NSFont.smallSystemFontSize],
-																			NSForegroundColorAttributeName:NSColor.blackColor }];
 
-	if (err && outError)
-		*outError = [NSError errorWithDomain: NSOSStatusErrorDomain code: ioErr userInfo: nil];
+/* -----------------------------------------------------------------------------
+	Write a sample stream: an array of frames
+		{ name: "Item <n>", value: <n>, items: [<n>, <n+1>, <n+2>, <n+3>] }
+	The slot tags are written once and referred to thereafter, as they would be
+	by FlattenRef.
+----------------------------------------------------------------------------- */
 
-	return err == noErr;
+static bool
+WriteSampleStream(const char * inFilename, size_t inSize)
+{
+	FILE * fp = fopen(inFilename, "w");
+	if (fp == NULL)
+		return false;
+	ULong numOfFrames = (ULong)(inSize / 64);
+	fputc(2, fp);					// version
+	fputc(5, fp);					// plain array
+	WriteXLong(fp, numOfFrames);
+	for (ULong n = 0; n < numOfFrames; ++n) {
+		fputc(6, fp);				// frame
+		WriteXLong(fp, 3);
+		if (n == 0) {
+			const char * tags[3] = { "name", "value", "items" };
+			for (ArrayIndex i = 0; i < 3; ++i) {
+				fputc(7, fp);		// symbol
+				WriteXLong(fp, (ULong)strlen(tags[i]));
+				fputs(tags[i], fp);
+			}
+		} else {
+			// precedent IDs 2,3,4 -- after the array and first frame
+			for (ULong i = 2; i <= 4; ++i) {
+				fputc(9, fp);
+				WriteXLong(fp, i);
+			}
+		}
+		char name[32];
+		ArrayIndex nameLen = snprintf(name, sizeof(name), "Item %u", n);
+		fputc(8, fp);				// string
+		WriteXLong(fp, (nameLen + 1) * sizeof(UniChar));
+		for (ArrayIndex i = 0; i <= nameLen; ++i) {
+			fputc(0, fp);
+			fputc(name[i], fp);
+		}
+		fputc(0, fp);				// immediate
+		WriteXLong(fp, (n & 0x1FFFFFFF) << 2);
+		fputc(5, fp);				// plain array
+		WriteXLong(fp, 4);
+		for (ULong i = 0; i < 4; ++i) {
+			fputc(0, fp);
+			WriteXLong(fp, ((n + i) & 0x1FFFFFFF) << 2);
+		}
+	}
+	bool isOK = ferror(fp) == 0;
+	return fclose(fp) == 0 && isOK;
+}
+
+
+static double
+PeakMemoryMB(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / (double)MByte;	// bytes on macOS
+}
+
+
++ (NSDictionary *)benchmarkPrinting:(NSURL *)inURL {
+	NSMutableDictionary * results = [[NSMutableDictionary alloc] init];
+	if (![inURL checkResourceIsReachableAndReturnError:NULL]) {
+		if (!WriteSampleStream(inURL.fileSystemRepresentation, kBenchmarkStreamSize))
+			return @{ @"error":@"can’t write sample stream" };
+		results[@"sampleWritten"] = @YES;
+	}
+	results[@"peakMBBefore"] = @(PeakMemoryMB());
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	CStreamPrinter streamPrinter;
+	NewtonErr err = streamPrinter.open(inURL.fileSystemRepresentation);
+	if (err)
+		return @{ @"error":[NSNumber numberWithInt:err] };
+	std::string text;
+	streamPrinter.print(0, kBenchmarkWindowLines, text);
+	results[@"firstWindowMs"] = @((CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+
+	// walk to the end
+	start = CFAbsoluteTimeGetCurrent();
+	streamPrinter.lineOfObject(kIndexNotFound - 1);
+	results[@"walkAllMs"] = @((CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+	ArrayIndex numOfLines = streamPrinter.numOfLines();
+	results[@"lines"] = [NSNumber numberWithUnsignedInt:numOfLines];
+	results[@"streamMB"] = @(streamPrinter.size() / (double)MByte);
+
+	// go back
+	start = CFAbsoluteTimeGetCurrent();
+	text.clear();
+	streamPrinter.print(numOfLines / 2, kBenchmarkWindowLines, text);
+	results[@"seekLineMs"] = @((CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+	start = CFAbsoluteTimeGetCurrent();
+	streamPrinter.lineOfObject(numOfLines / 3);		// there are at least half as many objects as lines
+	results[@"seekObjectMs"] = @((CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+
+	results[@"peakMBAfter"] = @(PeakMemoryMB());
+	return results;
 }
 
 
@@ -899,8 +1081,7 @@ static UserProtoList * fgUserProtoList = nil;
 	RefVar stream;
 	newton_try
 	{
-		CStdIOPipe pipe(self.fileURL.fileSystemRepresentation, "r");
-		stream = UnflattenRef(pipe);
+		stream = UnflattenFile(self.fileURL.fileSystemRepresentation);
 		DefConst(self.symbol.UTF8String, stream);
 		DoMessageIfDefined(stream, MakeSymbol("Install"), RA(NILREF), NULL);
 	}
@@ -932,6 +1113,25 @@ static UserProtoList * fgUserProtoList = nil;
 @end
 
 
+NativeCodeCacheStats	gNativeCodeCacheStats;
+
+
+/* -----------------------------------------------------------------------------
+	FNV-1a hash of a file’s contents.
+----------------------------------------------------------------------------- */
+
+static uint64_t
+HashBytes(const char * inData, size_t inLen)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char * s = (const unsigned char *)inData;
+	for (size_t i = 0; i < inLen; ++i) {
+		hash = (hash ^ s[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+
 #pragma mark -
 /* -----------------------------------------------------------------------------
 	N T X N a t i v e C o d e D o c u m e n t
@@ -939,6 +1139,14 @@ static UserProtoList * fgUserProtoList = nil;
 	Read-only.
 ----------------------------------------------------------------------------- */
 @implementation NTXNativeCodeDocument
+{
+	// the unflattened module, and the file it came from
+	RefStruct codeModule;
+	struct timespec modTime;
+	size_t fileSize;
+	uint64_t fileHash;
+}
+
 
 - (NSString *)storyboardName {
 	return @"NativeCode";
@@ -954,8 +1162,7 @@ static UserProtoList * fgUserProtoList = nil;
 	NewtonErr err = noErr;
 	newton_try
 	{
-		CStdIOPipe pipe(url.fileSystemRepresentation, "r");
-		RefVar codeModule(UnflattenRef(pipe));
+		RefVar codeModule([self codeModuleFrom:url]);
 		_name = MakeNSSymbol(GetFrameSlot(codeModule, SYMA(name)));
 		_cpu = MakeNSSymbol(GetFrameSlot(codeModule, MakeSymbol("CPUType")));
 
@@ -1005,6 +1212,57 @@ static UserProtoList * fgUserProtoList = nil;
 }
 
 
+/* -----------------------------------------------------------------------------
+	Return our code module, unflattening it only if the file has changed since
+	we last did.
+	A new modification date doesn’t necessarily mean new content -- the file
+	may just have been touched or copied -- so we also compare a hash of the
+	content before unflattening again.
+	Args:		inURL			the file
+	Return:	the code module frame
+				throws if the file can’t be read
+----------------------------------------------------------------------------- */
+
+- (Ref)codeModuleFrom:(NSURL *)inURL {
+	const char * path = inURL.fileSystemRepresentation;
+	struct stat info;
+	bool isStatted = stat(path, &info) == 0;
+	if (NOTNIL(codeModule) && isStatted
+	&&  (size_t)info.st_size == fileSize
+	&&  info.st_mtimespec.tv_sec == modTime.tv_sec && info.st_mtimespec.tv_nsec == modTime.tv_nsec) {
+		gNativeCodeCacheStats.hits++;
+		return codeModule;
+	}
+
+	CMappedFilePipe pipe(path, "r");
+	unwind_protect
+	{
+		size_t len = pipe.size();
+		uint64_t hash = HashBytes(pipe.readSpan(len), len);
+		gNativeCodeCacheStats.bytesRead += len;
+		if (NOTNIL(codeModule) && len == fileSize && hash == fileHash) {
+			gNativeCodeCacheStats.hashHits++;
+		} else {
+			pipe.readSeek(0, SEEK_SET);
+			codeModule = NILREF;
+			codeModule = UnflattenRef(pipe);
+			gNativeCodeCacheStats.unflattens++;
+			fileSize = len;
+			fileHash = hash;
+		}
+	}
+	on_unwind
+	{
+		pipe.discard();
+	}
+	end_unwind;
+	if (isStatted) {
+		modTime = info.st_mtimespec;
+	}
+	return codeModule;
+}
+
+
 /* -----------------------------------------------------------------------------
 	Compile our native code module, like so:
 		DefConst('<filename>, <frameOfCodeFile>);
@@ -1012,21 +1270,20 @@ static UserProtoList * fgUserProtoList = nil;
 
 - (Ref)build {
 	NewtonErr err = noErr;
-	RefVar codeModule;
+	RefVar module;
 	newton_try
 	{
-		CStdIOPipe pipe(self.fileURL.fileSystemRepresentation, "r");
-		codeModule = UnflattenRef(pipe);
-		DefConst(self.symbol.UTF8String, codeModule);
+		module = [self codeModuleFrom:self.fileURL];
+		DefConst(self.symbol.UTF8String, module);
 	}
 	newton_catch_all
 	{
 		err = (NewtonErr)(long)CurrentException()->data;;
-		codeModule = NILREF;
+		module = NILREF;
 	}
 	end_try;
 
-	return codeModule;
+	return module;
 }
 
 
@@ -1045,9 +1302,8 @@ static UserProtoList * fgUserProtoList = nil;
 	NewtonErr err = noErr;
 	newton_try
 	{
-		CStdIOPipe pipe(self.fileURL.fileSystemRepresentation, "r");
-		RefVar codeModule(UnflattenRef(pipe));
-		PrintObject(fp, codeModule, 4, NILREF, MAKEINT(16));
+		RefVar module([self codeModuleFrom:self.fileURL]);
+		PrintObject(fp, module, 4, NILREF, MAKEINT(16));
 	}
 	newton_catch_all
 	{
@@ -1059,5 +1315,66 @@ static UserProtoList * fgUserProtoList = nil;
 		*outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:ioErr userInfo:nil];
 }
 
+
+/* -----------------------------------------------------------------------------
+	Benchmark building many native code modules.
+	Every module in the folder is opened, then built kBenchmarkBuilds times
+	and exported once, as repeated project builds would. Only opening a module
+	should unflatten it or read its file.
+	Args:		inFolder		folder of .nativecode files
+	Return:	{ modules:, open: {...}, build: {...}, export: {...} }
+----------------------------------------------------------------------------- */
+#define kBenchmarkBuilds 10
+
+static NSDictionary *
+NativeCodeStatsSince(const NativeCodeCacheStats & inStart, CFAbsoluteTime inStartTime)
+{
+	return @{ @"hits":[NSNumber numberWithUnsignedInt:gNativeCodeCacheStats.hits - inStart.hits],
+				 @"hashHits":[NSNumber numberWithUnsignedInt:gNativeCodeCacheStats.hashHits - inStart.hashHits],
+				 @"unflattens":[NSNumber numberWithUnsignedInt:gNativeCodeCacheStats.unflattens - inStart.unflattens],
+				 @"bytesRead":[NSNumber numberWithUnsignedLongLong:gNativeCodeCacheStats.bytesRead - inStart.bytesRead],
+				 @"ms":@((CFAbsoluteTimeGetCurrent() - inStartTime) * 1000.0) };
+}
+
+
++ (NSDictionary *)benchmarkBuilding:(NSURL *)inFolder {
+	NSMutableArray<NTXNativeCodeDocument *> * modules = [[NSMutableArray alloc] init];
+	NSMutableDictionary * results = [[NSMutableDictionary alloc] init];
+
+	NativeCodeCacheStats start = gNativeCodeCacheStats;
+	CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+	NSDirectoryEnumerator * iter = [NSFileManager.defaultManager enumeratorAtURL:inFolder includingPropertiesForKeys:nil options:0 errorHandler:nil];
+	for (NSURL * url in iter) {
+		if ([url.pathExtension isEqualToString:@"nativecode"]) {
+			NTXNativeCodeDocument * module = [[NTXNativeCodeDocument alloc] initWithContentsOfURL:url ofType:NTXCodeFileType error:NULL];
+			if (module)
+				[modules addObject:module];
+		}
+	}
+	results[@"modules"] = [NSNumber numberWithUnsignedInteger:modules.count];
+	results[@"open"] = NativeCodeStatsSince(start, startTime);
+
+	start = gNativeCodeCacheStats;
+	startTime = CFAbsoluteTimeGetCurrent();
+	for (int i = 0; i < kBenchmarkBuilds; ++i) {
+		for (NTXNativeCodeDocument * module in modules) {
+			[module build];
+		}
+	}
+	results[@"build"] = NativeCodeStatsSince(start, startTime);
+
+	start = gNativeCodeCacheStats;
+	startTime = CFAbsoluteTimeGetCurrent();
+	FILE * fp = fopen("/dev/null", "w");
+	if (fp) {
+		for (NTXNativeCodeDocument * module in modules) {
+			[module exportToText:fp error:NULL];
+		}
+		fclose(fp);
+	}
+	results[@"export"] = NativeCodeStatsSince(start, startTime);
+	return results;
+}
+
 @end
 
@@ -8,6 +8,8 @@
 
 #include "NewtonKit.h"
 
+class CKeymap;
+
 /* -----------------------------------------------------------------------------
 	N T X E d i t o r V i e w
 	A plain text view that accepts NewtonScript editing commands.
@@ -16,7 +18,14 @@
 @interface NTXEditorView : NSTextView
 {
 	RefStruct ntxView;
+	// what this view’s keys are bound to
+	CKeymap * keymap;
+	// a command has just been sent to the editor, and may have changed what the next key does
+	bool isCommandPending;
 }
+
+// replay keystrokes through keyDown: and time them; run by NTXBenchmarks
++ (NSDictionary *)benchmarkKeystrokes:(NSString *)inScript;
 @end
 
 /* -----------------------------------------------------------------------------
@@ -12,6 +12,250 @@
 #import "NTK/Funcs.h"
 #import "NTK/Globals.h"
 
+#include <mach/mach_time.h>
+#include <unordered_map>
+
+
+/*------------------------------------------------------------------------------
+	K e y m a p
+	Asking protoEditor for a key’s handler means building a key spec frame
+	and sending GetKeyHandler -- for every keystroke, even plain typing.
+	But for a given key GetKeyHandler always answers the same, unless a
+	handler has changed the editor’s state (eg a prefix key) or rebound a key,
+	so each view remembers its answers natively. A key whose answer we know is
+	handled without creating any NewtonScript objects. The standard movement,
+	selection and deletion commands are done by NSTextView’s own actions;
+	only other bound commands go through DoMessage().
+	Each view’s ntxView frame overrides SetKeyHandler to count rebindings in
+	the global ntxKeyBindingsSeed; a keymap whose seed is out of date -- or
+	whose protoEditor has been replaced -- is flushed.
+	Keys are packed into a ULong:
+		bit 31			key is a character (else a virtual key code)
+		bits 16..19		modifiers
+		bits 0..15		character or key code
+------------------------------------------------------------------------------*/
+
+#define kKeyIsChar		0x80000000
+#define kKeyShift			0x00010000
+#define kKeyControl		0x00020000
+#define kKeyOption		0x00040000
+#define kKeyCommand		0x00080000
+
+struct KeymapStats
+{
+	ULong		hits;
+	ULong		lookups;		// GetKeyHandler messages sent
+	ULong		commands;	// handler messages sent
+	ULong		actions;		// commands done by NSTextView actions instead
+};
+
+KeymapStats	gKeymapStats;
+static bool	gUseKeymap = true;
+
+
+class CKeymap
+{
+public:
+				CKeymap();
+
+	bool		lookup(ULong inKey, Ref * outHandler, SEL * outAction);
+	void		add(ULong inKey, RefArg inHandler, SEL inAction);
+	void		flush(void);
+
+private:
+	struct Binding
+	{
+		ArrayIndex	handler;		// index into fHandlers; kIndexNotFound => unbound
+		SEL			action;		// NSTextView action that does the same, if any
+	};
+	std::unordered_map<ULong, Binding> fMap;
+	RefStruct	fHandlers;
+	RefStruct	fProto;		// protoEditor the answers came from
+	RefStruct	fSeedTag;	// 'ntxKeyBindingsSeed
+	Ref			fSeed;		// its value when the answers were given
+};
+
+
+CKeymap::CKeymap()
+{
+	fSeedTag = MakeSymbol("ntxKeyBindingsSeed");
+	if (ISNIL(GetGlobalVar(fSeedTag))) {
+		DefGlobalVar(fSeedTag, MAKEINT(0));
+	}
+	flush();
+}
+
+
+void
+CKeymap::flush(void)
+{
+	fMap.clear();
+	fHandlers = MakeArray(0);
+	fProto = GetGlobalVar(SYMA(protoEditor));
+	fSeed = GetGlobalVar(fSeedTag);
+}
+
+
+/*------------------------------------------------------------------------------
+	Look up a key.
+	Args:		inKey			packed key
+				outHandler	its handler symbol, or NILREF if unbound
+				outAction	the equivalent NSTextView action, or NULL
+	Return:	true => we know the answer
+------------------------------------------------------------------------------*/
+
+bool
+CKeymap::lookup(ULong inKey, Ref * outHandler, SEL * outAction)
+{
+	if (!EQRef(fProto, GetGlobalVar(SYMA(protoEditor)))
+	||  fSeed != GetGlobalVar(fSeedTag)) {
+		// the editor has been reinstalled or a key rebound
+		flush();
+		return false;
+	}
+	auto iter = fMap.find(inKey);
+	if (iter == fMap.end()) {
+		return false;
+	}
+	const Binding & binding = iter->second;
+	*outHandler = binding.handler == kIndexNotFound ? NILREF : GetArraySlot(fHandlers, binding.handler);
+	*outAction = binding.action;
+	gKeymapStats.hits++;
+	return true;
+}
+
+
+void
+CKeymap::add(ULong inKey, RefArg inHandler, SEL inAction)
+{
+	Binding binding = { kIndexNotFound, inAction };
+	if (NOTNIL(inHandler)) {
+		binding.handler = Length(fHandlers);
+		AddArraySlot(fHandlers, inHandler);
+	}
+	fMap[inKey] = binding;
+}
+
+
+/*------------------------------------------------------------------------------
+	Make the argument GetKeyHandler expects for a packed key:
+	the key itself, or if modified a frame
+		{ key:, shift:, control:, option:, command: }
+------------------------------------------------------------------------------*/
+
+static Ref
+KeySpec(ULong inKey)
+{
+	RefVar keyCode((inKey & kKeyIsChar) ? MAKECHAR(inKey & 0xFFFF) : MAKEINT(inKey & 0xFFFF));
+	if ((inKey & (kKeyShift | kKeyControl | kKeyOption | kKeyCommand)) == 0) {
+		return keyCode;
+	}
+	RefVar keyState(AllocateFrame());
+	if (inKey & kKeyShift)
+		SetFrameSlot(keyState, SYMA(shift), RA(TRUEREF));
+	if (inKey & kKeyControl)
+		SetFrameSlot(keyState, SYMA(control), RA(TRUEREF));
+	if (inKey & kKeyOption)
+		SetFrameSlot(keyState, SYMA(option), RA(TRUEREF));
+	if (inKey & kKeyCommand)
+		SetFrameSlot(keyState, SYMA(command), RA(TRUEREF));
+	SetFrameSlot(keyState, SYMA(key), keyCode);
+	return keyState;
+}
+
+
+/*------------------------------------------------------------------------------
+	The editor commands NSTextView has its own actions for: moving the
+	selection, extending it, and deleting. None of them is a prefix, so the
+	key after one is handled as usual.
+------------------------------------------------------------------------------*/
+
+static const struct
+{
+	const char *	command;
+	SEL				action;
+} kNativeCommands[] =
+{
+	{ "MoveCharBackward",			@selector(moveBackward:) },
+	{ "MoveCharForward",				@selector(moveForward:) },
+	{ "MoveWordBackward",			@selector(moveWordBackward:) },
+	{ "MoveWordForward",				@selector(moveWordForward:) },
+	{ "MoveLineUp",					@selector(moveUp:) },
+	{ "MoveLineDown",					@selector(moveDown:) },
+	{ "MovePageUp",					@selector(pageUp:) },
+	{ "MovePageDown",					@selector(pageDown:) },
+	{ "MoveToBeginningOfLine",		@selector(moveToBeginningOfLine:) },
+	{ "MoveToEndOfLine",				@selector(moveToEndOfLine:) },
+	{ "MoveToBeginningOfText",		@selector(moveToBeginningOfDocument:) },
+	{ "MoveToEndOfText",				@selector(moveToEndOfDocument:) },
+	{ "SelectCharBackward",			@selector(moveBackwardAndModifySelection:) },
+	{ "SelectCharForward",			@selector(moveForwardAndModifySelection:) },
+	{ "SelectWordBackward",			@selector(moveWordBackwardAndModifySelection:) },
+	{ "SelectWordForward",			@selector(moveWordForwardAndModifySelection:) },
+	{ "SelectLineUp",					@selector(moveUpAndModifySelection:) },
+	{ "SelectLineDown",				@selector(moveDownAndModifySelection:) },
+	{ "SelectPageUp",					@selector(pageUpAndModifySelection:) },
+	{ "SelectPageDown",				@selector(pageDownAndModifySelection:) },
+	{ "SelectToBeginningOfLine",	@selector(moveToBeginningOfLineAndModifySelection:) },
+	{ "SelectToEndOfLine",			@selector(moveToEndOfLineAndModifySelection:) },
+	{ "SelectToBeginningOfText",	@selector(moveToBeginningOfDocumentAndModifySelection:) },
+	{ "SelectToEndOfText",			@selector(moveToEndOfDocumentAndModifySelection:) },
+	{ "Delete",							@selector(deleteBackward:) },
+	{ "DeleteForward",				@selector(deleteForward:) },
+	{ "DeleteWordBackward",			@selector(deleteWordBackward:) },
+	{ "DeleteWordForward",			@selector(deleteWordForward:) },
+	{ "DeleteToEndOfLine",			@selector(deleteToEndOfLine:) }
+};
+
+
+/*------------------------------------------------------------------------------
+	Find the NSTextView action for a key handler.
+	Args:		inHandler	handler symbol
+	Return:	its action, NULL if it must be sent to the editor
+------------------------------------------------------------------------------*/
+
+static SEL
+NativeAction(RefArg inHandler)
+{
+	if (!IsSymbol(inHandler)) {
+		return NULL;
+	}
+	const char * command = SymbolName(inHandler);
+	for (ArrayIndex i = 0; i < sizeof(kNativeCommands)/sizeof(kNativeCommands[0]); ++i) {
+		if (symcmp(command, kNativeCommands[i].command) == 0) {
+			return kNativeCommands[i].action;
+		}
+	}
+	return NULL;
+}
+
+
+/*------------------------------------------------------------------------------
+	Make the SetKeyHandler method each ntxView overrides protoEditor’s with:
+	it rebinds the key and bumps ntxKeyBindingsSeed so that every view’s
+	keymap is flushed.
+------------------------------------------------------------------------------*/
+
+extern Ref ParseString(RefArg inStr);
+
+static RefStruct * gSetKeyHandler = NULL;
+
+static Ref
+SetKeyHandlerMethod(void)
+{
+	if (gSetKeyHandler == NULL) {
+		RefVar codeBlock(ParseString(MakeStringFromCString(
+			"func(key, handler)\n"
+			"begin\n"
+			"	local result := inherited:SetKeyHandler(key, handler);\n"
+			"	DefGlobalVar('ntxKeyBindingsSeed, GetGlobalVar('ntxKeyBindingsSeed) + 1);\n"
+			"	result\n"
+			"end")));
+		gSetKeyHandler = new RefStruct(InterpretBlock(codeBlock, RA(NILREF)));
+	}
+	return *gSetKeyHandler;
+}
+
 
 /*------------------------------------------------------------------------------
 	N T X E d i t o r V i e w
@@ -38,9 +282,19 @@
 }
 
 - (void)initProtoEditor {
+	if (keymap == NULL) {
+		keymap = new CKeymap;
+	}
+	isCommandPending = false;
 	ntxView = AllocateFrame();
 	SetFrameSlot(ntxView, SYMA(_proto), GetGlobalVar(SYMA(protoEditor)));
 	SetFrameSlot(ntxView, SYMA(viewCObject), (Ref)self);
+	SetFrameSlot(ntxView, MakeSymbol("SetKeyHandler"), SetKeyHandlerMethod());
+}
+
+
+- (void)dealloc {
+	delete keymap;
 }
 
 
@@ -76,40 +330,51 @@ extern void REPExceptionNotify(Exception * inException);
 		return;
 	}
 
-	RefVar keyState(AllocateFrame());
-	RefVar keyCode;
-	if (str != nil && (ch = [str characterAtIndex:0], [[NSCharacterSet characterSetWithRange:NSMakeRange(0x21, 0x5E)] characterIsMember:ch])) {
-		keyCode = MAKECHAR(ch);
+	ULong key;
+	if (str.length > 0 && (ch = [str characterAtIndex:0]) >= 0x21 && ch <= 0x7E) {
+		key = kKeyIsChar | ch;
 	} else {
-		keyCode = MAKEINT(code);
-		if (modifiers & NSEventModifierFlagShift) {
-			SetFrameSlot(keyState, SYMA(shift), RA(TRUEREF));
-		}
+		key = code;
+		if (modifiers & NSEventModifierFlagShift)
+			key |= kKeyShift;
 	}
-
 	if (modifiers & NSEventModifierFlagControl)
-		SetFrameSlot(keyState, SYMA(control), RA(TRUEREF));
+		key |= kKeyControl;
 	if (modifiers & NSEventModifierFlagOption)
-		SetFrameSlot(keyState, SYMA(option), RA(TRUEREF));
+		key |= kKeyOption;
 	if (modifiers & NSEventModifierFlagCommand)
-		SetFrameSlot(keyState, SYMA(command), RA(TRUEREF));
-	if (Length(keyState) > 0) {
-		SetFrameSlot(keyState, SYMA(key), keyCode);
-		keyCode = keyState;
-	}
+		key |= kKeyCommand;
 
-	RefVar args(MakeArray(1));
-	SetArraySlot(args, 0, keyCode);
+	// if we already know how this key is handled we don’t need to ask
+	RefVar handler, args;
+	Ref knownHandler;
+	SEL action = NULL;
+	bool isKnown = gUseKeymap && !isCommandPending && keymap->lookup(key, &knownHandler, &action);
+	if (isKnown) {
+		handler = knownHandler;
+	} else {
+		args = MakeArray(1);
+		SetArraySlot(args, 0, KeySpec(key));
+	}
 
-	RefVar handler;
 	newton_try
 	{
-		handler = DoMessage(ntxView, SYMA(GetKeyHandler), args);
-		if (NOTNIL(handler)) {
+		if (!isKnown) {
+			handler = DoMessage(ntxView, SYMA(GetKeyHandler), args);
+			gKeymapStats.lookups++;
+			action = NativeAction(handler);
+			if (gUseKeymap && !isCommandPending) {
+				keymap->add(key, handler, action);
+			}
+			isCommandPending = false;
+		}
+		if (NOTNIL(handler) && action == NULL) {
 			NSRange selected = self.selectedRange;
 			args = MakeArray(2);
 			SetArraySlot(args, 0, MAKEINT(selected.location));
 			SetArraySlot(args, 1, MAKEINT(selected.length));
+			isCommandPending = true;
+			gKeymapStats.commands++;
 			DoMessage(ntxView, handler, args);						// need to dispatch this to the newt? task -- certainly not the idle task
 
 			[self scrollRangeToVisible:self.selectedRange];
@@ -121,11 +386,115 @@ extern void REPExceptionNotify(Exception * inException);
 	}
 	end_try;
 
-	if (ISNIL(handler)) {
+	if (action != NULL) {
+		// a standard binding -- NSTextView does it without any NewtonScript
+		gKeymapStats.actions++;
+		[self doCommandBySelector:action];
+	} else if (ISNIL(handler)) {
 		[self interpretKeyEvents: [NSArray arrayWithObject: inEvent]];
 	}
 }
 
+
+/*------------------------------------------------------------------------------
+	Benchmark key handling.
+	A keystroke script is text to be typed, with {name} for non-character
+	keys: {left} {right} {up} {down} {delete} {return} {tab} {home} {end}
+	{pageup} {pagedown}
+	The script is replayed through keyDown: of an offscreen view, with and
+	without the keymap.
+	Args:		inScript		keystroke script
+	Return:	{ keymap: {...}, noKeymap: {...} }
+------------------------------------------------------------------------------*/
+
+static ULong gKeyBenchmarkGCs;
+
+static void
+KeyBenchmarkGCProc(void * inRefCon)
+{
+	gKeyBenchmarkGCs++;
+}
+
+
+static NSEvent *
+KeyEvent(NSString * inChars, unsigned short inKeyCode)
+{
+	return [NSEvent keyEventWithType:NSEventTypeKeyDown location:NSZeroPoint modifierFlags:0 timestamp:0 windowNumber:0 context:nil
+							characters:inChars charactersIgnoringModifiers:inChars isARepeat:NO keyCode:inKeyCode];
+}
+
+
++ (NSArray<NSEvent *> *)keyEventsFor:(NSString *)inScript {
+	NSDictionary * keys = @{ @"left":@[[NSString stringWithFormat:@"%C", (unichar)NSLeftArrowFunctionKey], @123],
+											  @"right":@[[NSString stringWithFormat:@"%C", (unichar)NSRightArrowFunctionKey], @124],
+											  @"down":@[[NSString stringWithFormat:@"%C", (unichar)NSDownArrowFunctionKey], @125],
+											  @"up":@[[NSString stringWithFormat:@"%C", (unichar)NSUpArrowFunctionKey], @126],
+											  @"delete":@[@"\x7F", @51],
+											  @"return":@[@"\r", @36],
+											  @"tab":@[@"\t", @48],
+											  @"home":@[[NSString stringWithFormat:@"%C", (unichar)NSHomeFunctionKey], @115],
+											  @"end":@[[NSString stringWithFormat:@"%C", (unichar)NSEndFunctionKey], @119],
+											  @"pageup":@[[NSString stringWithFormat:@"%C", (unichar)NSPageUpFunctionKey], @116],
+											  @"pagedown":@[[NSString stringWithFormat:@"%C", (unichar)NSPageDownFunctionKey], @121] };
+	NSMutableArray * events = [[NSMutableArray alloc] init];
+	NSScanner * scanner = [NSScanner scannerWithString:inScript];
+	scanner.charactersToBeSkipped = nil;
+	while (!scanner.atEnd) {
+		NSString * text;
+		if ([scanner scanUpToString:@"{" intoString:&text]) {
+			for (NSUInteger i = 0; i < text.length; ++i) {
+				unichar ch = [text characterAtIndex:i];
+				if (ch == '\n')
+					[events addObject:KeyEvent(@"\r", 36)];
+				else if (ch == '\t')
+					[events addObject:KeyEvent(@"\t", 48)];
+				else
+					[events addObject:KeyEvent([NSString stringWithCharacters:&ch length:1], ch == ' ' ? 49 : 0)];
+			}
+		}
+		NSString * name;
+		if ([scanner scanString:@"{" intoString:NULL] && [scanner scanUpToString:@"}" intoString:&name] && [scanner scanString:@"}" intoString:NULL]) {
+			NSArray * key = keys[name.lowercaseString];
+			if (key) {
+				[events addObject:KeyEvent(key[0], [key[1] unsignedShortValue])];
+			}
+		}
+	}
+	return events;
+}
+
+
++ (NSDictionary *)benchmarkKeystrokes:(NSString *)inScript {
+	NSArray<NSEvent *> * events = [self keyEventsFor:inScript];
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+
+	NSMutableDictionary * results = [[NSMutableDictionary alloc] init];
+	GCRegister(&gKeyBenchmarkGCs, KeyBenchmarkGCProc);
+	for (int pass = 0; pass < 2; ++pass) {
+		gUseKeymap = (pass == 1);
+		NTXEditorView * view = [[NTXEditorView alloc] initWithFrame:NSMakeRect(0, 0, 640, 480)];
+
+		KeymapStats before = gKeymapStats;
+		gKeyBenchmarkGCs = 0;
+		uint64_t start = mach_absolute_time();
+		for (NSEvent * event in events) {
+			[view keyDown:event];
+		}
+		double elapsed = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+
+		results[gUseKeymap ? @"keymap" : @"noKeymap"] = @{ @"keys":[NSNumber numberWithUnsignedInteger:events.count],
+																		 @"usPerKey":@(events.count > 0 ? elapsed / 1000.0 / events.count : 0.0),
+																		 @"gcs":[NSNumber numberWithUnsignedInt:gKeyBenchmarkGCs],
+																		 @"getKeyHandlerMessages":[NSNumber numberWithUnsignedInt:gKeymapStats.lookups - before.lookups],
+																		 @"commandMessages":[NSNumber numberWithUnsignedInt:gKeymapStats.commands - before.commands],
+																		 @"textViewActions":[NSNumber numberWithUnsignedInt:gKeymapStats.actions - before.actions] };
+	}
+	GCUnregister(&gKeyBenchmarkGCs);
+	gUseKeymap = true;
+	return results;
+}
+
 @end
 
 
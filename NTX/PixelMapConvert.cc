@@ -0,0 +1,308 @@
+/*
+	File:		PixelMapConvert.cc
+
+	Contains:	Expansion of Newton PixelMap bits to 8-bit grayscale or RGBA.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#include "PixelMapConvert.h"
+#include <string.h>
+#include <vector>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define hasSSSE3 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define hasNEON 1
+#endif
+
+
+/* -----------------------------------------------------------------------------
+	E x p a n s i o n   t a b l e s
+	For each depth, the gray levels of the pixels in every possible source
+	byte. Level v of n-bit depth is 255 - v * 255 / (2^n - 1).
+----------------------------------------------------------------------------- */
+
+struct ExpansionTables
+{
+	uint8_t	level[9][256];			// level[depth][value]
+	uint8_t	expand1[256][8];
+	uint8_t	expand2[256][4];
+	uint8_t	expand4[256][2];
+
+	ExpansionTables();
+};
+
+
+ExpansionTables::ExpansionTables()
+{
+	for (unsigned depth = 1; depth <= 8; depth *= 2) {
+		unsigned maxValue = (1 << depth) - 1;
+		for (unsigned v = 0; v <= maxValue; ++v)
+			level[depth][v] = 255 - (v * 255) / maxValue;
+	}
+	for (unsigned byte = 0; byte < 256; ++byte) {
+		for (unsigned i = 0; i < 8; ++i)
+			expand1[byte][i] = level[1][(byte >> (7 - i)) & 0x01];
+		for (unsigned i = 0; i < 4; ++i)
+			expand2[byte][i] = level[2][(byte >> (6 - 2*i)) & 0x03];
+		for (unsigned i = 0; i < 2; ++i)
+			expand4[byte][i] = level[4][(byte >> (4 - 4*i)) & 0x0F];
+	}
+}
+
+
+static const ExpansionTables &
+Tables(void)
+{
+	static const ExpansionTables tables;
+	return tables;
+}
+
+
+#pragma mark SIMD
+/* -----------------------------------------------------------------------------
+	Expand 16 source bytes.
+	Each takes a 16-entry table of gray levels, indexed by pixel value.
+----------------------------------------------------------------------------- */
+#if hasSSSE3
+
+static inline void
+Expand16x1(const uint8_t * inSrc, uint8_t * outDst)
+{
+	const __m128i src = _mm_loadu_si128((const __m128i *)inSrc);
+	const __m128i bits = _mm_set_epi8(0x01,0x02,0x04,0x08,0x10,0x20,0x40,(char)0x80, 0x01,0x02,0x04,0x08,0x10,0x20,0x40,(char)0x80);
+	const __m128i zero = _mm_setzero_si128();
+	// replicate bytes i and i+1 eight times each
+	__m128i index = _mm_set_epi8(1,1,1,1,1,1,1,1, 0,0,0,0,0,0,0,0);
+	const __m128i step = _mm_set1_epi8(2);
+	for (int i = 0; i < 16; i += 2) {
+		__m128i spread = _mm_shuffle_epi8(src, index);
+		// then test each pixel’s bit: clear bit => white
+		_mm_storeu_si128((__m128i *)(outDst + 8*i), _mm_cmpeq_epi8(_mm_and_si128(spread, bits), zero));
+		index = _mm_add_epi8(index, step);
+	}
+}
+
+
+static inline void
+Expand16x2(const uint8_t * inSrc, uint8_t * outDst, const uint8_t * inLevels)
+{
+	const __m128i src = _mm_loadu_si128((const __m128i *)inSrc);
+	const __m128i lut = _mm_loadu_si128((const __m128i *)inLevels);
+	const __m128i mask = _mm_set1_epi8(0x03);
+	__m128i p0 = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(src, 6), mask));
+	__m128i p1 = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(src, 4), mask));
+	__m128i p2 = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(src, 2), mask));
+	__m128i p3 = _mm_shuffle_epi8(lut, _mm_and_si128(src, mask));
+	// interleave p0 p1 p2 p3 for each source byte
+	__m128i lo01 = _mm_unpacklo_epi8(p0, p1), hi01 = _mm_unpackhi_epi8(p0, p1);
+	__m128i lo23 = _mm_unpacklo_epi8(p2, p3), hi23 = _mm_unpackhi_epi8(p2, p3);
+	_mm_storeu_si128((__m128i *)(outDst +  0), _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(outDst + 16), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(outDst + 32), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *)(outDst + 48), _mm_unpackhi_epi16(hi01, hi23));
+}
+
+
+static inline void
+Expand16x4(const uint8_t * inSrc, uint8_t * outDst, const uint8_t * inLevels)
+{
+	const __m128i src = _mm_loadu_si128((const __m128i *)inSrc);
+	const __m128i lut = _mm_loadu_si128((const __m128i *)inLevels);
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	__m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(src, 4), mask));
+	__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(src, mask));
+	_mm_storeu_si128((__m128i *)(outDst +  0), _mm_unpacklo_epi8(hi, lo));
+	_mm_storeu_si128((__m128i *)(outDst + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+#elif hasNEON
+
+static inline void
+Expand16x1(const uint8_t * inSrc, uint8_t * outDst)
+{
+	static const uint8_t kBits[16] = { 0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01, 0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01 };
+	const uint8x16_t src = vld1q_u8(inSrc);
+	const uint8x16_t bits = vld1q_u8(kBits);
+	// replicate bytes i and i+1 eight times each
+	uint8x16_t index = vcombine_u8(vdup_n_u8(0), vdup_n_u8(1));
+	const uint8x16_t step = vdupq_n_u8(2);
+	for (int i = 0; i < 16; i += 2) {
+		uint8x16_t spread = vqtbl1q_u8(src, index);
+		// then test each pixel’s bit: clear bit => white
+		vst1q_u8(outDst + 8*i, vmvnq_u8(vtstq_u8(spread, bits)));
+		index = vaddq_u8(index, step);
+	}
+}
+
+
+static inline void
+Expand16x2(const uint8_t * inSrc, uint8_t * outDst, const uint8_t * inLevels)
+{
+	const uint8x16_t src = vld1q_u8(inSrc);
+	const uint8x16_t lut = vld1q_u8(inLevels);
+	const uint8x16_t mask = vdupq_n_u8(0x03);
+	uint8x16x4_t pixels;
+	pixels.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(src, 6));
+	pixels.val[1] = vqtbl1q_u8(lut, vandq_u8(vshrq_n_u8(src, 4), mask));
+	pixels.val[2] = vqtbl1q_u8(lut, vandq_u8(vshrq_n_u8(src, 2), mask));
+	pixels.val[3] = vqtbl1q_u8(lut, vandq_u8(src, mask));
+	// interleaving store
+	vst4q_u8(outDst, pixels);
+}
+
+
+static inline void
+Expand16x4(const uint8_t * inSrc, uint8_t * outDst, const uint8_t * inLevels)
+{
+	const uint8x16_t src = vld1q_u8(inSrc);
+	const uint8x16_t lut = vld1q_u8(inLevels);
+	uint8x16x2_t pixels;
+	pixels.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(src, 4));
+	pixels.val[1] = vqtbl1q_u8(lut, vandq_u8(src, vdupq_n_u8(0x0F)));
+	vst2q_u8(outDst, pixels);
+}
+
+#endif
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	Expand one row.
+	Whole runs of 16 source bytes go through the SIMD expanders; the rest,
+	and the final partial byte, through the tables.
+	Args:		inSrc			source row
+				inDepth		bits per pixel
+				inWidth		pixels
+				outDst		destination row
+	Return:	--
+----------------------------------------------------------------------------- */
+
+static void
+ExpandRow(const uint8_t * inSrc, unsigned inDepth, unsigned inWidth, uint8_t * outDst)
+{
+	const ExpansionTables & tables = Tables();
+	unsigned pixelsPerByte = 8 / inDepth;
+	unsigned numOfBytes = inWidth / pixelsPerByte;		// whole bytes
+	unsigned i = 0;
+
+#if hasSSSE3 || hasNEON
+	// gray levels for the shuffle lookup, padded to 16 entries
+	uint8_t levels[16] = { 0 };
+	if (inDepth == 2 || inDepth == 4)
+		memcpy(levels, tables.level[inDepth], 1 << inDepth);
+	if (inDepth < 8) {
+		for ( ; i + 16 <= numOfBytes; i += 16) {
+			uint8_t * dst = outDst + i * pixelsPerByte;
+			switch (inDepth) {
+			case 1:	Expand16x1(inSrc + i, dst); break;
+			case 2:	Expand16x2(inSrc + i, dst, levels); break;
+			case 4:	Expand16x4(inSrc + i, dst, levels); break;
+			}
+		}
+	}
+#endif
+
+	switch (inDepth) {
+	case 1:
+		for ( ; i < numOfBytes; ++i)
+			memcpy(outDst + 8*i, tables.expand1[inSrc[i]], 8);
+		break;
+	case 2:
+		for ( ; i < numOfBytes; ++i)
+			memcpy(outDst + 4*i, tables.expand2[inSrc[i]], 4);
+		break;
+	case 4:
+		for ( ; i < numOfBytes; ++i)
+			memcpy(outDst + 2*i, tables.expand4[inSrc[i]], 2);
+		break;
+	case 8:
+		for ( ; i < numOfBytes; ++i)
+			outDst[i] = tables.level[8][inSrc[i]];
+		break;
+	}
+
+	// last partial byte
+	unsigned remainder = inWidth - numOfBytes * pixelsPerByte;
+	if (remainder > 0) {
+		const uint8_t * pixels = (inDepth == 1) ? tables.expand1[inSrc[numOfBytes]]
+									  : (inDepth == 2) ? tables.expand2[inSrc[numOfBytes]]
+									  : tables.expand4[inSrc[numOfBytes]];
+		memcpy(outDst + numOfBytes * pixelsPerByte, pixels, remainder);
+	}
+}
+
+
+static inline bool
+IsValidPixelMap(size_t inRowBytes, unsigned inDepth, unsigned inWidth)
+{
+	return (inDepth == 1 || inDepth == 2 || inDepth == 4 || inDepth == 8)
+		 && inRowBytes >= ((size_t)inWidth * inDepth + 7) / 8;
+}
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	Expand bits to 8-bit gray.
+----------------------------------------------------------------------------- */
+
+bool
+ExpandPixelMapToGray(const uint8_t * inBits, size_t inRowBytes, unsigned inDepth,
+							unsigned inWidth, unsigned inHeight,
+							uint8_t * outGray, size_t inGrayRowBytes)
+{
+	if (!IsValidPixelMap(inRowBytes, inDepth, inWidth) || inGrayRowBytes < inWidth)
+		return false;
+	for (unsigned row = 0; row < inHeight; ++row) {
+		ExpandRow(inBits, inDepth, inWidth, outGray);
+		inBits += inRowBytes;
+		outGray += inGrayRowBytes;
+	}
+	return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Expand bits to premultiplied RGBA.
+	Each row is expanded to gray, as is the mask, then widened; with only
+	fully opaque or fully transparent pixels, premultiplying is just masking.
+----------------------------------------------------------------------------- */
+
+bool
+ExpandPixelMapToRGBA(const uint8_t * inBits, size_t inRowBytes, unsigned inDepth,
+							const uint8_t * inMask, size_t inMaskRowBytes,
+							unsigned inWidth, unsigned inHeight,
+							uint8_t * outRGBA, size_t inRGBARowBytes)
+{
+	if (!IsValidPixelMap(inRowBytes, inDepth, inWidth) || inRGBARowBytes < 4 * (size_t)inWidth
+	||  (inMask && !IsValidPixelMap(inMaskRowBytes, 1, inWidth)))
+		return false;
+
+	std::vector<uint8_t> gray(inWidth);
+	std::vector<uint8_t> alpha(inWidth, 0xFF);
+	for (unsigned row = 0; row < inHeight; ++row) {
+		ExpandRow(inBits, inDepth, inWidth, gray.data());
+		if (inMask) {
+			// mask bit set => black => opaque
+			ExpandRow(inMask, 1, inWidth, alpha.data());
+			for (unsigned x = 0; x < inWidth; ++x)
+				alpha[x] = ~alpha[x];
+			inMask += inMaskRowBytes;
+		}
+		uint8_t * dst = outRGBA;
+		for (unsigned x = 0; x < inWidth; ++x) {
+			uint8_t g = gray[x] & alpha[x];
+			dst[0] = g;
+			dst[1] = g;
+			dst[2] = g;
+			dst[3] = alpha[x];
+			dst += 4;
+		}
+		inBits += inRowBytes;
+		outRGBA += inRGBARowBytes;
+	}
+	return true;
+}
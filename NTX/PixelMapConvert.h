@@ -0,0 +1,57 @@
+/*
+	File:		PixelMapConvert.h
+
+	Contains:	Expansion of Newton PixelMap bits to 8-bit grayscale or RGBA.
+					Screenshots and icons are 1, 2 or 4 bits per pixel (8 on some
+					hardware), packed most significant pixel first, with 0 = white.
+					Rather than draw them pixel by pixel into a graphics context, we
+					expand whole rows into a buffer that can be handed to CoreGraphics
+					as an image.
+					Every source byte expands to the same number of pixels, so rows are
+					expanded by table lookup; where SSSE3 or NEON is available the
+					lookup is done sixteen source bytes at a time by byte shuffle.
+					This is plain C++ with no dependency on the NewtonScript world or on
+					CoreGraphics.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__PIXELMAPCONVERT_H)
+#define __PIXELMAPCONVERT_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* -----------------------------------------------------------------------------
+	Expand bits to 8-bit gray, 0 = black.
+	Args:		inBits			first row of source bits
+				inRowBytes		source row stride; may be more than the width needs
+				inDepth			bits per pixel: 1, 2, 4 or 8
+				inWidth			pixels per row
+				inHeight			rows
+				outGray			first row of destination
+				inGrayRowBytes	destination row stride, at least inWidth
+	Return:	false => unsupported depth, or rows too short for the width
+----------------------------------------------------------------------------- */
+
+extern bool	ExpandPixelMapToGray(const uint8_t * inBits, size_t inRowBytes, unsigned inDepth,
+										unsigned inWidth, unsigned inHeight,
+										uint8_t * outGray, size_t inGrayRowBytes);
+
+/* -----------------------------------------------------------------------------
+	Expand bits to premultiplied RGBA, 8 bits per component, in that byte
+	order.
+	Args:		as above, plus
+				inMask			first row of 1-bit mask, 1 = opaque; NULL => all opaque
+				inMaskRowBytes	mask row stride
+				outRGBA			first row of destination
+				inRGBARowBytes	destination row stride, at least 4 * inWidth
+	Return:	false => unsupported depth, or rows too short for the width
+----------------------------------------------------------------------------- */
+
+extern bool	ExpandPixelMapToRGBA(const uint8_t * inBits, size_t inRowBytes, unsigned inDepth,
+										const uint8_t * inMask, size_t inMaskRowBytes,
+										unsigned inWidth, unsigned inHeight,
+										uint8_t * outRGBA, size_t inRGBARowBytes);
+
+#endif	/* __PIXELMAPCONVERT_H */
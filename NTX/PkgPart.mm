@@ -13,6 +13,58 @@ extern void		DrawBitmap(RefArg inBitmap, const Rect * inRect, int inTransferMode
 #define kMinutesSince1904   34714080
 
 
+/*------------------------------------------------------------------------------
+	Locate the pixels in a bitmap’s bits binary.
+	The binary is a 16-byte big-endian header -- baseAddr, rowBytes, reserved,
+	bounds -- followed by rows of 1-bit pixels.
+	Args:		inBits			bits binary
+				inBounds			bitmap bounds
+				outBits			first row of pixels
+				outRowBytes		row stride
+	Return:	false => the binary isn’t what we expect
+------------------------------------------------------------------------------*/
+
+static bool
+GetPixelMapBits(RefArg inBits, const Rect * inBounds, const uint8_t ** outBits, size_t * outRowBytes)
+{
+	if (!IsBinary(inBits))
+		return false;
+	ArrayIndex length = Length(inBits);
+	if (length < 16)
+		return false;
+	const uint8_t * p = (const uint8_t *)BinaryData(inBits);
+	size_t rowBytes = ((p[4] << 8) | p[5]) & 0x3FFF;
+	int height = inBounds->bottom - inBounds->top;
+	int width = inBounds->right - inBounds->left;
+	if (width <= 0 || height <= 0 || rowBytes * 8 < (size_t)width || 16 + rowBytes * height > length)
+		return false;
+	*outBits = p + 16;
+	*outRowBytes = rowBytes;
+	return true;
+}
+
+
+/*------------------------------------------------------------------------------
+	Make an image from a bitmap frame’s bits, and mask if it has one.
+	Args:		inBitmap		bitmap frame
+				inBounds		its bounds
+	Return:	an NSImage; nil => draw it instead
+------------------------------------------------------------------------------*/
+
+static NSImage *
+MakeImageFromBitmap(RefArg inBitmap, const Rect * inBounds)
+{
+	const uint8_t * bits, * mask = NULL;
+	size_t rowBytes, maskRowBytes = 0;
+	if (!GetPixelMapBits(GetFrameSlot(inBitmap, MakeSymbol("bits")), inBounds, &bits, &rowBytes))
+		return nil;
+	RefVar maskBits(GetFrameSlot(inBitmap, MakeSymbol("mask")));
+	if (NOTNIL(maskBits) && !GetPixelMapBits(maskBits, inBounds, &mask, &maskRowBytes))
+		return nil;
+	return MakeImageFromPixelMap(bits, rowBytes, 1, mask, maskRowBytes, inBounds->right - inBounds->left, inBounds->bottom - inBounds->top);
+}
+
+
 /*------------------------------------------------------------------------------
 	P k g P a r t
 ------------------------------------------------------------------------------*/
@@ -61,13 +113,16 @@ extern void		DrawBitmap(RefArg inBitmap, const Rect * inRect, int inTransferMode
 			Rect boundsRect;
 			FromObject(GetFrameSlot(icon, MakeSymbol("bounds")), &boundsRect);
 
-			_iconImage = [[NSImage alloc] initWithSize: NSMakeSize(boundsRect.right,  boundsRect.bottom)];
-			[_iconImage lockFocus];
+			_iconImage = MakeImageFromBitmap(icon, &boundsRect);
+			if (_iconImage == nil) {
+				_iconImage = [[NSImage alloc] initWithSize: NSMakeSize(boundsRect.right,  boundsRect.bottom)];
+				[_iconImage lockFocus];
 	 
-			InitDrawing((CGContextRef)NSGraphicsContext.currentContext.graphicsPort, boundsRect.bottom);
-			DrawBitmap(icon, &boundsRect, 0/*modeCopy*/);
+				InitDrawing((CGContextRef)NSGraphicsContext.currentContext.graphicsPort, boundsRect.bottom);
+				DrawBitmap(icon, &boundsRect, 0/*modeCopy*/);
 	 
-			[_iconImage unlockFocus];
+				[_iconImage unlockFocus];
+			}
 		}
 	}
 	return _iconImage;
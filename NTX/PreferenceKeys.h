@@ -14,6 +14,8 @@
 
 // Debug
 #define kLogToFilePref			@"LogToFile"
+#define kMockNewtonPref			@"MockNewton"		// Debug builds only
+#define kTraceCapturePref		@"TraceCapture"
 
 
 // Not preference keys:
@@ -19,6 +19,7 @@
 #import "PackagePart.h"
 #import "ProjectWindowController.h"
 #import "Utilities.h"
+#import "MappedFilePipe.h"
 #import "NTXDocument.h"
 #import "NTK/ObjectHeap.h"
 #import "NTK/Globals.h"
@@ -151,8 +152,7 @@ NSString * const NTXPackageFileType = @"com.newton.package";
 	if (self = [super init]) {
 	//	stream in default project settings
 		NSURL * url = [NSBundle.mainBundle URLForResource: @"CanonicalProject" withExtension: @"newtonstream"];
-		CStdIOPipe pipe(url.fileSystemRepresentation, "r");
-		_projectRef = UnflattenRef(pipe);
+		_projectRef = UnflattenFile(url.fileSystemRepresentation);
 	}
 	return self;
 }
@@ -301,8 +301,7 @@ NSString * const NTXPackageFileType = @"com.newton.package";
 			// the file appears to be a Mac NTK project
 			_projectRef = data.projectRef;
 		} else {
-			CStdIOPipe pipe(url.fileSystemRepresentation, "r");
-			_projectRef = UnflattenRef(pipe);
+			_projectRef = UnflattenFile(url.fileSystemRepresentation);
 		}
 
 		[self buildSourceList:url];
@@ -510,10 +509,9 @@ NSString * const NTXPackageFileType = @"com.newton.package";
 	else
 	{
 		// save settings and source list
-		CStdIOPipe pipe(url.fileSystemRepresentation, "w");
 		newton_try
 		{
-			FlattenRef(_projectRef, pipe);
+			FlattenToFile(_projectRef, url.fileSystemRepresentation, true);
 		}
 		newton_catch_all
 		{
@@ -802,8 +800,7 @@ extern Ref ForwardReference(Ref r);
 				RefVar result(GetGlobalVar(FIntern(RA(NILREF), resultSlot)));
 				// flatten to stream file
 				NSURL * streamURL = [self.fileURL.URLByDeletingPathExtension URLByAppendingPathExtension:@"newtonstream"];
-				CStdIOPipe pipe(streamURL.fileSystemRepresentation, "w");
-				FlattenRef(result, pipe);
+				FlattenToFile(result, streamURL.fileSystemRepresentation);
 				[self report:@"Build successful"];
 			}
 			break;
@@ -327,15 +327,24 @@ static void *ProgressObserverContext = &ProgressObserverContext;
 			int shotWidth = RVALUE(GetFrameSlot(inData, SYMA(right))) - RVALUE(GetFrameSlot(inData, SYMA(left)));
 			NSSize shotSize = NSMakeSize(shotWidth, shotHeight);
 
+			RefVar theBits(GetFrameSlot(inData, MakeSymbol("theBits")));
+			unsigned rowBytes = RINT(GetFrameSlot(inData, MakeSymbol("rowBytes")));
+			unsigned depth = RINT(GetFrameSlot(inData, MakeSymbol("depth")));
+
+		// expand PixelMap into an image
+			if (shotHeight > 0 && Length(theBits) >= rowBytes * shotHeight)
+				theImage = MakeImageFromPixelMap(BinaryData(theBits), rowBytes, depth, NULL, 0, shotWidth, shotHeight);
+
+			if (theImage == nil) {
 		// render PixelMap into NSImage
-			theImage = [[NSImage alloc] initWithSize:shotSize];
-			[theImage lockFocus];
+				theImage = [[NSImage alloc] initWithSize:shotSize];
+				[theImage lockFocus];
 
-			InitDrawing((CGContextRef) NSGraphicsContext.currentContext.graphicsPort, shotHeight);
-			DrawBits(BinaryData(GetFrameSlot(inData, MakeSymbol("theBits"))), shotHeight, shotWidth,
-						RINT(GetFrameSlot(inData, MakeSymbol("rowBytes"))), RINT(GetFrameSlot(inData, MakeSymbol("depth"))));
+				InitDrawing((CGContextRef) NSGraphicsContext.currentContext.graphicsPort, shotHeight);
+				DrawBits(BinaryData(theBits), shotHeight, shotWidth, rowBytes, depth);
 
-			[theImage unlockFocus];
+				[theImage unlockFocus];
+			}
 		}
 	}
 	newton_catch_all
@@ -0,0 +1,37 @@
+/*
+	File:		ProtoRegistry.h
+
+	Contains:	Registry of user protos built so far in a project build.
+					A layout template refers to its user proto by the FSSpec (or alias)
+					of the proto’s layout file, so we map file name -> proto.
+					Names are held as precomposed NSStrings -- the FSSpec name is
+					MacRoman, the file URL is whatever the file system gives us -- and
+					looked up in a hash table, so resolving a proto costs the same
+					however many protos the project has.
+					One registry lives for one build, and is shared by every layout
+					in it; NewtonScript is single-threaded, and so is this.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <Foundation/Foundation.h>
+#import "NewtonKit.h"
+
+extern NSString * FilenameFromFSSpec(const void * inFSpec, ArrayIndex inLen);
+
+
+/* -----------------------------------------------------------------------------
+	N T X P r o t o R e g i s t r y
+----------------------------------------------------------------------------- */
+
+@interface NTXProtoRegistry : NSObject
+
+@property(nonatomic,readonly) NSUInteger count;
+
+- (void)addObject:(RefArg)inObj for:(NSURL *)inURL;
+- (Ref)objectFor:(RefArg)inFSpec;
+
+// time resolution of 10 .. 10,000 protos; run by NTXBenchmarks
++ (NSDictionary *)benchmark;
+
+@end
@@ -0,0 +1,174 @@
+/*
+	File:		ProtoRegistry.mm
+
+	Contains:	Registry of user protos built so far in a project build.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "ProtoRegistry.h"
+#import "MacRsrcTypes.h"
+
+#include <mach/mach_time.h>
+
+#define kBenchmarkLookups	100000
+
+
+/* -----------------------------------------------------------------------------
+	Return the file name in an FSSpec or alias.
+	Args:		inFSpec		FSSpecX or FSAliasX
+				inLen			its size
+	Return:	the name; nil if it doesn’t fit the record
+----------------------------------------------------------------------------- */
+
+NSString *
+FilenameFromFSSpec(const void * inFSpec, ArrayIndex inLen)
+{
+	const uint8_t * filename;
+	if (inLen == sizeof(FSSpecX)) {
+		// we have a filespec
+		const FSSpecX * fsspec = (const FSSpecX *)inFSpec;
+		filename = &fsspec->name[0];
+	} else {
+		// this is an alias
+		const FSAliasX * alias = (const FSAliasX *)inFSpec;
+		filename = (const uint8_t *)&alias->fileName[0];
+	}
+	// pascal string -> NSString
+	if (filename + 1 + filename[0] > (const uint8_t *)inFSpec + inLen)
+		return nil;
+	return [[NSString alloc] initWithBytes:filename+1 length:filename[0] encoding:NSMacOSRomanStringEncoding];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Names from FSSpecs and names from the file system may differ in their
+	unicode normalization, so compare them precomposed.
+----------------------------------------------------------------------------- */
+
+static inline NSString *
+ProtoKey(NSString * inName)
+{
+	return inName.precomposedStringWithCanonicalMapping;
+}
+
+
+/* -----------------------------------------------------------------------------
+	N T X P r o t o R e g i s t r y
+----------------------------------------------------------------------------- */
+
+@implementation NTXProtoRegistry
+{
+	// protos in the order they were built; the GC needs to see them
+	RefStruct protos;
+	// file name -> index in protos
+	NSMutableDictionary<NSString *, NSNumber *> * index;
+}
+
+
+- (id)init {
+	if (self = [super init]) {
+		protos = MakeArray(0);
+		index = [[NSMutableDictionary alloc] init];
+	}
+	return self;
+}
+
+
+- (NSUInteger)count {
+	return index.count;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Register a built proto.
+	If two files have the same name, the first one built wins -- as it always
+	has.
+	Args:		inObj			the proto
+				inURL			URL of the layout file it was built from
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)addObject:(RefArg)inObj for:(NSURL *)inURL {
+	NSString * key = ProtoKey(inURL.lastPathComponent);
+	if (index[key] == nil) {
+		index[key] = [NSNumber numberWithUnsignedInteger:Length(protos)];
+		AddArraySlot(protos, inObj);
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Resolve a user proto.
+	Args:		inFSpec		FSSpec or alias of its layout file
+	Return:	the proto; nil if it hasn’t been built
+----------------------------------------------------------------------------- */
+
+- (Ref)objectFor:(RefArg)inFSpec {
+	NSString * filename = FilenameFromFSSpec(BinaryData(inFSpec), Length(inFSpec));
+	NSNumber * protoIndex = filename ? index[ProtoKey(filename)] : nil;
+	if (protoIndex == nil) {
+		printf("USER PROTO NOT FOUND!");
+		return NILREF;
+	}
+	return GetArraySlot(protos, protoIndex.unsignedIntegerValue);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Benchmark resolution with registries of 10 to 10,000 protos.
+	Each registry resolves the same number of FSSpecs, so the time per lookup
+	should not grow with the number of protos.
+	Return:	{ "<n>": { lookupNs:, resolveAllMs: }, ... }
+----------------------------------------------------------------------------- */
+
++ (NSDictionary *)benchmark {
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	double toNanoseconds = (double)timebase.numer / timebase.denom;
+
+	NSMutableDictionary * results = [[NSMutableDictionary alloc] init];
+	for (ArrayIndex numOfProtos = 10; numOfProtos <= 10000; numOfProtos *= 10) {
+		NTXProtoRegistry * registry = [[NTXProtoRegistry alloc] init];
+		RefVar specs(MakeArray(numOfProtos));
+		for (ArrayIndex i = 0; i < numOfProtos; ++i) {
+			NSString * name = [NSString stringWithFormat:@"Proto Layout %u", (unsigned int)i];
+			RefVar proto(MAKEINT(i));
+			[registry addObject:proto for:[NSURL fileURLWithPath:[@"/tmp" stringByAppendingPathComponent:name]]];
+
+			RefVar spec(AllocateBinary(MakeSymbol("fileSpec"), sizeof(FSSpecX)));
+			FSSpecX * fsspec = (FSSpecX *)BinaryData(spec);
+			memset(fsspec, 0, sizeof(FSSpecX));
+			NSUInteger nameLen = 0;
+			[name getBytes:&fsspec->name[1] maxLength:63 usedLength:&nameLen encoding:NSMacOSRomanStringEncoding options:0 range:NSMakeRange(0, name.length) remainingRange:NULL];
+			fsspec->name[0] = (uint8_t)nameLen;
+			SetArraySlot(specs, i, spec);
+		}
+
+		// resolve every proto once, as a build does
+		RefVar spec;
+		uint64_t start = mach_absolute_time();
+		for (ArrayIndex i = 0; i < numOfProtos; ++i) {
+			spec = GetArraySlot(specs, i);
+			[registry objectFor:spec];
+		}
+		double resolveAllTime = (mach_absolute_time() - start) * toNanoseconds;
+
+		// and the same number of lookups whatever the size of registry
+		start = mach_absolute_time();
+		for (ArrayIndex i = 0; i < kBenchmarkLookups; ++i) {
+			spec = GetArraySlot(specs, i % numOfProtos);
+			if (RINT([registry objectFor:spec]) != (i % numOfProtos)) {
+				NSLog(@"+[NTXProtoRegistry benchmark] proto %u resolved wrongly", (unsigned int)(i % numOfProtos));
+				break;
+			}
+		}
+		double lookupTime = (mach_absolute_time() - start) * toNanoseconds;
+
+		results[[NSString stringWithFormat:@"%u", (unsigned int)numOfProtos]] = @{ @"resolveAllMs":@(resolveAllTime / 1e6),
+																											@"lookupNs":@(lookupTime / kBenchmarkLookups) };
+	}
+	return results;
+}
+
+@end
@@ -0,0 +1,63 @@
+/*
+	File:		SlotCache.h
+
+	Contains:	Inline caching of frame slot lookups.
+					Frames cloned from the same template share an immutable map, so
+					once we know where a tag lives in that map we can go straight to
+					the slot next time instead of walking the map (and supermap chain).
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__SLOTCACHE_H)
+#define __SLOTCACHE_H 1
+
+#include "NewtonKit.h"
+
+/* -----------------------------------------------------------------------------
+	S l o t C a c h e S t a t s
+	Hit/miss counters, shared by all accessors.
+	uncacheable counts lookups in frames whose map is not shared (and may
+	therefore change under us) -- those always go through GetFrameSlot().
+----------------------------------------------------------------------------- */
+
+struct SlotCacheStats
+{
+	ULong		hits;
+	ULong		misses;
+	ULong		uncacheable;
+	ULong		flushes;
+};
+
+extern SlotCacheStats	gSlotCacheStats;
+
+
+/* -----------------------------------------------------------------------------
+	C S l o t A c c e s s o r
+	A monomorphic inline cache for a single slot tag: remembers the last map
+	seen and the index of the tag within it.
+	Declare one as a function-local static at a hot access site, eg
+		static CSlotAccessor valueSlot(SYMA(value));
+		RefVar value(valueSlot.get(frame));
+----------------------------------------------------------------------------- */
+
+class CSlotAccessor
+{
+public:
+					CSlotAccessor(RefArg inTag);
+
+	Ref			get(RefArg inFrame);
+	void			set(RefArg inFrame, RefArg inValue);
+	bool			has(RefArg inFrame);
+
+private:
+	bool			lookup(Ref inFrame, ArrayIndex * outIndex);
+
+	RefStruct	fTag;
+	Ref			fMap;
+	ArrayIndex	fIndex;
+	ULong			fEpoch;
+};
+
+
+#endif	/* __SLOTCACHE_H */
@@ -0,0 +1,215 @@
+/*
+	File:		SlotCache.mm
+
+	Contains:	Inline caching of frame slot lookups.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "SlotCache.h"
+#import "NTK/ObjHeader.h"
+
+SlotCacheStats	gSlotCacheStats;
+
+
+/* -----------------------------------------------------------------------------
+	Cached indexes are only valid until the next GC -- compaction moves maps,
+	so a map Ref we remember could later be the address of some other map.
+	Rather than track every cache entry we bump an epoch on GC; any entry
+	tagged with an older epoch is treated as a miss.
+----------------------------------------------------------------------------- */
+
+static ULong	gSlotCacheEpoch = 1;
+static bool		gSlotCacheRegistered = false;
+
+static void
+SlotCacheGCProc(void * inRefCon)
+{
+	gSlotCacheEpoch++;
+	gSlotCacheStats.flushes++;
+}
+
+static inline void
+RegisterSlotCache(void)
+{
+	if (!gSlotCacheRegistered) {
+		GCRegister(&gSlotCacheEpoch, SlotCacheGCProc);
+		gSlotCacheRegistered = true;
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the frame map of a frame whose map is shared (and therefore
+	immutable -- adding or removing a slot gives the frame a new map).
+	Args:		inFrame		a Ref
+	Return:	the map Ref, or INVALIDPTRREF if the frame can’t be cached
+----------------------------------------------------------------------------- */
+
+static inline Ref
+SharedMap(Ref inFrame)
+{
+	if (ISREALPTR(inFrame)) {
+		FrameObject * frPtr = (FrameObject *)ObjectPtr(inFrame);
+		if (ISFRAME(frPtr)) {
+			Ref map = frPtr->map;
+			FrameMapObject * mapPtr = (FrameMapObject *)ObjectPtr(map);
+			if (ISSHARED(mapPtr))
+				return map;
+		}
+	}
+	return INVALIDPTRREF;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Compare slot tags. Symbols are usually unique, but package symbols may not
+	be the same object as their RAM equivalent.
+----------------------------------------------------------------------------- */
+
+static inline bool
+TagsEqual(Ref inTag, Ref inMapTag)
+{
+	if (inTag == inMapTag)
+		return true;
+	if (ISREALPTR(inTag) && ISREALPTR(inMapTag)) {
+		SymbolObject * sym1 = (SymbolObject *)ObjectPtr(inTag);
+		SymbolObject * sym2 = (SymbolObject *)ObjectPtr(inMapTag);
+		return sym1->objClass == kSymbolClass && sym2->objClass == kSymbolClass
+			 && sym1->hash == sym2->hash
+			 && SymbolCompareLexRef(inTag, inMapTag) == 0;
+	}
+	return false;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find the frame slot index of a tag by walking the map and its supermaps.
+	Slots of a supermap precede those of the map that refers to it.
+	Args:		inMap			frame map
+				inTag			slot tag
+				ioIndex		number of slots in supermaps already passed
+	Return:	true => found, *ioIndex is the slot index
+----------------------------------------------------------------------------- */
+
+static bool
+FindSlotIndex(Ref inMap, Ref inTag, ArrayIndex * ioIndex)
+{
+	FrameMapObject * mapPtr = (FrameMapObject *)ObjectPtr(inMap);
+	if (NOTNIL(mapPtr->supermap)) {
+		if (FindSlotIndex(mapPtr->supermap, inTag, ioIndex))
+			return true;
+		mapPtr = (FrameMapObject *)ObjectPtr(inMap);
+	}
+	ArrayIndex numOfTags = (mapPtr->size - SIZEOF_FRAMEMAPOBJECT(0)) / sizeof(Ref);
+	for (ArrayIndex i = 0; i < numOfTags; ++i) {
+		if (TagsEqual(inTag, mapPtr->slot[i])) {
+			*ioIndex += i;
+			return true;
+		}
+	}
+	*ioIndex += numOfTags;
+	return false;
+}
+
+
+static inline ArrayIndex
+LookupSlotIndex(Ref inMap, Ref inTag)
+{
+	ArrayIndex index = 0;
+	return FindSlotIndex(inMap, inTag, &index) ? index : kIndexNotFound;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Direct slot access, once we have a valid index.
+----------------------------------------------------------------------------- */
+
+static inline Ref
+SlotAt(Ref inFrame, ArrayIndex index)
+{
+	return ((FrameObject *)ObjectPtr(inFrame))->slot[index];
+}
+
+static inline bool
+SetSlotAt(Ref inFrame, ArrayIndex index, Ref inValue)
+{
+	FrameObject * frPtr = (FrameObject *)ObjectPtr(inFrame);
+	if (ISREADONLY(frPtr))
+		return false;		// let SetFrameSlot() throw
+	frPtr->slot[index] = inValue;
+	frPtr->flags |= kObjDirty;
+	return true;
+}
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	C S l o t A c c e s s o r
+----------------------------------------------------------------------------- */
+
+CSlotAccessor::CSlotAccessor(RefArg inTag)
+	:	fTag(inTag), fMap(INVALIDPTRREF), fIndex(kIndexNotFound), fEpoch(0)
+{
+	RegisterSlotCache();
+}
+
+
+/* -----------------------------------------------------------------------------
+	Look up our tag in a frame.
+	Args:		inFrame		the frame
+				outIndex		slot index, or kIndexNotFound if the frame has no such slot
+	Return:	true => the frame is cacheable and *outIndex is valid
+----------------------------------------------------------------------------- */
+
+bool
+CSlotAccessor::lookup(Ref inFrame, ArrayIndex * outIndex)
+{
+	Ref map = SharedMap(inFrame);
+	if (map == INVALIDPTRREF) {
+		gSlotCacheStats.uncacheable++;
+		return false;
+	}
+	if (map == fMap && fEpoch == gSlotCacheEpoch) {
+		gSlotCacheStats.hits++;
+	} else {
+		gSlotCacheStats.misses++;
+		fMap = map;
+		fIndex = LookupSlotIndex(map, fTag);
+		fEpoch = gSlotCacheEpoch;
+	}
+	*outIndex = fIndex;
+	return true;
+}
+
+
+Ref
+CSlotAccessor::get(RefArg inFrame)
+{
+	ArrayIndex index;
+	if (lookup(inFrame, &index))
+		return index == kIndexNotFound ? NILREF : SlotAt(inFrame, index);
+	return GetFrameSlot(inFrame, fTag);
+}
+
+
+void
+CSlotAccessor::set(RefArg inFrame, RefArg inValue)
+{
+	ArrayIndex index;
+	if (lookup(inFrame, &index) && index != kIndexNotFound && SetSlotAt(inFrame, index, inValue))
+		return;
+	// adding a slot changes the frame’s map, so there’s nothing to cache
+	SetFrameSlot(inFrame, fTag, inValue);
+}
+
+
+bool
+CSlotAccessor::has(RefArg inFrame)
+{
+	ArrayIndex index;
+	if (lookup(inFrame, &index))
+		return index != kIndexNotFound;
+	return FrameHasSlot(inFrame, fTag);
+}
+
@@ -0,0 +1,109 @@
+/*
+	File:		SlotIterator.h
+
+	Contains:	Array and frame slot iterator that doesn’t allocate.
+					The framework’s FOREACH macros new a CObjectIterator -- with four
+					RefStructs and an exception cleanup record -- for every loop.
+					CSlotIterator lives on the stack and reads the object’s slots
+					(and its frame map’s tags) directly.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__SLOTITERATOR_H)
+#define __SLOTITERATOR_H 1
+
+#include <NTK/Objects.h>
+#include <NTK/Iterators.h>
+
+/* -----------------------------------------------------------------------------
+	C S l o t I t e r a t o r
+	Slot and tag pointers are re-derived on every access, so the object may
+	safely move if the loop body allocates (and so triggers GC) -- the object
+	itself is held in a RefVar. The number of slots is fixed when iteration
+	starts, as it is for CObjectIterator.
+
+	Use it like CObjectIterator:
+		for (CSlotIterator iter(obj); !iter.done(); iter.next())
+			DoSomething(iter.tag(), iter.value());
+	or with range-for:
+		for (CSlotIterator::Slot slot : CSlotIterator(obj))
+			DoSomething(slot.tag(), slot.value());
+	Ref values must be held in a RefVar if the loop body can allocate.
+----------------------------------------------------------------------------- */
+
+class CSlotIterator
+{
+public:
+				CSlotIterator(RefArg inObj);
+
+	bool		done(void) const;
+	void		next(void);
+	Ref		tag(void) const;
+	Ref		value(void) const;
+	ArrayIndex	index(void) const;
+
+	// range-for support; the end sentinel has no iterator
+	class Slot
+	{
+	public:
+					Slot(const CSlotIterator * inIter) : fIter(inIter) { }
+		Ref		tag(void) const { return fIter->tag(); }
+		Ref		value(void) const { return fIter->value(); }
+		bool		atEnd(void) const { return fIter == NULL || fIter->done(); }
+		bool		operator!=(const Slot & inSlot) const { return atEnd() != inSlot.atEnd(); }
+		Slot &	operator++(void) { const_cast<CSlotIterator *>(fIter)->next(); return *this; }
+		const Slot &	operator*(void) const { return *this; }
+	private:
+		const CSlotIterator * fIter;
+	};
+	Slot		begin(void) const { return Slot(this); }
+	Slot		end(void) const { return Slot(NULL); }
+
+private:
+	RefVar		fObj;
+	ArrayIndex	fIndex;
+	ArrayIndex	fLength;
+	bool			fIsFrame;
+};
+
+inline bool			CSlotIterator::done(void) const { return fIndex >= fLength; }
+inline void			CSlotIterator::next(void) { fIndex++; }
+inline ArrayIndex	CSlotIterator::index(void) const { return fIndex; }
+
+
+/* -----------------------------------------------------------------------------
+	The legacy FOREACH macros, reimplemented over CSlotIterator.
+	Usage is unchanged but the semantics differ from the framework’s macros:
+	-	there is no unwind_protect around the body. An exception thrown from
+		the body propagates straight to the enclosing handler; there is no
+		iterator to delete, so nothing is skipped.
+	-	continue moves on to the next slot. The framework’s loop advanced at
+		END_FOREACH, so continue there repeated the same slot forever.
+	-	return and break leave the loop cleanly. The framework’s loop left its
+		iterator and exception handler behind on return.
+----------------------------------------------------------------------------- */
+
+#undef FOREACH
+#undef FOREACH_WITH_TAG
+#undef END_FOREACH
+
+#define FOREACH(obj, value_var) \
+	{ \
+		RefVar value_var; \
+		for (CSlotIterator _iter(obj); !_iter.done(); _iter.next()) { \
+			value_var = _iter.value();
+
+#define FOREACH_WITH_TAG(obj, tag_var, value_var) \
+	{ \
+		RefVar tag_var; \
+		RefVar value_var; \
+		for (CSlotIterator _iter(obj); !_iter.done(); _iter.next()) { \
+			tag_var = _iter.tag(); \
+			value_var = _iter.value();
+
+#define END_FOREACH \
+		} \
+	}
+
+#endif	/* __SLOTITERATOR_H */
@@ -0,0 +1,84 @@
+/*
+	File:		SlotIterator.mm
+
+	Contains:	Array and frame slot iterator that doesn’t allocate.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "NewtonKit.h"
+#import "NTK/ObjHeader.h"
+
+
+/* -----------------------------------------------------------------------------
+	Return the tag at a slot index of a frame map.
+	Slots of a supermap precede those of the map that refers to it.
+	Args:		inMap			frame map
+				ioIndex		slot index; on return, less the number of slots passed
+	Return:	tag, or INVALIDPTRREF if the index lies beyond this map
+----------------------------------------------------------------------------- */
+
+static Ref
+TagAtIndex(Ref inMap, ArrayIndex * ioIndex)
+{
+	FrameMapObject * mapPtr = (FrameMapObject *)ObjectPtr(inMap);
+	if (NOTNIL(mapPtr->supermap)) {
+		Ref tag = TagAtIndex(mapPtr->supermap, ioIndex);
+		if (tag != INVALIDPTRREF)
+			return tag;
+		mapPtr = (FrameMapObject *)ObjectPtr(inMap);
+	}
+	ArrayIndex numOfTags = (mapPtr->size - SIZEOF_FRAMEMAPOBJECT(0)) / sizeof(Ref);
+	if (*ioIndex < numOfTags)
+		return mapPtr->slot[*ioIndex];
+	*ioIndex -= numOfTags;
+	return INVALIDPTRREF;
+}
+
+
+/* -----------------------------------------------------------------------------
+	C S l o t I t e r a t o r
+----------------------------------------------------------------------------- */
+
+CSlotIterator::CSlotIterator(RefArg inObj)
+	:	fObj(inObj), fIndex(0), fLength(0), fIsFrame(false)
+{
+	if (ISPTR(inObj)) {
+		ObjHeader * oPtr = ObjectPtr(inObj);
+		if (ISFRAME(oPtr)) {
+			fIsFrame = true;
+			fLength = (oPtr->size - SIZEOF_FRAMEOBJECT(0)) / sizeof(Ref);
+		} else if (ISARRAY(oPtr)) {
+			fLength = ARRAYLENGTH(oPtr);
+		}
+	}
+}
+
+
+Ref
+CSlotIterator::value(void) const
+{
+	if (fIsFrame) {
+		FrameObject * frPtr = (FrameObject *)ObjectPtr(fObj);
+		// the loop body might have removed slots
+		if (fIndex < (frPtr->size - SIZEOF_FRAMEOBJECT(0)) / sizeof(Ref))
+			return frPtr->slot[fIndex];
+	} else {
+		ArrayObject * arPtr = (ArrayObject *)ObjectPtr(fObj);
+		if (fIndex < ARRAYLENGTH(arPtr))
+			return arPtr->slot[fIndex];
+	}
+	return NILREF;
+}
+
+
+Ref
+CSlotIterator::tag(void) const
+{
+	if (fIsFrame) {
+		ArrayIndex index = fIndex;
+		Ref tag = TagAtIndex(((FrameObject *)ObjectPtr(fObj))->map, &index);
+		return tag != INVALIDPTRREF ? tag : NILREF;
+	}
+	return MAKEINT(fIndex);
+}
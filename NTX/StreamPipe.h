@@ -0,0 +1,72 @@
+/*
+	File:		StreamPipe.h
+
+	Contains:	A read-only pipe over a blocking byte stream.
+					Lets UnflattenRef() decode an object as its bytes arrive from the
+					connection, rather than buffering the whole flattened object first.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__STREAMPIPE_H)
+#define __STREAMPIPE_H 1
+
+#include "NewtonKit.h"
+
+/* -----------------------------------------------------------------------------
+	The source of bytes for the pipe.
+	It must block until exactly inLength bytes have been read into outBuf,
+	or return an error.
+----------------------------------------------------------------------------- */
+
+typedef NewtonErr (^StreamPipeReader)(char * outBuf, size_t inLength);
+
+#define kStreamPipeBufSize (4*KByte)
+
+
+/* -----------------------------------------------------------------------------
+	C S t r e a m P i p e
+	Reads at most inLength bytes from the source, through a small read-ahead
+	buffer, so peak memory is bounded by the buffer and not the object size.
+	Only forward reads are possible; write operations throw exPipe.
+----------------------------------------------------------------------------- */
+
+class CStreamPipe : public CPipe
+{
+public:
+				CStreamPipe(StreamPipeReader inReader, size_t inLength, size_t inBufSize = kStreamPipeBufSize);
+				~CStreamPipe();
+
+	long		readSeek(long inOffset, int inSelector);
+	long		readPosition(void) const;
+	long		writeSeek(long inOffset, int inSelector);
+	long		writePosition(void) const;
+	void		readChunk(void * outBuf, size_t & ioSize, bool & outEOF);
+	void		writeChunk(const void * inBuf, size_t inSize, bool inFlush);
+	void		flushRead(void);
+	void		flushWrite(void);
+	void		reset(void);
+	void		overflow();
+	void		underflow(long, bool&);
+
+	NewtonErr	drain(void);
+	NewtonErr	error(void) const;
+	size_t		remaining(void) const;
+
+private:
+	NewtonErr	fill(void);
+
+	StreamPipeReader	fReader;
+	char *		fBuf;
+	size_t		fBufSize;
+	size_t		fBufIndex;		// next byte to be consumed from fBuf
+	size_t		fBufCount;		// number of valid bytes in fBuf
+	size_t		fLength;			// total bytes available from the source
+	size_t		fFetched;		// bytes pulled from the source so far
+	NewtonErr	fError;
+};
+
+inline NewtonErr	CStreamPipe::error(void) const { return fError; }
+inline size_t		CStreamPipe::remaining(void) const { return fLength - readPosition(); }
+
+#endif	/* __STREAMPIPE_H */
@@ -0,0 +1,181 @@
+/*
+	File:		StreamPipe.mm
+
+	Contains:	A read-only pipe over a blocking byte stream.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "StreamPipe.h"
+#import <stdio.h>
+
+
+/* -----------------------------------------------------------------------------
+	C S t r e a m P i p e
+----------------------------------------------------------------------------- */
+
+CStreamPipe::CStreamPipe(StreamPipeReader inReader, size_t inLength, size_t inBufSize)
+	:	fReader(inReader), fBufIndex(0), fBufCount(0), fLength(inLength), fFetched(0), fError(noErr)
+{
+	fBufSize = MIN(inBufSize, inLength);
+	fBuf = fBufSize > 0 ? (char *)malloc(fBufSize) : NULL;
+	if (fBufSize > 0 && fBuf == NULL)
+		fError = kOSErrNoMemory;
+}
+
+
+CStreamPipe::~CStreamPipe()
+{
+	if (fBuf)
+		free(fBuf);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Refill the read-ahead buffer from the source.
+	We never ask for more than is left of the object, so the source can’t
+	block waiting for bytes that belong to the next event.
+	Args:		--
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+NewtonErr
+CStreamPipe::fill(void)
+{
+	if (fError == noErr) {
+		size_t count = MIN(fBufSize, fLength - fFetched);
+		if (count > 0) {
+			fError = fReader(fBuf, count);
+			if (fError == noErr) {
+				fFetched += count;
+				fBufIndex = 0;
+				fBufCount = count;
+			}
+		}
+	}
+	return fError;
+}
+
+
+void
+CStreamPipe::readChunk(void * outBuf, size_t & ioSize, bool & outEOF)
+{
+	char * p = (char *)outBuf;
+	size_t reqSize = ioSize;
+	size_t count = 0;
+	while (count < reqSize) {
+		if (fBufIndex == fBufCount) {
+			if (fFetched == fLength)
+				break;
+			if (fill() != noErr)
+				ThrowErr(exPipe, fError);
+		}
+		size_t chunkSize = MIN(reqSize - count, fBufCount - fBufIndex);
+		memcpy(p + count, fBuf + fBufIndex, chunkSize);
+		fBufIndex += chunkSize;
+		count += chunkSize;
+	}
+	ioSize = count;
+	outEOF = (fFetched == fLength && fBufIndex == fBufCount);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Consume whatever the unflattener didn’t, so the byte stream stays in step
+	with the protocol.
+	Args:		--
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+NewtonErr
+CStreamPipe::drain(void)
+{
+	fBufIndex = fBufCount;
+	while (fFetched < fLength && fill() == noErr)
+		fBufIndex = fBufCount;
+	return fError;
+}
+
+
+long
+CStreamPipe::readSeek(long inOffset, int inSelector)
+{
+	long pos = readPosition();
+	if (inSelector == SEEK_SET)
+		inOffset -= pos;
+	else if (inSelector == SEEK_END)
+		inOffset += fLength - pos;
+	if (inOffset < 0)
+		ThrowErr(exPipe, kOSErrBadParameters);	// can’t rewind a stream
+	// skip forward
+	while (inOffset > 0) {
+		if (fBufIndex == fBufCount) {
+			if (fFetched == fLength || fill() != noErr)
+				break;
+		}
+		size_t skipSize = MIN((size_t)inOffset, fBufCount - fBufIndex);
+		fBufIndex += skipSize;
+		inOffset -= skipSize;
+	}
+	return readPosition();
+}
+
+
+long
+CStreamPipe::readPosition(void) const
+{
+	return fFetched - (fBufCount - fBufIndex);
+}
+
+
+long
+CStreamPipe::writeSeek(long inOffset, int inSelector)
+{
+	ThrowErr(exPipe, kOSErrBadParameters);
+	return 0;
+}
+
+
+long
+CStreamPipe::writePosition(void) const
+{
+	return 0;
+}
+
+
+void
+CStreamPipe::writeChunk(const void * inBuf, size_t inSize, bool inFlush)
+{
+	ThrowErr(exPipe, kOSErrBadParameters);
+}
+
+
+void
+CStreamPipe::flushRead(void)
+{ }
+
+
+void
+CStreamPipe::flushWrite(void)
+{ }
+
+
+void
+CStreamPipe::reset(void)
+{
+	drain();
+}
+
+
+void
+CStreamPipe::overflow()
+{
+	ThrowErr(exPipe, kOSErrBadParameters);
+}
+
+
+void
+CStreamPipe::underflow(long inSize, bool & outEOF)
+{
+	outEOF = (fBufIndex == fBufCount && (fFetched == fLength || fill() != noErr));
+}
@@ -0,0 +1,104 @@
+/*
+	File:		StreamPrinter.h
+
+	Contains:	Incremental printer for Newton Streamed Object Format files.
+					Rather than unflatten a whole stream and print it into one string,
+					the printer walks the flattened bytes in place and prints only the
+					lines asked for. Every object and every closing bracket has a line
+					of its own, so the text for any range of lines can be made on
+					demand.
+					Walking is native -- it creates no NewtonScript objects -- and goes
+					no further into the stream than the last line asked for. The walk
+					state is saved every kStreamCheckpointLines lines so that printing
+					an earlier range, or one already passed, starts from the nearest
+					checkpoint rather than from the start of the stream.
+					Objects are numbered in the order they are printed, the root being
+					object 0, so a view can seek to an object.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__STREAMPRINTER_H)
+#define __STREAMPRINTER_H 1
+
+#include "NewtonKit.h"
+#include <string>
+#include <vector>
+
+#define kStreamCheckpointLines	256
+
+
+/* -----------------------------------------------------------------------------
+	S t r e a m L e v e l
+	A container being printed.
+----------------------------------------------------------------------------- */
+
+struct StreamLevel
+{
+	char			kind;			// kNSOFArray, kNSOFPlainArray, kNSOFFrame, or kNSOFRoot
+	bool			needsComma;	// after the closing bracket
+	ArrayIndex	count;
+	ArrayIndex	index;		// of next slot to print
+	size_t		tagOffset;	// frames: offset of next slot tag
+};
+
+
+/* -----------------------------------------------------------------------------
+	S t r e a m C u r s o r
+	Where the walk has got to.
+----------------------------------------------------------------------------- */
+
+struct StreamCursor
+{
+	size_t		offset;		// of next object in the stream
+	ArrayIndex	line;			// number of next line
+	ArrayIndex	object;		// number of next object
+	ArrayIndex	precedent;	// ID of next object that can be referred to
+	std::vector<StreamLevel> stack;
+};
+
+
+/* -----------------------------------------------------------------------------
+	C S t r e a m P r i n t e r
+----------------------------------------------------------------------------- */
+
+class CStreamPrinter
+{
+public:
+				CStreamPrinter();
+				~CStreamPrinter();
+
+	NewtonErr	open(const char * inFilename);
+
+	ArrayIndex	print(ArrayIndex inLine, ArrayIndex inCount, std::string & outText);
+	ArrayIndex	lineOfObject(ArrayIndex inObject);
+	bool			isComplete(void) const;
+	ArrayIndex	numOfLines(void) const;		// so far, unless complete
+	ArrayIndex	estimatedNumOfLines(void) const;
+	size_t		size(void) const;
+
+private:
+	bool			step(StreamCursor & ioCursor, std::string * outLine);
+	void			seekLine(StreamCursor & outCursor, ArrayIndex inLine);
+	size_t		readObject(size_t inOffset, ArrayIndex * ioPrecedent, std::string * outText, int inDepth = 0);
+	void			printReference(ULong inID, std::string & outText, int inDepth);
+	ULong			readXLong(size_t & ioOffset);
+	bool			have(size_t inOffset, size_t inLength);
+	void			notePrecedent(ArrayIndex * ioPrecedent, size_t inOffset);
+
+	const unsigned char *	fStream;
+	size_t		fSize;
+	bool			fIsBad;		// ran off the end, or found an unknown tag
+	bool			fIsComplete;
+	ArrayIndex	fNumOfLines;
+	size_t		fWalkedSize;	// offset the walk had reached at line fNumOfLines
+	std::vector<uint32_t>		fPrecedents;		// offset of each object that can be referred to, by ID
+	std::vector<StreamCursor>	fCheckpoints;		// walk state at every kStreamCheckpointLines lines
+};
+
+
+inline bool			CStreamPrinter::isComplete(void) const  { return fIsComplete; }
+inline ArrayIndex	CStreamPrinter::numOfLines(void) const  { return fNumOfLines; }
+inline size_t		CStreamPrinter::size(void) const  { return fSize; }
+
+#endif	/* __STREAMPRINTER_H */
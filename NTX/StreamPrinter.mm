@@ -0,0 +1,733 @@
+/*
+	File:		StreamPrinter.mm
+
+	Contains:	Incremental printer for Newton Streamed Object Format files.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <libkern/OSByteOrder.h>
+#include <algorithm>
+
+#include "StreamPrinter.h"
+#include "TextConvert.h"
+
+/* -----------------------------------------------------------------------------
+	NSOF object tags.
+----------------------------------------------------------------------------- */
+
+#define kNSOFVersion 2
+
+enum
+{
+	kNSOFImmediate,
+	kNSOFCharacter,
+	kNSOFUnicodeCharacter,
+	kNSOFBinaryObject,
+	kNSOFArray,
+	kNSOFPlainArray,
+	kNSOFFrame,
+	kNSOFSymbol,
+	kNSOFString,
+	kNSOFPrecedent,
+	kNSOFNIL,
+	kNSOFSmallRect,
+	kNSOFLargeBinary,
+	kNSOFRoot = 0x7F		// not a tag: the level that holds the root object
+};
+
+#define kMaxNesting		256
+#define kMaxStringChars	1000		// longer strings are truncated -- a line should fit in a view
+#define kIndent			"  "
+
+
+#pragma mark Formatting
+/* -----------------------------------------------------------------------------
+	Append a formatted string.
+----------------------------------------------------------------------------- */
+
+static void
+AppendFormat(std::string & ioText, const char * inFormat, ...)
+{
+	char buf[64];
+	va_list args;
+	va_start(args, inFormat);
+	vsnprintf(buf, sizeof(buf), inFormat, args);
+	va_end(args);
+	ioText += buf;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Append a UniChar, UTF-8 encoded.
+	Surrogate pairs are combined by the caller; a lone surrogate is encoded as
+	it stands.
+----------------------------------------------------------------------------- */
+
+static void
+AppendUTF8(std::string & ioText, ULong inCodePoint)
+{
+	if (inCodePoint < 0x80) {
+		ioText += (char)inCodePoint;
+	} else if (inCodePoint < 0x800) {
+		ioText += (char)(0xC0 | (inCodePoint >> 6));
+		ioText += (char)(0x80 | (inCodePoint & 0x3F));
+	} else if (inCodePoint < 0x10000) {
+		ioText += (char)(0xE0 | (inCodePoint >> 12));
+		ioText += (char)(0x80 | ((inCodePoint >> 6) & 0x3F));
+		ioText += (char)(0x80 | (inCodePoint & 0x3F));
+	} else {
+		ioText += (char)(0xF0 | (inCodePoint >> 18));
+		ioText += (char)(0x80 | ((inCodePoint >> 12) & 0x3F));
+		ioText += (char)(0x80 | ((inCodePoint >> 6) & 0x3F));
+		ioText += (char)(0x80 | (inCodePoint & 0x3F));
+	}
+}
+
+
+static void
+PrintCharacter(std::string & ioText, UniChar inChar)
+{
+	if (inChar == '\\')
+		ioText += "$\\\\";
+	else if (inChar >= 0x20 && inChar < 0x7F) {
+		ioText += '$';
+		ioText += (char)inChar;
+	} else
+		AppendFormat(ioText, "$\\u%04X", inChar);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print an immediate Ref.
+----------------------------------------------------------------------------- */
+
+static void
+PrintImmediate(std::string & ioText, ULong inRef)
+{
+	if ((inRef & 0x03) == 0)
+		AppendFormat(ioText, "%d", (int32_t)inRef >> 2);
+	else if ((inRef & 0x0F) == 0x06)
+		PrintCharacter(ioText, (UniChar)(inRef >> 4));
+	else if (inRef == 0x1A)
+		ioText += "true";
+	else if (inRef == 0x02)
+		ioText += "nil";
+	else if ((inRef & 0x03) == 0x03)
+		AppendFormat(ioText, "@%u", inRef >> 2);
+	else
+		AppendFormat(ioText, "<immediate 0x%08X>", inRef);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print a symbol, quoted with |bars| if it isn’t a plain identifier.
+	Symbol names are MacRoman.
+----------------------------------------------------------------------------- */
+
+static void
+PrintSymbol(std::string & ioText, const unsigned char * inName, size_t inLen)
+{
+	bool isPlain = inLen > 0 && !(inName[0] >= '0' && inName[0] <= '9');
+	bool isASCII = true;
+	for (size_t i = 0; i < inLen; ++i) {
+		unsigned char ch = inName[i];
+		if (!((ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_'))
+			isPlain = false;
+		if (ch >= 0x80)
+			isASCII = false;
+	}
+	ioText += '\'';
+	if (!isPlain)
+		ioText += '|';
+	if (isASCII) {
+		for (size_t i = 0; i < inLen; ++i) {
+			if (inName[i] == '|' || inName[i] == '\\')
+				ioText += '\\';
+			ioText += (char)inName[i];
+		}
+	} else {
+		std::vector<UniChar> name(inLen);
+		MacRomanToUniChar(inName, inLen, name.data());
+		for (UniChar ch : name) {
+			if (ch == '|' || ch == '\\')
+				ioText += '\\';
+			AppendUTF8(ioText, ch);
+		}
+	}
+	if (!isPlain)
+		ioText += '|';
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print a string. Its data is big-endian UniChars, nul-terminated.
+----------------------------------------------------------------------------- */
+
+static void
+PrintString(std::string & ioText, const unsigned char * inData, size_t inLen)
+{
+	ioText += '"';
+	ArrayIndex count = (ArrayIndex)(inLen / sizeof(UniChar));
+	ArrayIndex i;
+	for (i = 0; i < count && i < kMaxStringChars; ++i) {
+		UniChar ch = OSReadBigInt16(inData, i * sizeof(UniChar));
+		if (ch == 0)
+			break;
+		if (ch == '"' || ch == '\\') {
+			ioText += '\\';
+			ioText += (char)ch;
+		} else if (ch == 0x0D)
+			ioText += "\\n";
+		else if (ch == 0x09)
+			ioText += "\\t";
+		else if (ch < 0x20)
+			AppendFormat(ioText, "\\u%04X\\u", ch);
+		else if (ch >= 0xD800 && ch < 0xDC00 && i+1 < count) {
+			UniChar lo = OSReadBigInt16(inData, (i+1) * sizeof(UniChar));
+			if (lo >= 0xDC00 && lo < 0xE000) {
+				AppendUTF8(ioText, 0x10000 + ((ch - 0xD800) << 10) + (lo - 0xDC00));
+				++i;
+			} else
+				AppendUTF8(ioText, ch);
+		} else
+			AppendUTF8(ioText, ch);
+	}
+	if (i == kMaxStringChars && i < count && OSReadBigInt16(inData, i * sizeof(UniChar)) != 0)
+		ioText += "…";
+	ioText += '"';
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print a binary object. Reals we can show; anything else is just a size.
+	Args:		ioText
+				inClass		its class, as printed
+				inData		its data
+				inLen			its size
+----------------------------------------------------------------------------- */
+
+static void
+PrintBinary(std::string & ioText, const std::string & inClass, const unsigned char * inData, size_t inLen)
+{
+	if (inClass == "'real" && inLen == sizeof(double)) {
+		uint64_t bits = OSReadBigInt64(inData, 0);
+		double value;
+		memcpy(&value, &bits, sizeof(double));
+		AppendFormat(ioText, "%.15g", value);
+	} else {
+		ioText += "<binary ";
+		ioText += inClass;
+		AppendFormat(ioText, ", %lu bytes>", (unsigned long)inLen);
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Strip the quote from a printed symbol, to print it as a slot tag or array
+	class.
+----------------------------------------------------------------------------- */
+
+static inline const char *
+Unquoted(const std::string & inSym)
+{
+	return (inSym.length() > 0 && inSym[0] == '\'') ? inSym.c_str() + 1 : inSym.c_str();
+}
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	C S t r e a m P r i n t e r
+----------------------------------------------------------------------------- */
+
+CStreamPrinter::CStreamPrinter()
+	:	fStream(NULL), fSize(0), fIsBad(false), fIsComplete(false), fNumOfLines(0), fWalkedSize(0)
+{ }
+
+
+CStreamPrinter::~CStreamPrinter()
+{
+	if (fStream)
+		munmap((void *)fStream, fSize);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Map a stream file.
+	Args:		inFilename
+	Return:	error code
+----------------------------------------------------------------------------- */
+
+NewtonErr
+CStreamPrinter::open(const char * inFilename)
+{
+	NewtonErr err = noErr;
+	int fd = ::open(inFilename, O_RDONLY);
+	if (fd < 0)
+		return kOSErrItemNotFound;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < 2 || info.st_size > UINT32_MAX) {
+		err = kNSErrUnknownStreamFormat;
+	} else {
+		void * p = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			err = kOSErrNoMemory;
+		} else {
+			fStream = (const unsigned char *)p;
+			fSize = (size_t)info.st_size;
+			// we read it in order, mostly
+			madvise(p, fSize, MADV_SEQUENTIAL);
+		}
+	}
+	::close(fd);
+	if (err)
+		return err;
+
+	if (fStream[0] != kNSOFVersion)
+		return kNSErrUnknownStreamFormat;
+
+	// the walk starts with the root object
+	StreamCursor start;
+	start.offset = 1;
+	start.line = 0;
+	start.object = 0;
+	start.precedent = 0;
+	start.stack.push_back(StreamLevel{ kNSOFRoot, false, 1, 0, 0 });
+	fCheckpoints.push_back(start);
+	return noErr;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print lines.
+	Args:		inLine		first line to print
+				inCount		number of lines to print
+				outText		the lines are appended to this, UTF-8 encoded
+	Return:	number of lines printed; fewer than inCount at the end of the stream
+----------------------------------------------------------------------------- */
+
+ArrayIndex
+CStreamPrinter::print(ArrayIndex inLine, ArrayIndex inCount, std::string & outText)
+{
+	if (fStream == NULL)
+		return 0;
+
+	StreamCursor cursor;
+	seekLine(cursor, inLine);
+	if (cursor.line < inLine)
+		return 0;
+
+	ArrayIndex count;
+	std::string line;
+	for (count = 0; count < inCount; ++count) {
+		line.clear();
+		if (!step(cursor, &line))
+			break;
+		outText += line;
+		outText += '\n';
+	}
+	if (count < inCount && fIsBad)
+		AppendFormat(outText, "*** Stream is damaged at offset %lu ***\n", (unsigned long)cursor.offset);
+	return count;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find the line on which an object is printed.
+	Args:		inObject		object number
+	Return:	line number; kIndexNotFound if the stream has fewer objects
+----------------------------------------------------------------------------- */
+
+ArrayIndex
+CStreamPrinter::lineOfObject(ArrayIndex inObject)
+{
+	if (fStream == NULL)
+		return kIndexNotFound;
+
+	// start from the last checkpoint before the object
+	auto iter = std::upper_bound(fCheckpoints.begin(), fCheckpoints.end(), inObject,
+										  [](ArrayIndex inObj, const StreamCursor & inCheckpoint) { return inObj < inCheckpoint.object; });
+	StreamCursor cursor = *(iter - 1);
+	for ( ; ; ) {
+		const StreamLevel & level = cursor.stack.back();
+		if (cursor.object == inObject && level.index < level.count)
+			return cursor.line;
+		if (!step(cursor, NULL))
+			return kIndexNotFound;
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Position a cursor at a line, walking from the nearest checkpoint.
+	Args:		outCursor
+				inLine
+	Return:	--		if the stream has fewer lines, the cursor is left at the end
+----------------------------------------------------------------------------- */
+
+void
+CStreamPrinter::seekLine(StreamCursor & outCursor, ArrayIndex inLine)
+{
+	size_t index = std::min((size_t)(inLine / kStreamCheckpointLines), fCheckpoints.size() - 1);
+	outCursor = fCheckpoints[index];
+	while (outCursor.line < inLine && step(outCursor, NULL))
+		;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print the next line.
+	Args:		ioCursor		walk state
+				outLine		the line is appended to this; NULL => just walk
+	Return:	false => no more lines
+----------------------------------------------------------------------------- */
+
+bool
+CStreamPrinter::step(StreamCursor & ioCursor, std::string * outLine)
+{
+	// damage is found afresh by each walk, so lines before it can still be printed
+	fIsBad = false;
+
+	if ((ioCursor.line % kStreamCheckpointLines) == 0 && ioCursor.line / kStreamCheckpointLines == fCheckpoints.size())
+		fCheckpoints.push_back(ioCursor);
+
+	StreamLevel & level = ioCursor.stack.back();
+	ArrayIndex depth = (ArrayIndex)ioCursor.stack.size() - 1;
+	if (level.index == level.count) {
+		if (level.kind == kNSOFRoot) {
+			fIsComplete = true;
+			return false;
+		}
+		// close the container
+		if (outLine) {
+			for (ArrayIndex i = 1; i < depth; ++i)
+				*outLine += kIndent;
+			*outLine += (level.kind == kNSOFFrame) ? "}" : "]";
+			if (level.needsComma)
+				*outLine += ',';
+		}
+		ioCursor.stack.pop_back();
+	} else {
+		std::string tag;
+		if (outLine) {
+			for (ArrayIndex i = 0; i < depth; ++i)
+				*outLine += kIndent;
+		}
+		if (level.kind == kNSOFFrame) {
+			level.tagOffset = readObject(level.tagOffset, NULL, outLine ? &tag : NULL);
+			if (outLine) {
+				*outLine += Unquoted(tag);
+				*outLine += ": ";
+			}
+		}
+		bool needsComma = (++level.index < level.count);
+
+		size_t offset = ioCursor.offset;
+		if (!have(offset, 1))
+			return false;
+		char kind = fStream[offset];
+		if (kind == kNSOFArray || kind == kNSOFPlainArray || kind == kNSOFFrame) {
+			// open a container
+			if (ioCursor.stack.size() > kMaxNesting) {
+				fIsBad = true;
+				return false;
+			}
+			notePrecedent(&ioCursor.precedent, offset++);
+			ArrayIndex count = readXLong(offset);
+			std::string cls;
+			size_t tagOffset = 0;
+			if (kind == kNSOFArray) {
+				offset = readObject(offset, &ioCursor.precedent, outLine ? &cls : NULL, 1);
+			} else if (kind == kNSOFFrame) {
+				tagOffset = offset;
+				for (ArrayIndex i = 0; i < count && !fIsBad; ++i)
+					offset = readObject(offset, &ioCursor.precedent, NULL, 1);
+			}
+			if (fIsBad)
+				return false;
+			if (outLine) {
+				*outLine += (kind == kNSOFFrame) ? "{" : "[";
+				if (kind == kNSOFArray && cls != "'array") {
+					*outLine += Unquoted(cls);
+					*outLine += ':';
+				}
+				if (count == 0) {
+					*outLine += (kind == kNSOFFrame) ? "}" : "]";
+					if (needsComma)
+						*outLine += ',';
+				}
+			}
+			if (count > 0)
+				ioCursor.stack.push_back(StreamLevel{ kind, needsComma, count, 0, tagOffset });
+		} else {
+			offset = readObject(offset, &ioCursor.precedent, outLine, 0);
+			if (fIsBad)
+				return false;
+			if (outLine && needsComma)
+				*outLine += ',';
+		}
+		ioCursor.offset = offset;
+		ioCursor.object++;
+	}
+
+	ioCursor.line++;
+	if (fNumOfLines < ioCursor.line) {
+		fNumOfLines = ioCursor.line;
+		fWalkedSize = ioCursor.offset;
+	}
+	return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Estimate the number of lines in the whole stream, from the lines printed
+	so far and how much of the stream they took.
+	Args:		--
+	Return:	number of lines; exact once the walk is complete
+----------------------------------------------------------------------------- */
+
+ArrayIndex
+CStreamPrinter::estimatedNumOfLines(void) const
+{
+	if (fIsComplete || fWalkedSize <= 1)
+		return fNumOfLines;
+	uint64_t estimate = (uint64_t)fNumOfLines * (fSize - 1) / (fWalkedSize - 1);
+	if (estimate <= fNumOfLines)
+		return fNumOfLines + 1;	// there’s more to come
+	return estimate < kIndexNotFound ? (ArrayIndex)estimate : kIndexNotFound - 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read a whole object.
+	Args:		inOffset			of the object in the stream
+				ioPrecedent		ID of next object that can be referred to;
+									NULL => the object has been read before
+				outText			a summary of the object is appended to this;
+									NULL => just skip it
+				inDepth			of nested objects read
+	Return:	offset of the following object
+----------------------------------------------------------------------------- */
+
+size_t
+CStreamPrinter::readObject(size_t inOffset, ArrayIndex * ioPrecedent, std::string * outText, int inDepth)
+{
+	if (inDepth > kMaxNesting || !have(inOffset, 1)) {
+		fIsBad = true;
+		return fSize;
+	}
+	size_t offset = inOffset + 1;
+	switch (fStream[inOffset]) {
+	case kNSOFImmediate: {
+			ULong ref = readXLong(offset);
+			if (outText)
+				PrintImmediate(*outText, ref);
+		}
+		break;
+
+	case kNSOFCharacter: {
+			ULong ch = readXLong(offset);
+			if (outText)
+				PrintCharacter(*outText, (UniChar)ch);
+		}
+		break;
+
+	case kNSOFUnicodeCharacter:
+		if (have(offset, 2)) {
+			if (outText)
+				PrintCharacter(*outText, OSReadBigInt16(fStream, offset));
+			offset += 2;
+		}
+		break;
+
+	case kNSOFBinaryObject: {
+			notePrecedent(ioPrecedent, inOffset);
+			ULong len = readXLong(offset);
+			std::string cls;
+			offset = readObject(offset, ioPrecedent, outText ? &cls : NULL, inDepth + 1);
+			if (have(offset, len)) {
+				if (outText)
+					PrintBinary(*outText, cls, fStream + offset, len);
+				offset += len;
+			}
+		}
+		break;
+
+	case kNSOFArray:
+	case kNSOFPlainArray: {
+			notePrecedent(ioPrecedent, inOffset);
+			ArrayIndex count = readXLong(offset);
+			std::string cls;
+			if (fStream[inOffset] == kNSOFArray)
+				offset = readObject(offset, ioPrecedent, outText ? &cls : NULL, inDepth + 1);
+			for (ArrayIndex i = 0; i < count && !fIsBad; ++i)
+				offset = readObject(offset, ioPrecedent, NULL, inDepth + 1);
+			if (outText) {
+				*outText += '[';
+				if (cls.length() > 0 && cls != "'array") {
+					*outText += Unquoted(cls);
+					*outText += ": ";
+				}
+				*outText += count > 0 ? "…]" : "]";
+			}
+		}
+		break;
+
+	case kNSOFFrame: {
+			notePrecedent(ioPrecedent, inOffset);
+			ArrayIndex count = readXLong(offset);
+			for (ArrayIndex i = 0; i < 2*count && !fIsBad; ++i)
+				offset = readObject(offset, ioPrecedent, NULL, inDepth + 1);
+			if (outText)
+				*outText += count > 0 ? "{…}" : "{}";
+		}
+		break;
+
+	case kNSOFSymbol: {
+			notePrecedent(ioPrecedent, inOffset);
+			ULong len = readXLong(offset);
+			if (have(offset, len)) {
+				if (outText)
+					PrintSymbol(*outText, fStream + offset, len);
+				offset += len;
+			}
+		}
+		break;
+
+	case kNSOFString: {
+			notePrecedent(ioPrecedent, inOffset);
+			ULong len = readXLong(offset);
+			if (have(offset, len)) {
+				if (outText)
+					PrintString(*outText, fStream + offset, len);
+				offset += len;
+			}
+		}
+		break;
+
+	case kNSOFPrecedent: {
+			ULong id = readXLong(offset);
+			if (outText && !fIsBad)
+				printReference(id, *outText, inDepth + 1);
+		}
+		break;
+
+	case kNSOFNIL:
+		if (outText)
+			*outText += "nil";
+		break;
+
+	case kNSOFSmallRect:
+		notePrecedent(ioPrecedent, inOffset);
+		if (have(offset, 4)) {
+			if (outText)
+				AppendFormat(*outText, "{top: %u, left: %u, bottom: %u, right: %u}", fStream[offset], fStream[offset+1], fStream[offset+2], fStream[offset+3]);
+			offset += 4;
+		}
+		break;
+
+	case kNSOFLargeBinary: {
+			notePrecedent(ioPrecedent, inOffset);
+			std::string cls;
+			offset = readObject(offset, ioPrecedent, outText ? &cls : NULL, inDepth + 1);
+			// compressed byte, then length, compander name length, compander parms length, reserved longs
+			if (have(offset, 17)) {
+				bool isCompressed = fStream[offset] != 0;
+				uint64_t len = OSReadBigInt32(fStream, offset + 1);
+				uint64_t extra = (uint64_t)OSReadBigInt32(fStream, offset + 5) + OSReadBigInt32(fStream, offset + 9);
+				offset += 17;
+				if (have(offset, len + extra)) {
+					if (outText) {
+						*outText += "<large binary ";
+						*outText += cls;
+						AppendFormat(*outText, ", %llu bytes%s>", len, isCompressed ? ", compressed" : "");
+					}
+					offset += len + extra;
+				}
+			}
+		}
+		break;
+
+	default:
+		fIsBad = true;
+		break;
+	}
+	return fIsBad ? fSize : offset;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print a reference to an object already read.
+	Containers are only summarized -- they have already been printed in full.
+	Args:		inID			precedent ID of object
+				outText
+				inDepth		of nested objects read
+	Return:	--
+----------------------------------------------------------------------------- */
+
+void
+CStreamPrinter::printReference(ULong inID, std::string & outText, int inDepth)
+{
+	if (inID >= fPrecedents.size()) {
+		AppendFormat(outText, "<unknown reference %u>", inID);
+		return;
+	}
+	readObject(fPrecedents[inID], NULL, &outText, inDepth);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Note the offset of an object that can be referred to.
+	Args:		ioPrecedent		its ID; NULL => the object has been read before
+				inOffset
+	Return:	--
+----------------------------------------------------------------------------- */
+
+void
+CStreamPrinter::notePrecedent(ArrayIndex * ioPrecedent, size_t inOffset)
+{
+	if (ioPrecedent) {
+		if (*ioPrecedent == fPrecedents.size())
+			fPrecedents.push_back((uint32_t)inOffset);
+		(*ioPrecedent)++;
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Read an xlong: a byte, or 0xFF then a big-endian long.
+----------------------------------------------------------------------------- */
+
+ULong
+CStreamPrinter::readXLong(size_t & ioOffset)
+{
+	if (!have(ioOffset, 1))
+		return 0;
+	ULong value = fStream[ioOffset++];
+	if (value == 0xFF) {
+		if (!have(ioOffset, 4))
+			return 0;
+		value = OSReadBigInt32(fStream, ioOffset);
+		ioOffset += 4;
+	}
+	return value;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Check there is data to be read; if not, the stream is damaged.
+----------------------------------------------------------------------------- */
+
+bool
+CStreamPrinter::have(size_t inOffset, size_t inLength)
+{
+	if (inOffset <= fSize && inLength <= fSize - inOffset)
+		return true;
+	fIsBad = true;
+	return false;
+}
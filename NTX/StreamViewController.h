@@ -0,0 +1,33 @@
+/*
+	File:		StreamViewController.h
+
+	Abstract:	Interface for NTXStreamViewController class.
+					The view holds only the lines of the printed stream around those
+					visible, and moves that window as it is scrolled; but it is as
+					tall as the whole stream, so the scroller reaches all of it.
+
+	Written by:		Newton Research, 2018.
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/* -----------------------------------------------------------------------------
+	N T X S t r e a m T e x t V i e w
+	A text view whose text is drawn some way down, at the place in the stream
+	of the lines it holds.
+----------------------------------------------------------------------------- */
+
+@interface NTXStreamTextView : NSTextView
+@property(nonatomic) CGFloat topMargin;
+@end
+
+
+/* -----------------------------------------------------------------------------
+	N T X S t r e a m V i e w C o n t r o l l e r
+----------------------------------------------------------------------------- */
+
+@interface NTXStreamViewController : NSViewController
+@property IBOutlet NTXStreamTextView * textView;
+- (BOOL)showObject:(NSUInteger)inObject;
+- (IBAction)goToObject:(id)sender;
+@end
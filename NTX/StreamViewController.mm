@@ -0,0 +1,237 @@
+/*
+	File:		StreamViewController.mm
+
+	Abstract:	Implementation of NTXStreamViewController class.
+
+	Written by:		Newton Research, 2018.
+*/
+
+#import "StreamViewController.h"
+#import "ScriptViewController.h"
+#import "NTXDocument.h"
+
+// lines kept above and below those visible
+#define kReadAheadLines 100
+
+
+/* -----------------------------------------------------------------------------
+	N T X S t r e a m T e x t V i e w
+----------------------------------------------------------------------------- */
+
+@implementation NTXStreamTextView
+
+- (void)setTopMargin:(CGFloat)inMargin {
+	_topMargin = inMargin;
+	[self invalidateTextContainerOrigin];
+	self.needsDisplay = YES;
+}
+
+- (NSPoint)textContainerOrigin {
+	NSPoint origin = super.textContainerOrigin;
+	origin.y += _topMargin;
+	return origin;
+}
+
+@end
+
+
+/* -----------------------------------------------------------------------------
+	N T X S t r e a m V i e w C o n t r o l l e r
+----------------------------------------------------------------------------- */
+
+@implementation NTXStreamViewController
+{
+	NSDictionary * attributes;
+	CGFloat lineHeight;
+	NSUInteger firstLine;		// line of the stream at the top of the text
+	NSUInteger numOfLines;		// in the text
+	BOOL isMoving;
+}
+
+
+- (void)viewDidLoad {
+	[super viewDidLoad];
+
+	NSFont * font = [NSFont fontWithName:@"Menlo" size:NSFont.smallSystemFontSize];
+	attributes = @{ NSFontAttributeName:font,
+						 NSForegroundColorAttributeName:NSColor.blackColor };
+	lineHeight = [self.textView.layoutManager defaultLineHeightForFont:font];
+
+	// don’t wrap: one line of text is one line fragment, so we know which line is where
+	NSTextContainer * textContainer = self.textView.textContainer;
+	textContainer.containerSize = NSMakeSize(LargeNumberForText, LargeNumberForText);
+	textContainer.widthTracksTextView = NO;
+	self.textView.horizontallyResizable = YES;
+	self.textView.maxSize = NSMakeSize(LargeNumberForText, FLT_MAX);	// a stream can be taller than LargeNumberForText
+	self.textView.enclosingScrollView.hasHorizontalScroller = YES;
+
+	NSClipView * clipView = self.textView.enclosingScrollView.contentView;
+	clipView.postsBoundsChangedNotifications = YES;
+	[NSNotificationCenter.defaultCenter addObserver:self selector:@selector(viewDidScroll:) name:NSViewBoundsDidChangeNotification object:clipView];
+
+	[self showLinesFrom:0];
+}
+
+
+- (void)dealloc {
+	[NSNotificationCenter.defaultCenter removeObserver:self];
+}
+
+
+/* -----------------------------------------------------------------------------
+	The number of lines we hold: those visible and the read-ahead either side.
+----------------------------------------------------------------------------- */
+
+- (NSUInteger)visibleLines {
+	return (NSUInteger)ceil(self.textView.enclosingScrollView.contentView.bounds.size.height / lineHeight);
+}
+
+- (NSUInteger)windowLines {
+	return self.visibleLines + 2*kReadAheadLines;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Replace the text with lines of the stream, drawn where those lines are in
+	the whole stream.
+	Args:		inLine		first line to show
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)showLinesFrom:(NSUInteger)inLine {
+	NTXStreamDocument * document = self.representedObject;
+	NSString * text = [document linesFrom:inLine count:self.windowLines];
+	if (text.length == 0 && inLine > 0 && document.isComplete) {
+		// we were scrolled past the end of the stream -- it was shorter than estimated
+		inLine = (document.numOfLines > self.windowLines) ? document.numOfLines - self.windowLines : 0;
+		text = [document linesFrom:inLine count:self.windowLines];
+	}
+
+	firstLine = inLine;
+	numOfLines = 0;
+	for (NSUInteger i = 0, count = text.length; i < count; ++i) {
+		if ([text characterAtIndex:i] == '\n')
+			++numOfLines;
+	}
+
+	isMoving = YES;
+	self.textView.topMargin = firstLine * lineHeight;
+	[self.textView.textStorage setAttributedString:[[NSAttributedString alloc] initWithString:text attributes:attributes]];
+	[self sizeToStream];
+	isMoving = NO;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Make the text view as tall as the whole stream -- as far as we know it.
+	Until the stream has been printed to the end its length is estimated from
+	the lines printed so far, so the scroller is only approximate until then.
+----------------------------------------------------------------------------- */
+
+- (void)sizeToStream {
+	NTXStreamDocument * document = self.representedObject;
+	NSUInteger lines = MAX(document.estimatedNumOfLines, firstLine + numOfLines);
+	NSSize size = self.textView.minSize;
+	size.height = MAX(lines * lineHeight + 2*self.textView.textContainerInset.height, self.textView.enclosingScrollView.contentView.bounds.size.height);
+	self.textView.minSize = size;
+	[self.textView sizeToFit];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Scroll so that a line of the stream is at some distance from the top of
+	the view.
+----------------------------------------------------------------------------- */
+
+- (void)scrollToLine:(NSUInteger)inLine offset:(CGFloat)inOffset {
+	NSScrollView * scrollView = self.textView.enclosingScrollView;
+	NSClipView * clipView = scrollView.contentView;
+	isMoving = YES;
+	[clipView scrollToPoint:NSMakePoint(clipView.bounds.origin.x, self.textView.textContainerInset.height + inLine * lineHeight + inOffset)];
+	[scrollView reflectScrolledClipView:clipView];
+	isMoving = NO;
+}
+
+
+/* -----------------------------------------------------------------------------
+	When the view is scrolled close to either end of the text we hold, or
+	beyond it, move the window of lines so the visible lines are in the middle
+	of it again.
+----------------------------------------------------------------------------- */
+
+- (void)viewDidScroll:(NSNotification *)inNotification {
+	if (isMoving)
+		return;
+
+	CGFloat top = self.textView.enclosingScrollView.contentView.bounds.origin.y - self.textView.textContainerInset.height;
+	if (top < 0)
+		top = 0;
+	NSUInteger topLine = (NSUInteger)(top / lineHeight);
+
+	NTXStreamDocument * document = self.representedObject;
+	BOOL isNearStart = firstLine > 0
+						 && topLine < firstLine + kReadAheadLines/2;
+	BOOL isNearEnd = !(document.isComplete && firstLine + numOfLines >= document.numOfLines)	// else we have the end of the stream
+					  && topLine + self.visibleLines + kReadAheadLines/2 > firstLine + numOfLines;
+	if (isNearStart || isNearEnd) {
+		[self showLinesFrom:(topLine > kReadAheadLines) ? topLine - kReadAheadLines : 0];
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Show an object, and select its line.
+	Args:		inObject		object number; the root object is 0, and the rest are
+								numbered in the order they are printed
+	Return:	NO => there is no such object
+----------------------------------------------------------------------------- */
+
+- (BOOL)showObject:(NSUInteger)inObject {
+	NTXStreamDocument * document = self.representedObject;
+	NSUInteger line = [document lineOfObject:inObject];
+	if (line == NSNotFound)
+		return NO;
+
+	if (line < firstLine || line >= firstLine + numOfLines) {
+		[self showLinesFrom:(line > kReadAheadLines) ? line - kReadAheadLines : 0];
+	}
+	[self scrollToLine:line offset:0];
+
+	NSString * text = self.textView.string;
+	NSUInteger index = 0;
+	for (NSUInteger i = firstLine; i < line; ++i) {
+		index = NSMaxRange([text lineRangeForRange:NSMakeRange(index, 0)]);
+	}
+	self.textView.selectedRange = [text lineRangeForRange:NSMakeRange(index, 0)];
+	return YES;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Handle Go to Object menu item: ask for an object number and show it.
+	Args:		sender
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (IBAction)goToObject:(id)sender {
+	NSTextField * field = [[NSTextField alloc] initWithFrame:NSMakeRect(0, 0, 200, 22)];
+	field.placeholderString = @"0 is the root object";
+
+	NSAlert * alert = [[NSAlert alloc] init];
+	alert.messageText = @"Go to Object";
+	alert.informativeText = @"Objects are numbered in the order they are printed.";
+	alert.accessoryView = field;
+	[alert addButtonWithTitle:@"Go"];
+	[alert addButtonWithTitle:@"Cancel"];
+	alert.window.initialFirstResponder = field;
+
+	[alert beginSheetModalForWindow:self.view.window completionHandler:^(NSModalResponse inResponse) {
+		if (inResponse == NSAlertFirstButtonReturn) {
+			NSInteger object = field.integerValue;
+			if (object < 0 || ![self showObject:(NSUInteger)object])
+				NSBeep();
+		}
+	}];
+}
+
+@end
@@ -0,0 +1,68 @@
+/*
+	File:		TemplateCache.h
+
+	Contains:	Cache of code compiled from layout slot source.
+					Building a layout compiles every script and evaluated slot of every
+					view template, on every build, whether or not it has changed. We
+					keep the codeblock compiled from each source text, keyed by a hash
+					of that text, and reuse it for as long as the source and the global
+					constants it names are unchanged. (The compiler folds constants
+					into the code, so a codeblock is only as current as the constants
+					it saw.)
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__TEMPLATECACHE_H)
+#define __TEMPLATECACHE_H 1
+
+#include "NewtonKit.h"
+#include <unordered_map>
+
+#define kMaxTemplateCacheEntries	4096
+
+/* -----------------------------------------------------------------------------
+	T e m p l a t e C a c h e S t a t s
+	compiles counts calls to the compiler; a rebuild of an unchanged layout
+	should add only hits.
+----------------------------------------------------------------------------- */
+
+struct TemplateCacheStats
+{
+	ULong		hits;
+	ULong		compiles;
+	ULong		evaluationsSkipped;
+	ULong		flushes;
+};
+
+extern TemplateCacheStats	gTemplateCacheStats;
+
+
+/* -----------------------------------------------------------------------------
+	C T e m p l a t e C a c h e
+	Entries are held in a NewtonScript array so the GC sees them; the hash
+	index only holds array indexes, which don’t move.
+----------------------------------------------------------------------------- */
+
+class CTemplateCache
+{
+public:
+					CTemplateCache();
+
+	void			beginBuild(void);
+	Ref			compile(RefArg inSource);
+	Ref			evaluateFunction(RefArg inSource);
+	void			flush(void);
+
+private:
+	ArrayIndex	entryFor(RefArg inSource);
+	ArrayIndex	find(RefArg inSource, ULong inHash);
+	bool			isCurrent(RefArg inEntry);
+	void			recordDependencies(RefArg ioEntry, RefArg inSource);
+
+	std::unordered_multimap<ULong, ArrayIndex>	fIndex;
+	RefStruct	fEntries;		// array of entry arrays
+	RefStruct	fOptions;		// compiler option constants the entries were compiled with
+};
+
+#endif	/* __TEMPLATECACHE_H */
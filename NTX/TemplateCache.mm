@@ -0,0 +1,385 @@
+/*
+	File:		TemplateCache.mm
+
+	Contains:	Cache of code compiled from layout slot source.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import "TemplateCache.h"
+#include <set>
+#include <string>
+#include <vector>
+
+extern Ref ParseString(RefArg inStr);
+extern Ref GetGlobalConstant(RefArg inTag);
+extern Ref GetAllGlobalConstants(void);
+
+TemplateCacheStats	gTemplateCacheStats;
+
+
+/* -----------------------------------------------------------------------------
+	An entry is an array of:
+----------------------------------------------------------------------------- */
+
+enum
+{
+	kEntrySource,			// string compiled
+	kEntryCodeBlock,		// what ParseString() made of it
+	kEntryFunction,		// for function literals, the function the codeblock evaluated to; else nil
+	kEntryConstants,		// array of constant tag, value seen at compile time, tag, value, ...
+	kEntryVariables,		// array of identifiers that were NOT constants at compile time
+	kEntrySize
+};
+
+/* -----------------------------------------------------------------------------
+	Constants that change the way the compiler generates code.
+	If any of these change, nothing we have compiled is any use.
+----------------------------------------------------------------------------- */
+
+static const char * const kCompilerOptions[] =
+{
+	"kCheckGlobalFunctions",
+	"kOldBuildRules",
+	"kSuppressByteCodes",
+	"kFasterFunctions",
+	"kDebugOn",
+	"kProfileOn",
+	"kIgnoreNativeKeyword"
+};
+#define kNumOfCompilerOptions (sizeof(kCompilerOptions)/sizeof(kCompilerOptions[0]))
+
+/* -----------------------------------------------------------------------------
+	Byte codes of a codeblock that is just a function literal.
+----------------------------------------------------------------------------- */
+
+enum
+{
+	kOpReturn = 002,
+	kOpSetLexScope = 004,
+	kOpPushLiteral0 = 030
+};
+
+
+/* -----------------------------------------------------------------------------
+	FNV-1a hash of a string’s bytes.
+----------------------------------------------------------------------------- */
+
+static ULong
+HashSource(RefArg inSource)
+{
+	ULong hash = 2166136261U;
+	const unsigned char * s = (const unsigned char *)BinaryData(inSource);
+	for (ArrayIndex i = 0, count = Length(inSource); i < count; ++i) {
+		hash = (hash ^ s[i]) * 16777619U;
+	}
+	return hash;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Compare values. Constant values are commonly strings, which will have been
+	recreated by each build, so compare binary objects by content. Frames and
+	arrays are recreated too, so compare them slot by slot.
+----------------------------------------------------------------------------- */
+
+static bool
+SameValue(Ref inA, Ref inB)
+{
+	if (EQRef(inA, inB))
+		return true;
+	if (IsBinary(inA) && IsBinary(inB)) {
+		ArrayIndex len = Length(inA);
+		return EQRef(ClassOf(inA), ClassOf(inB))
+			 && len == Length(inB)
+			 && memcmp(BinaryData(inA), BinaryData(inB), len) == 0;
+	}
+	if (IsArray(inA) && IsArray(inB)) {
+		ArrayIndex count = Length(inA);
+		if (!EQRef(ClassOf(inA), ClassOf(inB)) || count != Length(inB))
+			return false;
+		for (ArrayIndex i = 0; i < count; ++i) {
+			if (!SameValue(GetArraySlot(inA, i), GetArraySlot(inB, i)))
+				return false;
+		}
+		return true;
+	}
+	if (IsFrame(inA) && IsFrame(inB) && !IsFunction(inA) && !IsFunction(inB)) {
+		if (Length(inA) != Length(inB))
+			return false;
+		RefVar b(inB);
+		FOREACH_WITH_TAG(inA, tag, slot)
+			if (!FrameHasSlot(b, tag) || !SameValue(slot, GetFrameSlot(b, tag)))
+				return false;
+		END_FOREACH
+		return true;
+	}
+	return false;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Is a codeblock a function literal -- func(…) begin … end -- and nothing
+	else? Its instructions are then push literal 0, set-lex-scope, return, so
+	evaluating it can only ever make a closure over that one function.
+	Anything else -- a choice between functions, a call, a global -- could
+	evaluate differently next time.
+	Args:		inCodeBlock
+	Return:	true => it is
+----------------------------------------------------------------------------- */
+
+static bool
+IsFunctionLiteral(RefArg inCodeBlock)
+{
+	if (!IsFrame(inCodeBlock))
+		return false;
+	RefVar instructions(GetFrameSlot(inCodeBlock, SYMA(instructions)));
+	RefVar literals(GetFrameSlot(inCodeBlock, SYMA(literals)));
+	if (!IsBinary(instructions) || Length(instructions) != 3
+	||  !IsArray(literals) || Length(literals) == 0)
+		return false;
+	const unsigned char * code = (const unsigned char *)BinaryData(instructions);
+	return code[0] == kOpPushLiteral0 && code[1] == kOpSetLexScope && code[2] == kOpReturn
+		 && EQRef(ClassOf(GetArraySlot(literals, 0)), SYMA(CodeBlock));
+}
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	C T e m p l a t e C a c h e
+----------------------------------------------------------------------------- */
+
+CTemplateCache::CTemplateCache()
+{
+	fEntries = MakeArray(0);
+	fOptions = MakeArray(kNumOfCompilerOptions);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Prepare for a build: check the compiler options haven’t changed since the
+	last one.
+----------------------------------------------------------------------------- */
+
+void
+CTemplateCache::beginBuild(void)
+{
+	bool isChanged = false;
+	for (ArrayIndex i = 0; i < kNumOfCompilerOptions; ++i) {
+		RefVar option(GetGlobalConstant(MakeSymbol(kCompilerOptions[i])));
+		if (!SameValue(option, GetArraySlot(fOptions, i))) {
+			SetArraySlot(fOptions, i, option);
+			isChanged = true;
+		}
+	}
+	if (isChanged && Length(fEntries) > 0) {
+		flush();
+	}
+}
+
+
+/* -----------------------------------------------------------------------------
+	Discard all entries.
+----------------------------------------------------------------------------- */
+
+void
+CTemplateCache::flush(void)
+{
+	fEntries = MakeArray(0);
+	fIndex.clear();
+	gTemplateCacheStats.flushes++;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the codeblock for some source, compiling it only if we haven’t
+	already.
+	Args:		inSource		NewtonScript source string
+	Return:	codeblock
+----------------------------------------------------------------------------- */
+
+Ref
+CTemplateCache::compile(RefArg inSource)
+{
+	return GetArraySlot(GetArraySlot(fEntries, entryFor(inSource)), kEntryCodeBlock);
+}
+
+
+/* -----------------------------------------------------------------------------
+	Return the value of a script slot.
+	Script slots are usually function literals, so once evaluated the function
+	can be reused for as long as the codeblock is; anything else is evaluated
+	every time, even if it evaluates to a function.
+	Args:		inSource		NewtonScript source string
+	Return:	result of evaluating the source
+----------------------------------------------------------------------------- */
+
+Ref
+CTemplateCache::evaluateFunction(RefArg inSource)
+{
+	RefVar entry(GetArraySlot(fEntries, entryFor(inSource)));
+	RefVar result(GetArraySlot(entry, kEntryFunction));
+	if (NOTNIL(result)) {
+		gTemplateCacheStats.evaluationsSkipped++;
+		return result;
+	}
+	RefVar codeBlock(GetArraySlot(entry, kEntryCodeBlock));
+	result = InterpretBlock(codeBlock, RA(NILREF));
+	if (IsFunction(result) && IsFunctionLiteral(codeBlock)) {
+		SetArraySlot(entry, kEntryFunction, result);
+	}
+	return result;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find the entry for some source, compiling it if it’s new or out of date.
+	Args:		inSource		NewtonScript source string
+	Return:	index of entry in fEntries
+----------------------------------------------------------------------------- */
+
+ArrayIndex
+CTemplateCache::entryFor(RefArg inSource)
+{
+	ULong hash = HashSource(inSource);
+	ArrayIndex index = find(inSource, hash);
+	RefVar entry;
+	if (index != kIndexNotFound) {
+		entry = GetArraySlot(fEntries, index);
+		if (isCurrent(entry)) {
+			gTemplateCacheStats.hits++;
+			return index;
+		}
+		// a constant it uses has changed -- recompile in place
+	} else {
+		if (Length(fEntries) >= kMaxTemplateCacheEntries) {
+			flush();
+		}
+		entry = MakeArray(kEntrySize);
+		SetArraySlot(entry, kEntrySource, Clone(inSource));
+	}
+
+	gTemplateCacheStats.compiles++;
+	SetArraySlot(entry, kEntryCodeBlock, ParseString(inSource));
+	SetArraySlot(entry, kEntryFunction, NILREF);
+	recordDependencies(entry, inSource);
+
+	if (index == kIndexNotFound) {
+		index = Length(fEntries);
+		AddArraySlot(fEntries, entry);
+		fIndex.insert(std::make_pair(hash, index));
+	}
+	return index;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Find an existing entry. The hash only narrows the search; the source must
+	match exactly.
+	Args:		inSource		NewtonScript source string
+				inHash		its hash
+	Return:	index of entry in fEntries, kIndexNotFound if none
+----------------------------------------------------------------------------- */
+
+ArrayIndex
+CTemplateCache::find(RefArg inSource, ULong inHash)
+{
+	auto range = fIndex.equal_range(inHash);
+	for (auto iter = range.first; iter != range.second; ++iter) {
+		Ref source = GetArraySlot(GetArraySlot(fEntries, iter->second), kEntrySource);
+		if (SameValue(source, inSource)) {
+			return iter->second;
+		}
+	}
+	return kIndexNotFound;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Is an entry’s codeblock still valid? It is if every constant it used still
+	has the same value, and none of its other identifiers has since been
+	defined as a constant.
+	Args:		inEntry		cache entry
+	Return:	true => valid
+----------------------------------------------------------------------------- */
+
+bool
+CTemplateCache::isCurrent(RefArg inEntry)
+{
+	RefVar consts(GetAllGlobalConstants());
+	RefVar deps(GetArraySlot(inEntry, kEntryConstants));
+	RefVar tag;
+	for (ArrayIndex i = 0, count = Length(deps); i < count; i += 2) {
+		tag = GetArraySlot(deps, i);
+		if (!FrameHasSlot(consts, tag)
+		||  !SameValue(GetFrameSlot(consts, tag), GetArraySlot(deps, i+1)))
+			return false;
+	}
+	deps = GetArraySlot(inEntry, kEntryVariables);
+	for (ArrayIndex i = 0, count = Length(deps); i < count; ++i) {
+		tag = GetArraySlot(deps, i);
+		if (FrameHasSlot(consts, tag))
+			return false;
+	}
+	return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+	Record the identifiers in some source, split into those that are global
+	constants (with their current value) and those that are not.
+	This is a lexical scan, not a parse: words in strings and comments are
+	included too, which at worst causes an unnecessary recompile.
+	Args:		ioEntry		cache entry
+				inSource		NewtonScript source string
+	Return:	--
+----------------------------------------------------------------------------- */
+
+static inline bool
+IsIdentifierStart(UniChar ch)
+{
+	return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || ch == '_';
+}
+
+static inline bool
+IsIdentifierChar(UniChar ch)
+{
+	return IsIdentifierStart(ch) || (ch >= '0' && ch <= '9');
+}
+
+void
+CTemplateCache::recordDependencies(RefArg ioEntry, RefArg inSource)
+{
+	// take a copy of the source -- making symbols may move it
+	ArrayIndex count = Length(inSource) / sizeof(UniChar);
+	std::vector<UniChar> source((const UniChar *)BinaryData(inSource), (const UniChar *)BinaryData(inSource) + count);
+
+	std::set<std::string> words;
+	for (ArrayIndex i = 0; i < count; ) {
+		if (IsIdentifierStart(source[i]) && (i == 0 || !IsIdentifierChar(source[i-1]))) {
+			std::string word;
+			for ( ; i < count && IsIdentifierChar(source[i]); ++i) {
+				word += (char)source[i];
+			}
+			words.insert(word);
+		} else {
+			++i;
+		}
+	}
+
+	RefVar consts(GetAllGlobalConstants());
+	RefVar constDeps(MakeArray(0));
+	RefVar varDeps(MakeArray(0));
+	RefVar tag;
+	for (const std::string & word : words) {
+		tag = MakeSymbol(word.c_str());
+		if (FrameHasSlot(consts, tag)) {
+			AddArraySlot(constDeps, tag);
+			AddArraySlot(constDeps, GetFrameSlot(consts, tag));
+		} else {
+			AddArraySlot(varDeps, tag);
+		}
+	}
+	SetArraySlot(ioEntry, kEntryConstants, constDeps);
+	SetArraySlot(ioEntry, kEntryVariables, varDeps);
+}
@@ -0,0 +1,346 @@
+/*
+	File:		TextConvert.cc
+
+	Contains:	Conversion of text between MacRoman, UTF-8 and UniChar.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#include "TextConvert.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define hasSSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define hasNEON 1
+#endif
+
+
+/* -----------------------------------------------------------------------------
+	M a c R o m a n   t a b l e
+	UniChar for MacRoman 0x80..0xFF; below that MacRoman is ASCII.
+----------------------------------------------------------------------------- */
+
+static const TextChar gMacRomanHigh[128] =
+{
+	0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+	0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+	0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+	0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+	0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+	0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+	0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+	0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+	0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+	0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+	0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+	0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
+	0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+	0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+	0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+	0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+
+#pragma mark SIMD
+/* -----------------------------------------------------------------------------
+	Sixteen characters at a time.
+	IsASCII16		are 16 bytes all ASCII?
+	Widen16			16 bytes => 16 UniChars
+	IsASCII16Wide	are 16 UniChars all ASCII?
+	Narrow16			16 UniChars => 16 bytes
+	ConvertLF16		LF => CR in 16 UniChars; return number changed
+----------------------------------------------------------------------------- */
+#if hasSSE2
+
+static inline bool
+IsASCII16(const uint8_t * inStr)
+{
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)inStr)) == 0;
+}
+
+static inline void
+Widen16(const uint8_t * inStr, TextChar * outStr)
+{
+	const __m128i src = _mm_loadu_si128((const __m128i *)inStr);
+	const __m128i zero = _mm_setzero_si128();
+	_mm_storeu_si128((__m128i *)outStr, _mm_unpacklo_epi8(src, zero));
+	_mm_storeu_si128((__m128i *)(outStr + 8), _mm_unpackhi_epi8(src, zero));
+}
+
+static inline bool
+IsASCII16Wide(const TextChar * inStr)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)inStr);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)(inStr + 8));
+	const __m128i nonASCII = _mm_and_si128(_mm_or_si128(lo, hi), _mm_set1_epi16((short)0xFF80));
+	return _mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static inline void
+Narrow16(const TextChar * inStr, uint8_t * outStr)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)inStr);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)(inStr + 8));
+	_mm_storeu_si128((__m128i *)outStr, _mm_packus_epi16(lo, hi));
+}
+
+static inline size_t
+ConvertLF16(TextChar * ioStr)
+{
+	const __m128i lf = _mm_set1_epi16(0x0A);
+	const __m128i lfxorcr = _mm_set1_epi16(0x0A ^ 0x0D);
+	__m128i lo = _mm_loadu_si128((const __m128i *)ioStr);
+	__m128i hi = _mm_loadu_si128((const __m128i *)(ioStr + 8));
+	const __m128i isLFlo = _mm_cmpeq_epi16(lo, lf);
+	const __m128i isLFhi = _mm_cmpeq_epi16(hi, lf);
+	int mask = _mm_movemask_epi8(_mm_packs_epi16(isLFlo, isLFhi));
+	if (mask == 0)
+		return 0;
+	_mm_storeu_si128((__m128i *)ioStr, _mm_xor_si128(lo, _mm_and_si128(isLFlo, lfxorcr)));
+	_mm_storeu_si128((__m128i *)(ioStr + 8), _mm_xor_si128(hi, _mm_and_si128(isLFhi, lfxorcr)));
+	return __builtin_popcount(mask);
+}
+
+#elif hasNEON
+
+static inline bool
+IsASCII16(const uint8_t * inStr)
+{
+	return vmaxvq_u8(vld1q_u8(inStr)) < 0x80;
+}
+
+static inline void
+Widen16(const uint8_t * inStr, TextChar * outStr)
+{
+	const uint8x16_t src = vld1q_u8(inStr);
+	vst1q_u16(outStr, vmovl_u8(vget_low_u8(src)));
+	vst1q_u16(outStr + 8, vmovl_high_u8(src));
+}
+
+static inline bool
+IsASCII16Wide(const TextChar * inStr)
+{
+	return vmaxvq_u16(vorrq_u16(vld1q_u16(inStr), vld1q_u16(inStr + 8))) < 0x80;
+}
+
+static inline void
+Narrow16(const TextChar * inStr, uint8_t * outStr)
+{
+	vst1q_u8(outStr, vcombine_u8(vmovn_u16(vld1q_u16(inStr)), vmovn_u16(vld1q_u16(inStr + 8))));
+}
+
+static inline size_t
+ConvertLF16(TextChar * ioStr)
+{
+	const uint16x8_t lf = vdupq_n_u16(0x0A);
+	const uint16x8_t lfxorcr = vdupq_n_u16(0x0A ^ 0x0D);
+	uint16x8_t lo = vld1q_u16(ioStr);
+	uint16x8_t hi = vld1q_u16(ioStr + 8);
+	const uint16x8_t isLFlo = vceqq_u16(lo, lf);
+	const uint16x8_t isLFhi = vceqq_u16(hi, lf);
+	// each match is 0xFFFF; count them 1 apiece
+	size_t count = vaddvq_u16(vshrq_n_u16(isLFlo, 15)) + vaddvq_u16(vshrq_n_u16(isLFhi, 15));
+	if (count == 0)
+		return 0;
+	vst1q_u16(ioStr, veorq_u16(lo, vandq_u16(isLFlo, lfxorcr)));
+	vst1q_u16(ioStr + 8, veorq_u16(hi, vandq_u16(isLFhi, lfxorcr)));
+	return count;
+}
+
+#endif
+#define hasSIMD (hasSSE2 || hasNEON)
+
+
+#pragma mark -
+/* -----------------------------------------------------------------------------
+	MacRoman => UniChar.
+----------------------------------------------------------------------------- */
+
+size_t
+MacRomanToUniChar(const uint8_t * inStr, size_t inLen, TextChar * outStr)
+{
+	size_t i = 0;
+#if hasSIMD
+	for ( ; i + 16 <= inLen; i += 16) {
+		if (IsASCII16(inStr + i))
+			Widen16(inStr + i, outStr + i);
+		else
+			for (size_t j = i; j < i + 16; ++j) {
+				uint8_t ch = inStr[j];
+				outStr[j] = ch < 0x80 ? ch : gMacRomanHigh[ch - 0x80];
+			}
+	}
+#endif
+	for ( ; i < inLen; ++i) {
+		uint8_t ch = inStr[i];
+		outStr[i] = ch < 0x80 ? ch : gMacRomanHigh[ch - 0x80];
+	}
+	return inLen;
+}
+
+
+/* -----------------------------------------------------------------------------
+	UTF-8 => UniChar.
+	Decode one non-ASCII sequence.
+	Args:		inStr			lead byte
+				inLen			bytes available from there
+				outChar		code point; kReplacementChar if ill-formed
+	Return:	number of bytes used
+----------------------------------------------------------------------------- */
+
+static inline size_t
+DecodeUTF8(const uint8_t * inStr, size_t inLen, uint32_t & outChar)
+{
+	uint8_t lead = inStr[0];
+	size_t seqLen;
+	uint32_t ch, minChar;
+	if (lead >= 0xC2 && lead <= 0xDF) {
+		seqLen = 2; ch = lead & 0x1F; minChar = 0x80;
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		seqLen = 3; ch = lead & 0x0F; minChar = 0x800;
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		seqLen = 4; ch = lead & 0x07; minChar = 0x10000;
+	} else {
+		// stray continuation byte, or a lead byte that can only start an overlong or out-of-range sequence
+		outChar = kReplacementChar;
+		return 1;
+	}
+	if (seqLen > inLen) {
+		outChar = kReplacementChar;
+		return 1;
+	}
+	for (size_t i = 1; i < seqLen; ++i) {
+		uint8_t trail = inStr[i];
+		if ((trail & 0xC0) != 0x80) {
+			outChar = kReplacementChar;
+			return 1;
+		}
+		ch = (ch << 6) | (trail & 0x3F);
+	}
+	if (ch < minChar || ch > 0x10FFFF || (ch >= 0xD800 && ch <= 0xDFFF)) {
+		outChar = kReplacementChar;
+		return 1;
+	}
+	outChar = ch;
+	return seqLen;
+}
+
+
+size_t
+UTF8ToUniChar(const uint8_t * inStr, size_t inLen, TextChar * outStr)
+{
+	size_t i = 0, outLen = 0;
+	while (i < inLen) {
+#if hasSIMD
+		if (i + 16 <= inLen && IsASCII16(inStr + i)) {
+			if (outStr)
+				Widen16(inStr + i, outStr + outLen);
+			i += 16;
+			outLen += 16;
+			continue;
+		}
+#endif
+		uint8_t ch = inStr[i];
+		if (ch < 0x80) {
+			if (outStr)
+				outStr[outLen] = ch;
+			++i;
+			++outLen;
+			continue;
+		}
+		uint32_t codePoint;
+		i += DecodeUTF8(inStr + i, inLen - i, codePoint);
+		if (codePoint >= 0x10000) {
+			if (outStr) {
+				codePoint -= 0x10000;
+				outStr[outLen] = 0xD800 + (codePoint >> 10);
+				outStr[outLen + 1] = 0xDC00 + (codePoint & 0x03FF);
+			}
+			outLen += 2;
+		} else {
+			if (outStr)
+				outStr[outLen] = codePoint;
+			++outLen;
+		}
+	}
+	return outLen;
+}
+
+
+/* -----------------------------------------------------------------------------
+	UniChar => UTF-8.
+----------------------------------------------------------------------------- */
+
+size_t
+UniCharToUTF8(const TextChar * inStr, size_t inLen, uint8_t * outStr)
+{
+	size_t i = 0, outLen = 0;
+	while (i < inLen) {
+#if hasSIMD
+		if (i + 16 <= inLen && IsASCII16Wide(inStr + i)) {
+			if (outStr)
+				Narrow16(inStr + i, outStr + outLen);
+			i += 16;
+			outLen += 16;
+			continue;
+		}
+#endif
+		uint32_t ch = inStr[i++];
+		if (ch >= 0xD800 && ch <= 0xDFFF) {
+			if (ch <= 0xDBFF && i < inLen && inStr[i] >= 0xDC00 && inStr[i] <= 0xDFFF)
+				ch = 0x10000 + ((ch - 0xD800) << 10) + (inStr[i++] - 0xDC00);
+			else
+				ch = kReplacementChar;
+		}
+		if (ch < 0x80) {
+			if (outStr)
+				outStr[outLen] = ch;
+			outLen += 1;
+		} else if (ch < 0x800) {
+			if (outStr) {
+				outStr[outLen] = 0xC0 | (ch >> 6);
+				outStr[outLen + 1] = 0x80 | (ch & 0x3F);
+			}
+			outLen += 2;
+		} else if (ch < 0x10000) {
+			if (outStr) {
+				outStr[outLen] = 0xE0 | (ch >> 12);
+				outStr[outLen + 1] = 0x80 | ((ch >> 6) & 0x3F);
+				outStr[outLen + 2] = 0x80 | (ch & 0x3F);
+			}
+			outLen += 3;
+		} else {
+			if (outStr) {
+				outStr[outLen] = 0xF0 | (ch >> 18);
+				outStr[outLen + 1] = 0x80 | ((ch >> 12) & 0x3F);
+				outStr[outLen + 2] = 0x80 | ((ch >> 6) & 0x3F);
+				outStr[outLen + 3] = 0x80 | (ch & 0x3F);
+			}
+			outLen += 4;
+		}
+	}
+	return outLen;
+}
+
+
+/* -----------------------------------------------------------------------------
+	LF => CR.
+----------------------------------------------------------------------------- */
+
+size_t
+ConvertLineEndings(TextChar * ioStr, size_t inLen)
+{
+	size_t i = 0, count = 0;
+#if hasSIMD
+	for ( ; i + 16 <= inLen; i += 16)
+		count += ConvertLF16(ioStr + i);
+#endif
+	for ( ; i < inLen; ++i)
+		if (ioStr[i] == 0x0A) {
+			ioStr[i] = 0x0D;
+			++count;
+		}
+	return count;
+}
@@ -0,0 +1,73 @@
+/*
+	File:		TextConvert.h
+
+	Contains:	Conversion of text between MacRoman, UTF-8 and UniChar.
+					NewtonScript strings are UniChar (UTF-16) in host byte order,
+					terminated by a zero UniChar; desktop text is UTF-8 or, in legacy
+					projects, MacRoman.
+					Most of the text we convert -- slot names, file paths, source --
+					is ASCII, so each conversion checks sixteen bytes at a time with
+					SSE2 or NEON and widens or narrows them in one go; anything else is
+					converted a character at a time.
+					There are no length limits, and each conversion can be asked for
+					the length of its result first so that the caller can convert
+					straight into storage of exactly the right size.
+					This is plain C++ with no dependency on the NewtonScript world.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#if !defined(__TEXTCONVERT_H)
+#define __TEXTCONVERT_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint16_t TextChar;		// same as UniChar
+
+#define kReplacementChar	0xFFFD
+
+
+/* -----------------------------------------------------------------------------
+	Convert MacRoman to UniChar. Every byte makes one UniChar.
+	Args:		inStr			MacRoman text
+				inLen			its length in bytes
+				outStr		room for inLen UniChars
+	Return:	number of UniChars
+----------------------------------------------------------------------------- */
+
+extern size_t	MacRomanToUniChar(const uint8_t * inStr, size_t inLen, TextChar * outStr);
+
+/* -----------------------------------------------------------------------------
+	Convert UTF-8 to UniChar.
+	Ill-formed sequences -- overlong, surrogate, out of range or truncated --
+	are replaced by kReplacementChar, one per byte.
+	Args:		inStr			UTF-8 text
+				inLen			its length in bytes
+				outStr		NULL => count only
+	Return:	number of UniChars
+----------------------------------------------------------------------------- */
+
+extern size_t	UTF8ToUniChar(const uint8_t * inStr, size_t inLen, TextChar * outStr);
+
+/* -----------------------------------------------------------------------------
+	Convert UniChar to UTF-8.
+	Unpaired surrogates are replaced by kReplacementChar.
+	Args:		inStr			UniChar text
+				inLen			its length in UniChars
+				outStr		NULL => count only
+	Return:	number of bytes
+----------------------------------------------------------------------------- */
+
+extern size_t	UniCharToUTF8(const TextChar * inStr, size_t inLen, uint8_t * outStr);
+
+/* -----------------------------------------------------------------------------
+	Make line endings Newton-style: LF => CR, in place.
+	Args:		ioStr			UniChar text
+				inLen			its length in UniChars
+	Return:	number of line endings changed
+----------------------------------------------------------------------------- */
+
+extern size_t	ConvertLineEndings(TextChar * ioStr, size_t inLen);
+
+#endif	/* __TEXTCONVERT_H */
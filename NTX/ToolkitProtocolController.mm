@@ -47,6 +47,8 @@
 #import "NTKProtocol.h"
 #import "DockErrors.h"
 #import "PreferenceKeys.h"
+#import "StreamPipe.h"
+#import "BufferPipe.h"
 #import "NTK/Globals.h"
 
 
@@ -54,6 +56,9 @@ extern NewtonErr	GetPackageDetails(NSURL * inURL, NSString ** outName, unsigned
 extern "C" const char *	GetFramesErrorString(int inErr);
 extern void			PrintFramesErrorMsg(const char * inStr, RefArg inData);
 
+// largest flattened object we’ll accept from the Newton
+#define kMaxToolkitObjectSize (64*MByte)
+
 
 /* -----------------------------------------------------------------------------
 	N o t i f i c a t i o n s
@@ -253,6 +258,11 @@ NTXToolkitProtocolController * gNTXNub = nil;
 }
 
 
+- (NewtonErr)sendData:(dispatch_data_t)inData {
+	return [ep.endpoint writeData:inData];
+}
+
+
 /* -----------------------------------------------------------------------------
 	Read word from Newton.
 ----------------------------------------------------------------------------- */
@@ -332,24 +342,36 @@ if (err) NSLog(@"-[NTXToolkitProtocolController readCommand:length:] error = %d"
 }
 
 
+/* -----------------------------------------------------------------------------
+	Read flattened object from Newton.
+	Rather than buffer the whole object we unflatten it straight off the
+	input stream, so decoding starts with the first bytes and memory use is
+	bounded by the pipe’s read-ahead buffer.
+	Objects larger than kMaxToolkitObjectSize are skipped.
+----------------------------------------------------------------------------- */
+
 - (Ref)readRef:(NSUInteger)inLength {
 	NewtonErr err = noErr;
-	char * buf = NULL;
 	RefVar rref;
 
-	XTRY
-	{
-		buf = (char *)malloc(inLength);
-		XFAILNOT(buf, err = kOSErrNoMemory;)
-		err = [self read:buf length:inLength];
-
-		CPtrPipe pipe;
-		pipe.init(buf, inLength, NO, nil);
-		rref = UnflattenRef(pipe);
+	CStreamPipe pipe(^NewtonErr(char * outBuf, size_t inSize) { return [self read:outBuf length:inSize]; }, inLength);
+	if (inLength > kMaxToolkitObjectSize) {
+		NSLog(@"-[NTXToolkitProtocolController readRef:] object too large (%lu bytes)", (unsigned long)inLength);
+	} else if ((err = pipe.error()) == noErr) {
+		newton_try
+		{
+			rref = UnflattenRef(pipe);
+		}
+		newton_catch_all
+		{
+			err = (NewtonErr)(long)CurrentException()->data;
+			rref = NILREF;
+		}
+		end_try;
 	}
-	XENDTRY;
-	if (buf)
-		free(buf);
+	// keep the stream in step with the protocol, whatever happened
+	pipe.drain();
+if (err) NSLog(@"-[NTXToolkitProtocolController readRef:] error = %d",err);
 
 	return rref;
 }
@@ -414,22 +436,27 @@ if (inLength > 0) printf("[%ld] ", (unsigned long)inLength);
 ----------------------------------------------------------------------------- */
 
 - (NewtonErr)sendCommand:(EventType)inCmd data:(char *)inData length:(NSUInteger)inLength {
-	NewtonErr	err = noErr;
-	XTRY
-	{
-		XFAIL(err = [self sendCommand:inCmd length:inLength])
-		XFAIL(err = [self send:inData length:inLength])
+	if (inData == NULL || inLength == 0) {
+		return [self sendCommand:inCmd length:inLength];
+	}
 
-		NSUInteger padLength = inLength & 0x03;
-		if (padLength != 0)
-		{
-		// pad with zeroes
-			ULong padding = 0;
-			err = [self send: (char *)&padding length: 4 - padLength];
-		}
+#if kDebugOn
+printf("\n%c%c%c%c --> [%ld] ", (inCmd >> 24) & 0xFF, (inCmd >> 16) & 0xFF, (inCmd >> 8) & 0xFF, inCmd & 0xFF, (unsigned long)inLength);
+#endif
+
+	// build header, data and zero padding in one buffer that the endpoint writes from directly
+	size_t eventLength = 4*sizeof(ULong) + ALIGN(inLength, 4);
+	ULong * event = (ULong *)malloc(eventLength);
+	if (event == NULL) {
+		return kOSErrNoMemory;
 	}
-	XENDTRY;
-	return err;
+	event[0] = CANONICAL_LONG(kNewtEventClass);
+	event[1] = CANONICAL_LONG(kToolkitEventId);
+	event[2] = CANONICAL_LONG(inCmd);
+	event[3] = CANONICAL_LONG(inLength);
+	memcpy(event + 4, inData, inLength);
+	memset((char *)(event + 4) + inLength, 0, eventLength - 4*sizeof(ULong) - inLength);
+	return [self sendData:dispatch_data_create(event, eventLength, NULL, DISPATCH_DATA_DESTRUCTOR_FREE)];
 }
 
 
@@ -667,7 +694,9 @@ extern void REPExceptionNotify(Exception * inException);
 	[inScript getCharacters:str range:NSMakeRange(0, strLen)];
 	str[strLen] = 0;
 
-	char * codeBlockData = NULL;
+	// flatten in a single pass into a buffer that grows as required
+	// (declared outside the try block so it’s destroyed whatever happens)
+	CBufferPipe pipe;
 
 	newton_try
 	{
@@ -676,17 +705,12 @@ extern void REPExceptionNotify(Exception * inException);
 		free(str), str = NULL;
 
 		// prepare data
-		NSUInteger objLength = FlattenRefSize(codeBlock);
 		// kTCode requires ULong (unused by Newton -- of unknown purpose) before the codeBlock NSOF
-		NSUInteger dataLength = sizeof(ULong) + objLength;
-		codeBlockData = (char *)malloc(dataLength);
-		memset(codeBlockData, 0, sizeof(ULong));
-
-		CPtrPipe pipe;
-		pipe.init(codeBlockData + sizeof(ULong), objLength, NO, nil);
+		ULong unused = 0;
+		pipe.writeChunk(&unused, sizeof(ULong), false);
 		FlattenRef(codeBlock, pipe);
 
-		[self sendCommand:kTCode data:codeBlockData length:dataLength];
+		[self sendCommand:kTCode data:pipe.data() length:pipe.size()];
 	}
 	newton_catch_all
 	{
@@ -695,8 +719,6 @@ extern void REPExceptionNotify(Exception * inException);
 	end_try;
 	if (str)
 		free(str);
-	if (codeBlockData)
-		free(codeBlockData);
 }
 
 
@@ -708,6 +730,8 @@ extern void REPExceptionNotify(Exception * inException);
 - (void)installPackage:(NSURL *)inPackage {
 	NSString * pkgName = inPackage.lastPathComponent;
 	NSData * pkgData = [NSData dataWithContentsOfURL:inPackage];
+	// the endpoint writes chunks straight from pkgData, which the destructor holds on to until they’re written
+	dispatch_data_t pkg = dispatch_data_create(pkgData.bytes, pkgData.length, NULL, ^{ (void)pkgData; });
 // send in chunks and provide progress feedback
 	self.delegate.progress.completedUnitCount = 0;
 	self.delegate.progress.totalUnitCount = (pkgData.length - 1) / kChunkSize + 1;
@@ -724,7 +748,7 @@ extern void REPExceptionNotify(Exception * inException);
 				if (chunkSize > amountRemaining)
 					chunkSize = amountRemaining;
 NSLog(@"-[NTXToolkitProtocolController installPackage:“%@”] sending %d bytes", pkgName, chunkSize);
-				err = [self send:(char *)pkgData.bytes + amountDone length:chunkSize];
+				err = [self sendData:dispatch_data_create_subrange(pkg, amountDone, chunkSize)];
 				if (err) {
 					break;
 				}
@@ -9,6 +9,8 @@
 #import <Foundation/Foundation.h>
 #include "NewtonKit.h"
 
+@class NSImage;
+
 
 extern Ref			SetBoundsRect(RefArg ioFrame, const Rect * inBounds);
 extern Ref			ToObject(const Rect * inBounds);
@@ -26,6 +28,10 @@ extern Ref			BuildFileInfo(NSString * inPath, NSString * inFile);
 
 extern NSString *	GetPackageDetails(NSString * inPath, unsigned int * outSize);
 
+extern NSDictionary *	BenchmarkTextConversion(void);
+
+extern NSImage *	MakeImageFromPixelMap(const void * inBits, size_t inRowBytes, unsigned inDepth, const void * inMask, size_t inMaskRowBytes, unsigned inWidth, unsigned inHeight);
+
 extern NSURL *		ApplicationSupportFolder(void);
 extern NSURL *		ApplicationSupportFile(NSString * inFilename);
 extern NSURL *		ApplicationLogFile(void);
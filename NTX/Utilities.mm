@@ -6,10 +6,12 @@
 	Written by:	Newton Research Group, 2005.
 */
 
+#import <AppKit/AppKit.h>
 #import "Utilities.h"
+#import "PixelMapConvert.h"
+#import "TextConvert.h"
 #import "NTK/PackageParts.h"
-
-extern Ref MakeStringOfLength(const UniChar * str, ArrayIndex numChars);
+#include <vector>
 
 NSString * gDesktopName;
 
@@ -72,20 +74,13 @@ MakeNSString(RefArg inStr)
 Ref
 MakeString(NSString * inStr)
 {
-	RefVar s;
-	UniChar buf[128];
-	UniChar * str = buf;
-	ArrayIndex strLen = [inStr length];
-	if (strLen > 128)
-		str = (UniChar *) malloc(strLen*sizeof(UniChar));
-	[inStr getCharacters: str];
+	ArrayIndex strLen = (ArrayIndex)inStr.length;
+	RefVar s(AllocateBinary(SYMA(string), (strLen + 1) * sizeof(UniChar)));
+	UniChar * str = (UniChar *) BinaryData(s);
+	[inStr getCharacters: str range: NSMakeRange(0, strLen)];
+	str[strLen] = kEndOfString;
 	// NO LINEFEEDS!
-	for (UniChar * p = str; p < str + strLen; p++)
-		if (*p == 0x0A)
-			*p = 0x0D;
-	s = MakeStringOfLength(str, strLen);
-	if (str != buf)
-		free(str);
+	ConvertLineEndings(str, strLen);
 	return s;
 }
 
@@ -214,3 +209,150 @@ ApplicationLogFile(void)
 	return [url URLByAppendingPathComponent: @"NewtonToolkit.log"];
 }
 
+
+/*------------------------------------------------------------------------------
+	Make an image from Newton PixelMap bits.
+	The bits are expanded to a buffer and handed to CoreGraphics whole: gray if
+	there is no mask, else RGBA.
+	Args:		inBits			first row of bits
+				inRowBytes		row stride
+				inDepth			bits per pixel
+				inMask			first row of 1-bit mask; NULL => none
+				inMaskRowBytes	mask row stride
+				inWidth			in pixels
+				inHeight
+	Return:	an NSImage; nil if the bits can’t be expanded
+------------------------------------------------------------------------------*/
+
+NSImage *
+MakeImageFromPixelMap(const void * inBits, size_t inRowBytes, unsigned inDepth, const void * inMask, size_t inMaskRowBytes, unsigned inWidth, unsigned inHeight)
+{
+	if (inWidth == 0 || inHeight == 0)
+		return nil;
+
+	size_t pixelBytes = inMask ? 4 : 1;
+	NSMutableData * pixels = [NSMutableData dataWithLength:pixelBytes * inWidth * inHeight];
+	bool isExpanded = inMask ? ExpandPixelMapToRGBA((const uint8_t *)inBits, inRowBytes, inDepth, (const uint8_t *)inMask, inMaskRowBytes, inWidth, inHeight, (uint8_t *)pixels.mutableBytes, 4 * inWidth)
+									 : ExpandPixelMapToGray((const uint8_t *)inBits, inRowBytes, inDepth, inWidth, inHeight, (uint8_t *)pixels.mutableBytes, inWidth);
+	if (!isExpanded)
+		return nil;
+
+	CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)pixels);
+	CGColorSpaceRef colorSpace = inMask ? CGColorSpaceCreateDeviceRGB() : CGColorSpaceCreateDeviceGray();
+	CGImageRef cgImage = CGImageCreate(inWidth, inHeight, 8, 8 * pixelBytes, pixelBytes * inWidth, colorSpace,
+												  inMask ? kCGImageAlphaPremultipliedLast : kCGImageAlphaNone,
+												  provider, NULL, false, kCGRenderingIntentDefault);
+	CGColorSpaceRelease(colorSpace);
+	CGDataProviderRelease(provider);
+	if (cgImage == NULL)
+		return nil;
+
+	NSImage * image = [[NSImage alloc] initWithCGImage:cgImage size:NSMakeSize(inWidth, inHeight)];
+	CGImageRelease(cgImage);
+	return image;
+}
+
+
+/*------------------------------------------------------------------------------
+	Check text conversion against Foundation and time it.
+	Random strings -- mostly ASCII, with some of every UTF-8 length -- are
+	converted both ways and must match what NSString makes of them, and must
+	round-trip. Then a large ASCII-heavy text is converted both ways.
+	Args:		--
+	Return:	results, for JSON
+------------------------------------------------------------------------------*/
+
+NSDictionary *
+BenchmarkTextConversion(void)
+{
+	const NSUInteger kNumOfTrials = 100000;
+	NSUInteger numOfMismatches = 0;
+	srandom(1);
+	std::vector<UniChar> chars;
+	std::vector<UniChar> back;
+	std::vector<uint8_t> bytes;
+	for (NSUInteger trial = 0; trial < kNumOfTrials; ++trial) {
+		chars.clear();
+		size_t numOfChars = random() % 100;
+		for (size_t i = 0; i < numOfChars; ++i) {
+			uint32_t ch, kind = random() % 10;
+			if (kind < 6)
+				ch = random() % 0x80;
+			else if (kind < 8)
+				ch = 0x80 + random() % 0x780;
+			else if (kind < 9) {
+				do ch = 0x800 + random() % 0xF800; while (ch >= 0xD800 && ch <= 0xDFFF);
+			} else
+				ch = 0x10000 + random() % 0x100000;
+			if (ch >= 0x10000) {
+				chars.push_back(0xD800 + ((ch - 0x10000) >> 10));
+				chars.push_back(0xDC00 + ((ch - 0x10000) & 0x03FF));
+			} else
+				chars.push_back(ch);
+		}
+		NSString * str = [NSString stringWithCharacters:chars.data() length:chars.size()];
+
+		// UniChar => UTF-8
+		const char * utf8 = str.UTF8String;
+		size_t len = UniCharToUTF8(chars.data(), chars.size(), NULL);
+		bytes.resize(len);
+		UniCharToUTF8(chars.data(), chars.size(), bytes.data());
+		if (len != strlen(utf8) || memcmp(bytes.data(), utf8, len) != 0)
+			++numOfMismatches;
+
+		// UTF-8 => UniChar
+		size_t backLen = UTF8ToUniChar(bytes.data(), len, NULL);
+		back.resize(backLen);
+		UTF8ToUniChar(bytes.data(), len, back.data());
+		if (backLen != chars.size() || memcmp(back.data(), chars.data(), backLen * sizeof(UniChar)) != 0)
+			++numOfMismatches;
+
+		// MacRoman => UniChar, using the UTF-8 bytes as MacRoman
+		NSString * macStr = [[NSString alloc] initWithBytes:bytes.data() length:len encoding:NSMacOSRomanStringEncoding];
+		back.resize(len);
+		MacRomanToUniChar(bytes.data(), len, back.data());
+		if (macStr.length != len || ![macStr isEqualToString:[NSString stringWithCharacters:back.data() length:len]])
+			++numOfMismatches;
+	}
+
+	// throughput on 16MB of source-like text
+	const size_t kTextLen = 16*MByte;
+	std::vector<uint8_t> text(kTextLen);
+	for (size_t i = 0; i < kTextLen; ++i)
+		text[i] = (i % 64 == 63) ? 0x0A : (random() % 50 == 0) ? 0xC3 : 0x20 + random() % 0x5F;
+	for (size_t i = 0; i < kTextLen - 1; ++i)
+		if (text[i] == 0xC3)
+			text[++i] = 0xA9;		// é
+	std::vector<UniChar> wide(kTextLen);
+	std::vector<uint8_t> narrow(kTextLen);
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	size_t wideLen = UTF8ToUniChar(text.data(), kTextLen, wide.data());
+	double utf8ToUniChar = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	NSString * textStr = [[NSString alloc] initWithBytes:text.data() length:kTextLen encoding:NSUTF8StringEncoding];
+	[textStr getCharacters:wide.data() range:NSMakeRange(0, wideLen)];
+	double foundationUTF8ToUniChar = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	UniCharToUTF8(wide.data(), wideLen, narrow.data());
+	double uniCharToUTF8 = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	MacRomanToUniChar(text.data(), kTextLen, wide.data());
+	double macRomanToUniChar = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	ConvertLineEndings(wide.data(), kTextLen);
+	double lineEndings = CFAbsoluteTimeGetCurrent() - start;
+
+	return @{ @"trials":[NSNumber numberWithUnsignedInteger:kNumOfTrials],
+				 @"mismatches":[NSNumber numberWithUnsignedInteger:numOfMismatches],
+				 @"textBytes":@(kTextLen),
+				 @"utf8ToUniCharMBps":@(kTextLen / MByte / utf8ToUniChar),
+				 @"foundationUTF8ToUniCharMBps":@(kTextLen / MByte / foundationUTF8ToUniChar),
+				 @"uniCharToUTF8MBps":@(kTextLen / MByte / uniCharToUTF8),
+				 @"macRomanToUniCharMBps":@(kTextLen / MByte / macRomanToUniChar),
+				 @"lineEndingsMBps":@(kTextLen / MByte / lineEndings) };
+}
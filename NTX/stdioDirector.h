@@ -19,8 +19,17 @@
 		example are not redirected. I consider this a good thing, but if more
 		universal redirecting is needed, it can be done at file descriptor
 		level.
+
+	@note Writes are copied into a ring buffer, which is drained on the main
+		thread shortly after the first write into it -- or at once if it is
+		filling up -- so that a burst of output reaches the listener in a few
+		large chunks rather than a message per write. If it fills while the
+		main thread is busy, other threads’ output is dropped, and the
+		listener is told how much.
 ------------------------------------------------------------------------------*/
 
+struct OutputRing;
+
 @interface NTXOutputRedirect : NSObject
 {
 	id listener;
@@ -32,6 +41,13 @@
 	
 	// Pointer to old write function for the stream.
 	int	(*oldWriteFunc)(void *, const char *, int);
+
+	// Buffer of output not yet forwarded, and how we’re told to forward it.
+	struct OutputRing * ring;
+	dispatch_source_t drainSignal;
+	BOOL isDrainScheduled;
+	// Trailing bytes of an incomplete UTF-8 sequence, held until the rest arrives.
+	NSMutableData * partial;
 }
 
 + (id) redirect_stdout;
@@ -8,6 +8,34 @@
 */
 
 #import "stdioDirector.h"
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define kOutputRingSize			(64*1024)
+#define kOutputHighWater		(kOutputRingSize/2)
+#define kOutputDrainDelay		50		// milliseconds from first write to delivery
+#define kOutputFullWait			20		// milliseconds a writer waits for a full ring to drain
+
+// what a writer asks of the drain signal
+#define kDrainSoon				1
+#define kDrainNow					2
+
+/**
+ * Ring buffer of output. head and tail are running byte counts; only the
+ * writer advances head, only the main thread advances tail. stdio locks the
+ * stream around _write, so there is only ever one writer at a time.
+ * dropped counts output that didn’t fit, since the last drain.
+ */
+struct OutputRing
+{
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+	_Atomic uint64_t dropped;
+	char data[kOutputRingSize];
+};
+
+static struct OutputRing g_stdoutRing;
+static struct OutputRing g_stderrRing;
 
 /// Global pointer to NTXOutputRedirect object that manages redirects for stdout.
 static NTXOutputRedirect * g_stdoutDirector = nil;
@@ -19,33 +47,100 @@ static NTXOutputRedirect * g_stderrDirector = nil;
 - (id) initWithStream: (FILE *) aStream selector: (SEL) aSelector;
 - (void) startRedirect;
 - (void) stopRedirect;
-- (void) forwardOutput: (NSData *) data;
+- (void) requestDrain: (unsigned long) urgency;
+- (void) drain;
+- (void) forwardOutput: (NSMutableData *) data;
 @end
 
 /**
- * Function that replaces stdout->_write and forwards stdout to g_stdoutDirector.
+ * Copies output into a director’s ring. This never allocates or messages
+ * the main thread, except to ask for the ring to be drained when it goes from
+ * empty to not, or passes its high-water mark.
+ * If the ring is full, output from the main thread is forwarded there and
+ * then. Any other thread waits a little for the main thread to drain it --
+ * but the main thread may itself be waiting for this one, so after that the
+ * output is dropped and counted, and until the next drain nothing waits.
  */
-int stdoutwrite(void * inFD, const char * buffer, int size)
+static int ringwrite(NTXOutputRedirect * director, struct OutputRing * ring, const char * buffer, int size)
 {
-	@autoreleasepool
+	int remaining = size;
+	int waited = 0;
+	while (remaining > 0)
 	{
-		NSData * data = [[NSData alloc] initWithBytes: buffer length: size];
-		[g_stdoutDirector performSelectorOnMainThread:@selector(forwardOutput:) withObject:data waitUntilDone:NO];
+		uint64_t h = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		uint64_t used = h - atomic_load_explicit(&ring->tail, memory_order_acquire);
+		size_t space = kOutputRingSize - (size_t)used;
+		if (space == 0)
+		{
+			if ([NSThread isMainThread])
+				[director drain];
+			else if (waited < kOutputFullWait && atomic_load_explicit(&ring->dropped, memory_order_relaxed) == 0)
+			{
+				[director requestDrain:kDrainNow];
+				usleep(1000);
+				++waited;
+			}
+			else
+			{
+				atomic_fetch_add_explicit(&ring->dropped, remaining, memory_order_relaxed);
+				break;
+			}
+			continue;
+		}
+
+		size_t count = MIN(space, (size_t)remaining);
+		size_t index = (size_t)(h % kOutputRingSize);
+		size_t spaceAfter = kOutputRingSize - index;
+		if (count <= spaceAfter)
+			memcpy(ring->data + index, buffer, count);
+		else
+		{
+			memcpy(ring->data + index, buffer, spaceAfter);
+			memcpy(ring->data, buffer + spaceAfter, count - spaceAfter);
+		}
+		atomic_store_explicit(&ring->head, h + count, memory_order_release);
+		buffer += count;
+		remaining -= count;
+
+		if (used == 0)
+			[director requestDrain:kDrainSoon];
+		if (used < kOutputHighWater && used + count >= kOutputHighWater)
+			[director requestDrain:kDrainNow];
 	}
 	return size;
 }
 
+/**
+ * Function that replaces stdout->_write and forwards stdout to g_stdoutDirector.
+ */
+int stdoutwrite(void * inFD, const char * buffer, int size)
+{
+	return ringwrite(g_stdoutDirector, &g_stdoutRing, buffer, size);
+}
+
 /**
  * Function that replaces stderr->_write and forwards stderr to g_stderrDirector.
  */
 int stderrwrite(void * inFD, const char * buffer, int size)
 {
-	@autoreleasepool
+	return ringwrite(g_stderrDirector, &g_stderrRing, buffer, size);
+}
+
+/**
+ * Returns the length of a UTF-8 byte sequence up to (not including) any
+ * incomplete character at its end.
+ */
+static NSUInteger completeUTF8Length(const unsigned char * bytes, NSUInteger length)
+{
+	for (NSUInteger i = length; i > 0 && i + 4 > length; --i)
 	{
-		NSData * data = [[NSData alloc] initWithBytes:buffer length:size];
-		[g_stderrDirector performSelectorOnMainThread:@selector(forwardOutput:) withObject:data waitUntilDone:NO];
+		unsigned char ch = bytes[i-1];
+		if ((ch & 0xC0) == 0x80)
+			continue;	// continuation byte -- keep looking for its lead
+		NSUInteger seqLen = ch >= 0xF0 ? 4 : ch >= 0xE0 ? 3 : ch >= 0xC0 ? 2 : 1;
+		return (i - 1 + seqLen > length) ? i - 1 : length;
 	}
-	return size;
+	return length;
 }
 
 @implementation NTXOutputRedirect
@@ -112,6 +207,33 @@ int stderrwrite(void * inFD, const char * buffer, int size)
 		forwardingSelector = aSelector;
 		stream = aStream;
 		oldWriteFunc = NULL;
+		ring = aStream == stdout ? &g_stdoutRing : &g_stderrRing;
+		partial = [[NSMutableData alloc] init];
+		isDrainScheduled = NO;
+
+		NTXOutputRedirect *__weak weakself = self;
+		drainSignal = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, dispatch_get_main_queue());
+		dispatch_source_set_event_handler(drainSignal, ^{
+			NTXOutputRedirect * strongself = weakself;
+			if (strongself == nil)
+				return;
+			if (dispatch_source_get_data(strongself->drainSignal) & kDrainNow)
+				[strongself drain];
+			else if (!strongself->isDrainScheduled)
+			{
+				// wait a little to gather more output
+				strongself->isDrainScheduled = YES;
+				dispatch_after(dispatch_time(DISPATCH_TIME_NOW, kOutputDrainDelay * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+					NTXOutputRedirect * director = weakself;
+					if (director)
+					{
+						director->isDrainScheduled = NO;
+						[director drain];
+					}
+				});
+			}
+		});
+		dispatch_resume(drainSignal);
 	}
 	return self;
 }
@@ -138,18 +260,70 @@ int stderrwrite(void * inFD, const char * buffer, int size)
 {
 	if (oldWriteFunc)
 	{
+		fflush(stream);
 		stream->_write = oldWriteFunc;
 		oldWriteFunc = NULL;
+		[self drain];
 	}
 }
 
 /**
- * Called from @c stdoutwrite() and @c stderrwrite() to forward the output to 
- * listeners.
+ * Asks the main thread to drain the ring. Called from @c ringwrite() on
+ * any thread.
+ */
+- (void)requestDrain:(unsigned long)urgency
+{
+	dispatch_source_merge_data(drainSignal, urgency);
+}
+
+/**
+ * Takes everything in the ring and forwards it to the listener in one go.
+ * Runs on the main thread.
+ */
+- (void)drain
+{
+	uint64_t t = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint64_t h = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (h == t)
+		return;
+
+	size_t count = (size_t)(h - t);
+	size_t index = (size_t)(t % kOutputRingSize);
+	size_t spaceAfter = kOutputRingSize - index;
+	if (count <= spaceAfter)
+		[partial appendBytes:ring->data + index length:count];
+	else
+	{
+		[partial appendBytes:ring->data + index length:spaceAfter];
+		[partial appendBytes:ring->data length:count - spaceAfter];
+	}
+	atomic_store_explicit(&ring->tail, h, memory_order_release);
+
+	[self forwardOutput:partial];
+
+	uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+	if (dropped > 0)
+		[listener performSelector:forwardingSelector withObject:[NSString stringWithFormat:@"\n[%llu bytes of output dropped]\n", dropped]];
+
+	// a write that raced with us may not have asked for another drain
+	if (atomic_load_explicit(&ring->head, memory_order_acquire) != h)
+		[self requestDrain:kDrainSoon];
+}
+
+/**
+ * Called from @c drain to forward the output to listeners. Any incomplete
+ * UTF-8 character at the end is left in data for next time.
  */ 
-- (void)forwardOutput:(NSData *)data
+- (void)forwardOutput:(NSMutableData *)data
 {
-	NSString *string = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+	NSUInteger length = completeUTF8Length((const unsigned char *)data.bytes, data.length);
+	if (length == 0)
+		return;
+	NSString *string = [[NSString alloc] initWithBytes:data.bytes length:length encoding:NSUTF8StringEncoding];
+	if (string == nil)
+		// not UTF-8 after all; Newton text is MacRoman
+		string = [[NSString alloc] initWithBytes:data.bytes length:length encoding:NSMacOSRomanStringEncoding];
+	[data replaceBytesInRange:NSMakeRange(0, length) withBytes:NULL length:0];
 	[listener performSelector:forwardingSelector withObject:string];
 }
 
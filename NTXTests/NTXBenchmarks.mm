@@ -0,0 +1,217 @@
+/*
+	File:		NTXBenchmarks.mm
+
+	Contains:	Benchmarks for the NTX app.
+					They run as a unit test bundle hosted by the app, so the
+					NewtonScript environment is set up just as it is for a user, and
+					nothing in the app itself looks for them at launch.
+					Each benchmark writes its results as JSON to the folder named by
+					NTX_BENCHMARK_RESULTS (by default NTXBenchmarks in the temporary
+					folder). Benchmarks that need input take it from the environment
+					variables named below, and are skipped if those aren’t set.
+
+	Run them with   xcodebuild test -project NTX.xcodeproj -scheme NTX
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#import <XCTest/XCTest.h>
+#import "CommsBenchmark.h"
+#import "TraceCapture.h"
+#import "MNPSerialEndpoint.h"
+#import "ProtoRegistry.h"
+#import "NTXEditorView.h"
+#import "NTXDocument.h"
+#import "BatchImporter.h"
+#import "Utilities.h"
+
+
+/* -----------------------------------------------------------------------------
+	N T X B e n c h m a r k s
+----------------------------------------------------------------------------- */
+
+@interface NTXBenchmarks : XCTestCase
+@end
+
+
+@implementation NTXBenchmarks
+
+/* -----------------------------------------------------------------------------
+	Return the value of an environment variable as a file URL.
+	Args:		inName		variable name
+				isDir			the file is a folder
+	Return:	URL, nil if the variable isn’t set
+----------------------------------------------------------------------------- */
+
+- (NSURL *)urlFromEnvironment:(NSString *)inName isDirectory:(BOOL)isDir {
+	NSString * path = NSProcessInfo.processInfo.environment[inName];
+	if (path.length == 0) {
+		NSLog(@"%@ not set; skipping %@", inName, self.name);
+		return nil;
+	}
+	return [NSURL fileURLWithPath:path.stringByExpandingTildeInPath isDirectory:isDir];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Write benchmark results to the results folder.
+	Args:		inResults	JSON-able results
+				inName		file name, without extension
+	Return:	--
+----------------------------------------------------------------------------- */
+
+- (void)writeResults:(NSDictionary *)inResults name:(NSString *)inName {
+	XCTAssertNotNil(inResults);
+	NSString * folder = NSProcessInfo.processInfo.environment[@"NTX_BENCHMARK_RESULTS"];
+	NSURL * folderURL = folder.length > 0 ? [NSURL fileURLWithPath:folder.stringByExpandingTildeInPath isDirectory:YES]
+													  : [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"NTXBenchmarks"] isDirectory:YES];
+	[NSFileManager.defaultManager createDirectoryAtURL:folderURL withIntermediateDirectories:YES attributes:nil error:NULL];
+	NSURL * url = [folderURL URLByAppendingPathComponent:[inName stringByAppendingPathExtension:@"json"]];
+	NSError * error = nil;
+	NSData * json = [NSJSONSerialization dataWithJSONObject:inResults options:NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error:&error];
+	XCTAssertTrue(json != nil && [json writeToURL:url options:NSDataWritingAtomic error:&error], @"%@", error);
+	NSLog(@"%@ results written to %@", inName, url.path);
+}
+
+
+#pragma mark Comms
+/* -----------------------------------------------------------------------------
+	CRC, page buffer, MNP framing and the toolkit protocol against the mock
+	Newton.
+----------------------------------------------------------------------------- */
+
+- (void)testCommsStack {
+	NCCommsBenchmark * benchmark = [[NCCommsBenchmark alloc] init];
+	[self writeResults:[benchmark run] name:@"CommsBenchmark"];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Replay a link capture through the MNP receive path.
+	NTX_TRACE_REPLAY						capture file
+	NTX_TRACE_REPLAY_REALTIME=1		keep the capture’s original timing
+----------------------------------------------------------------------------- */
+
+- (void)testTraceReplay {
+	NSURL * url = [self urlFromEnvironment:@"NTX_TRACE_REPLAY" isDirectory:NO];
+	if (url == nil)
+		return;
+	BOOL isRealTime = [NSProcessInfo.processInfo.environment[@"NTX_TRACE_REPLAY_REALTIME"] boolValue];
+	NCTraceReplay * replay = [[NCTraceReplay alloc] initWithURL:url];
+	XCTAssertTrue(replay.isValid, @"%@ is not a link capture", url.path);
+	NCError err = [replay replayInto:[[MNPSerialEndpoint alloc] init] stream:nil realTime:isRealTime];
+	XCTAssertEqual(err, noErr);
+	[self writeResults:@{ @"capture":url.path,
+								 @"realTime":@(isRealTime),
+								 @"records":@(replay.recordsReplayed),
+								 @"bytesReplayed":@(replay.bytesReplayed),
+								 @"bytesUnframed":@(replay.bytesUnframed),
+								 @"receiveTime":@(replay.receiveTime) } name:@"TraceReplay"];
+}
+
+
+#pragma mark Build
+/* -----------------------------------------------------------------------------
+	Resolve 10 .. 10,000 user protos.
+----------------------------------------------------------------------------- */
+
+- (void)testProtoRegistry {
+	[self writeResults:[NTXProtoRegistry benchmark] name:@"ProtoRegistryBenchmark"];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Count native code module unflattens over repeated builds.
+	NTX_NATIVE_CODE_FOLDER		folder of native code modules
+----------------------------------------------------------------------------- */
+
+- (void)testNativeCodeBuilding {
+	NSURL * url = [self urlFromEnvironment:@"NTX_NATIVE_CODE_FOLDER" isDirectory:YES];
+	if (url == nil)
+		return;
+	[self writeResults:[NTXNativeCodeDocument benchmarkBuilding:url] name:@"NativeCodeBuildBenchmark"];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Build a layout twice; the second build should compile nothing.
+	NTX_LAYOUT			layout file
+----------------------------------------------------------------------------- */
+
+- (void)testLayoutBuilding {
+	NSURL * url = [self urlFromEnvironment:@"NTX_LAYOUT" isDirectory:NO];
+	if (url == nil)
+		return;
+	NSDictionary * results = [NTXLayoutDocument benchmarkBuilding:url];
+	XCTAssertNotNil(results, @"can’t open %@", url.path);
+	XCTAssertEqualObjects(results[@"second"][@"compiles"], @0);
+	[self writeResults:results name:@"LayoutBuildBenchmark"];
+}
+
+
+#pragma mark Editing
+/* -----------------------------------------------------------------------------
+	Replay keystrokes through the editor.
+	NTX_KEY_REPLAY			key script
+----------------------------------------------------------------------------- */
+
+- (void)testKeyReplay {
+	NSURL * url = [self urlFromEnvironment:@"NTX_KEY_REPLAY" isDirectory:NO];
+	if (url == nil)
+		return;
+	NSString * script = [NSString stringWithContentsOfURL:url encoding:NSUTF8StringEncoding error:NULL];
+	XCTAssertNotNil(script, @"can’t read %@", url.path);
+	if (script)
+		[self writeResults:[NTXEditorView benchmarkKeystrokes:script] name:@"KeyReplayBenchmark"];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Print a stream document.
+	NTX_STREAM			stream file; a sample stream is made if it doesn’t exist
+----------------------------------------------------------------------------- */
+
+- (void)testStreamPrinting {
+	NSURL * url = [self urlFromEnvironment:@"NTX_STREAM" isDirectory:NO];
+	if (url == nil)
+		url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"NTXBenchmarks.newtonstream"]];
+	[self writeResults:[NTXStreamDocument benchmarkPrinting:url] name:@"StreamPrintBenchmark"];
+}
+
+
+/* -----------------------------------------------------------------------------
+	Check text conversion against NSString’s, and time it.
+----------------------------------------------------------------------------- */
+
+- (void)testTextConversion {
+	NSDictionary * results = BenchmarkTextConversion();
+	XCTAssertEqualObjects(results[@"mismatches"], @0);
+	[self writeResults:results name:@"TextConvertBenchmark"];
+}
+
+
+#pragma mark Import
+/* -----------------------------------------------------------------------------
+	Convert a tree of legacy Mac NTK projects.
+	NTX_BATCH_IMPORT					folder of projects
+	NTX_BATCH_IMPORT_DESTINATION	folder for the converted projects; by default
+											beside the source, with “ (NTX)” appended
+----------------------------------------------------------------------------- */
+
+- (void)testBatchImport {
+	NSURL * sourceURL = [self urlFromEnvironment:@"NTX_BATCH_IMPORT" isDirectory:YES];
+	if (sourceURL == nil)
+		return;
+	NSString * destinationPath = NSProcessInfo.processInfo.environment[@"NTX_BATCH_IMPORT_DESTINATION"];
+	NSURL * destinationURL = destinationPath.length > 0 ? [NSURL fileURLWithPath:destinationPath.stringByExpandingTildeInPath isDirectory:YES]
+																		 : [sourceURL.URLByDeletingLastPathComponent URLByAppendingPathComponent:[sourceURL.lastPathComponent stringByAppendingString:@" (NTX)"] isDirectory:YES];
+	NTXBatchImporter * importer = [[NTXBatchImporter alloc] initWithSource:sourceURL destination:destinationURL];
+	XCTestExpectation * imported = [self expectationWithDescription:@"import"];
+	[importer runWithCompletion:^(NSDictionary * inReport) {
+		[self writeResults:inReport name:@"ImportReport"];
+		[imported fulfill];
+	}];
+	[self waitForExpectationsWithTimeout:3600.0 handler:nil];
+}
+
+@end
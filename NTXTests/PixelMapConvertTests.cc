@@ -0,0 +1,204 @@
+/*
+	File:		PixelMapConvertTests.cc
+
+	Contains:	Tests of PixelMap expansion.
+					Small golden images, worked out by hand, pin down the gray levels
+					and pixel order of every depth and of the mask. Then random images
+					of every depth, width up to well past one SIMD block, and padded
+					rows are checked against a naive per-pixel reference. Last, a
+					screen-sized image is expanded repeatedly to give a throughput
+					figure; that is reported, not checked.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#include "PixelMapConvert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static int gFailures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+			++gFailures; \
+		} \
+	} while (0)
+
+
+/* -----------------------------------------------------------------------------
+	Reference expansion: one pixel at a time.
+----------------------------------------------------------------------------- */
+
+static uint8_t
+ReferencePixel(const uint8_t * inRow, unsigned inDepth, unsigned inX)
+{
+	unsigned bit = inX * inDepth;
+	unsigned maxValue = (1 << inDepth) - 1;
+	unsigned value = (inRow[bit / 8] >> (8 - inDepth - bit % 8)) & maxValue;
+	return 255 - (value * 255) / maxValue;
+}
+
+
+static void
+ReferenceGray(const uint8_t * inBits, size_t inRowBytes, unsigned inDepth, unsigned inWidth, unsigned inHeight, uint8_t * outGray)
+{
+	for (unsigned y = 0; y < inHeight; ++y)
+		for (unsigned x = 0; x < inWidth; ++x)
+			outGray[y * inWidth + x] = ReferencePixel(inBits + y * inRowBytes, inDepth, x);
+}
+
+
+static void
+ReferenceRGBA(const uint8_t * inBits, size_t inRowBytes, unsigned inDepth, const uint8_t * inMask, size_t inMaskRowBytes,
+				  unsigned inWidth, unsigned inHeight, uint8_t * outRGBA)
+{
+	for (unsigned y = 0; y < inHeight; ++y)
+		for (unsigned x = 0; x < inWidth; ++x) {
+			uint8_t gray = ReferencePixel(inBits + y * inRowBytes, inDepth, x);
+			bool isOpaque = inMask == NULL || ReferencePixel(inMask + y * inMaskRowBytes, 1, x) == 0;
+			uint8_t * dst = outRGBA + 4 * (y * inWidth + x);
+			dst[0] = dst[1] = dst[2] = isOpaque ? gray : 0;
+			dst[3] = isOpaque ? 0xFF : 0;
+		}
+}
+
+
+#pragma mark Golden images
+/* -----------------------------------------------------------------------------
+	Expand a small image and compare it with the expected gray levels.
+----------------------------------------------------------------------------- */
+
+static void
+CheckGolden(const char * inName, const uint8_t * inBits, size_t inRowBytes, unsigned inDepth,
+				unsigned inWidth, unsigned inHeight, const uint8_t * inExpected)
+{
+	std::vector<uint8_t> gray(inWidth * inHeight, 0x5A);
+	CHECK(ExpandPixelMapToGray(inBits, inRowBytes, inDepth, inWidth, inHeight, gray.data(), inWidth), "%s: rejected", inName);
+	CHECK(memcmp(gray.data(), inExpected, gray.size()) == 0, "%s: wrong pixels", inName);
+}
+
+
+static void
+TestGoldenImages(void)
+{
+	// 1 bit, 10 pixels wide so the last byte is partial; rows padded to 4 bytes
+	static const uint8_t bits1[] = { 0xB0, 0x40, 0xEE, 0xEE,
+												0x0F, 0xC0, 0xEE, 0xEE };
+	static const uint8_t gray1[] = {   0, 255,   0,   0, 255, 255, 255, 255, 255,   0,
+												255, 255, 255, 255,   0,   0,   0,   0,   0,   0 };
+	CheckGolden("1-bit", bits1, 4, 1, 10, 2, gray1);
+
+	// 2 bit: white, light gray, dark gray, black, and a partial byte
+	static const uint8_t bits2[] = { 0x1B, 0xE4 };
+	static const uint8_t gray2[] = { 255, 170, 85, 0, 0, 85 };
+	CheckGolden("2-bit", bits2, 2, 2, 6, 1, gray2);
+
+	// 4 bit: 255 - 17 * value
+	static const uint8_t bits4[] = { 0x0F, 0x5A, 0x80 };
+	static const uint8_t gray4[] = { 255, 0, 170, 85, 119 };
+	CheckGolden("4-bit", bits4, 3, 4, 5, 1, gray4);
+
+	// 8 bit: 255 - value
+	static const uint8_t bits8[] = { 0x00, 0x01, 0x80, 0xFF };
+	static const uint8_t gray8[] = { 255, 254, 127, 0 };
+	CheckGolden("8-bit", bits8, 4, 8, 4, 1, gray8);
+
+	// masked: black opaque, white opaque, black transparent, white transparent
+	static const uint8_t bitsRGBA[] = { 0xA0 };
+	static const uint8_t maskRGBA[] = { 0xC0 };
+	static const uint8_t rgba[] = {   0,   0,   0, 255,
+											  255, 255, 255, 255,
+												 0,   0,   0,   0,
+												 0,   0,   0,   0 };
+	uint8_t out[16];
+	memset(out, 0x5A, sizeof(out));
+	CHECK(ExpandPixelMapToRGBA(bitsRGBA, 1, 1, maskRGBA, 1, 4, 1, out, 16), "RGBA: rejected");
+	CHECK(memcmp(out, rgba, sizeof(out)) == 0, "RGBA: wrong pixels");
+
+	// what we can’t expand
+	uint8_t dst[64];
+	CHECK(!ExpandPixelMapToGray(bits8, 4, 3, 4, 1, dst, 4), "depth 3 accepted");
+	CHECK(!ExpandPixelMapToGray(bits8, 1, 1, 10, 1, dst, 10), "short rows accepted");
+	CHECK(!ExpandPixelMapToGray(bits8, 4, 8, 4, 1, dst, 3), "short destination rows accepted");
+}
+
+
+#pragma mark Reference
+/* -----------------------------------------------------------------------------
+	Random images against the reference.
+----------------------------------------------------------------------------- */
+
+static void
+TestAgainstReference(void)
+{
+	srand(49);
+	const unsigned depths[] = { 1, 2, 4, 8 };
+	for (unsigned depth : depths) {
+		for (unsigned width = 1; width <= 300; width += (width < 40 ? 1 : 13)) {
+			for (unsigned padding = 0; padding <= 5; padding += 5) {
+				const unsigned height = 3;
+				size_t rowBytes = ((size_t)width * depth + 7) / 8 + padding;
+				size_t maskRowBytes = (width + 7) / 8 + padding;
+				std::vector<uint8_t> bits(rowBytes * height), mask(maskRowBytes * height);
+				for (uint8_t & b : bits)
+					b = rand();
+				for (uint8_t & b : mask)
+					b = rand();
+
+				std::vector<uint8_t> gray(width * height), expectedGray(width * height);
+				ReferenceGray(bits.data(), rowBytes, depth, width, height, expectedGray.data());
+				CHECK(ExpandPixelMapToGray(bits.data(), rowBytes, depth, width, height, gray.data(), width)
+					&& gray == expectedGray, "gray: depth %u, width %u, rowBytes %zu", depth, width, rowBytes);
+
+				std::vector<uint8_t> rgba(4 * width * height), expectedRGBA(4 * width * height);
+				ReferenceRGBA(bits.data(), rowBytes, depth, mask.data(), maskRowBytes, width, height, expectedRGBA.data());
+				CHECK(ExpandPixelMapToRGBA(bits.data(), rowBytes, depth, mask.data(), maskRowBytes, width, height, rgba.data(), 4 * width)
+					&& rgba == expectedRGBA, "RGBA: depth %u, width %u, rowBytes %zu", depth, width, rowBytes);
+			}
+		}
+	}
+}
+
+
+#pragma mark Throughput
+/* -----------------------------------------------------------------------------
+	Expand a MessagePad-sized screen at each depth and report megapixels per
+	second.
+----------------------------------------------------------------------------- */
+
+static void
+ReportThroughput(void)
+{
+	const unsigned width = 320, height = 480, passes = 200;
+	const unsigned depths[] = { 1, 2, 4, 8 };
+	for (unsigned depth : depths) {
+		size_t rowBytes = (width * depth + 7) / 8;
+		std::vector<uint8_t> bits(rowBytes * height), gray(width * height);
+		for (uint8_t & b : bits)
+			b = rand();
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < passes; ++i)
+			ExpandPixelMapToGray(bits.data(), rowBytes, depth, width, height, gray.data(), width);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		printf("%u-bit: %.0f Mpixel/s\n", depth, (double)width * height * passes / elapsed.count() / 1e6);
+	}
+}
+
+
+int
+main(int argc, const char * argv[])
+{
+	TestGoldenImages();
+	TestAgainstReference();
+	ReportThroughput();
+	if (gFailures > 0)
+		fprintf(stderr, "%d failures\n", gFailures);
+	return gFailures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+/*
+	File:		TextConvertTests.cc
+
+	Contains:	Tests of text conversion.
+					Known MacRoman characters, and ill-formed UTF-8 and unpaired
+					surrogates, are checked against hand-worked results. Then random
+					text -- mostly ASCII, so that both the sixteen-at-a-time and the
+					character-at-a-time paths are taken, and the switch between them
+					lands everywhere in a block -- is checked against a per-character
+					reference, and round-tripped.
+
+	Written by:	Newton Research Group, 2018.
+*/
+
+#include "TextConvert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static int gFailures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+			++gFailures; \
+		} \
+	} while (0)
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<TextChar> Chars;
+
+
+/* -----------------------------------------------------------------------------
+	Conversions into vectors, checking that the count-only call agrees.
+----------------------------------------------------------------------------- */
+
+static Chars
+ToUniChar(const Bytes & inStr)
+{
+	size_t len = UTF8ToUniChar(inStr.data(), inStr.size(), NULL);
+	Chars str(len + 1, 0x5A5A);
+	CHECK(UTF8ToUniChar(inStr.data(), inStr.size(), str.data()) == len, "UTF-8 count differs");
+	CHECK(str[len] == 0x5A5A, "UTF-8 conversion overran");
+	str.resize(len);
+	return str;
+}
+
+
+static Bytes
+ToUTF8(const Chars & inStr)
+{
+	size_t len = UniCharToUTF8(inStr.data(), inStr.size(), NULL);
+	Bytes str(len + 1, 0x5A);
+	CHECK(UniCharToUTF8(inStr.data(), inStr.size(), str.data()) == len, "UniChar count differs");
+	CHECK(str[len] == 0x5A, "UniChar conversion overran");
+	str.resize(len);
+	return str;
+}
+
+
+#pragma mark Reference
+/* -----------------------------------------------------------------------------
+	Reference conversions: one character at a time, with the same treatment
+	of ill-formed text -- each byte of a bad sequence is one replacement.
+----------------------------------------------------------------------------- */
+
+static Chars
+ReferenceToUniChar(const Bytes & inStr)
+{
+	Chars str;
+	for (size_t i = 0; i < inStr.size(); ) {
+		uint8_t lead = inStr[i];
+		size_t seqLen = lead < 0x80 ? 1 : lead < 0xC2 ? 0 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF5 ? 4 : 0;
+		uint32_t ch = seqLen == 1 ? lead : lead & (0x7F >> seqLen);
+		bool isValid = seqLen > 0 && i + seqLen <= inStr.size();
+		for (size_t j = 1; isValid && j < seqLen; ++j) {
+			isValid = (inStr[i + j] & 0xC0) == 0x80;
+			ch = (ch << 6) | (inStr[i + j] & 0x3F);
+		}
+		static const uint32_t minChar[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if (isValid)
+			isValid = ch >= minChar[seqLen] && ch <= 0x10FFFF && !(ch >= 0xD800 && ch <= 0xDFFF);
+		if (!isValid) {
+			str.push_back(kReplacementChar);
+			i += 1;
+		} else if (ch >= 0x10000) {
+			str.push_back(0xD800 + ((ch - 0x10000) >> 10));
+			str.push_back(0xDC00 + ((ch - 0x10000) & 0x3FF));
+			i += seqLen;
+		} else {
+			str.push_back(ch);
+			i += seqLen;
+		}
+	}
+	return str;
+}
+
+
+static Bytes
+ReferenceToUTF8(const Chars & inStr)
+{
+	Bytes str;
+	for (size_t i = 0; i < inStr.size(); ++i) {
+		uint32_t ch = inStr[i];
+		if (ch >= 0xDC00 && ch <= 0xDFFF)
+			ch = kReplacementChar;
+		else if (ch >= 0xD800 && ch <= 0xDBFF) {
+			if (i + 1 < inStr.size() && inStr[i+1] >= 0xDC00 && inStr[i+1] <= 0xDFFF)
+				ch = 0x10000 + ((ch - 0xD800) << 10) + (inStr[++i] - 0xDC00);
+			else
+				ch = kReplacementChar;
+		}
+		if (ch < 0x80)
+			str.push_back(ch);
+		else if (ch < 0x800) {
+			str.push_back(0xC0 | (ch >> 6));
+			str.push_back(0x80 | (ch & 0x3F));
+		} else if (ch < 0x10000) {
+			str.push_back(0xE0 | (ch >> 12));
+			str.push_back(0x80 | ((ch >> 6) & 0x3F));
+			str.push_back(0x80 | (ch & 0x3F));
+		} else {
+			str.push_back(0xF0 | (ch >> 18));
+			str.push_back(0x80 | ((ch >> 12) & 0x3F));
+			str.push_back(0x80 | ((ch >> 6) & 0x3F));
+			str.push_back(0x80 | (ch & 0x3F));
+		}
+	}
+	return str;
+}
+
+
+#pragma mark Known text
+/* -----------------------------------------------------------------------------
+	Hand-worked conversions.
+----------------------------------------------------------------------------- */
+
+static void
+CheckUTF8(const char * inName, const Bytes & inStr, const Chars & inExpected)
+{
+	CHECK(ToUniChar(inStr) == inExpected, "UTF-8 => UniChar: %s", inName);
+}
+
+
+static void
+TestKnownText(void)
+{
+	// MacRoman: ASCII is unchanged; a few from the high half
+	const uint8_t macRoman[] = { 'N', 'e', 'w', 't', 'o', 'n', 0x80, 0xA5, 0xDB, 0xF0, 0xCA, 0xFF };
+	const TextChar uniChars[] = { 'N', 'e', 'w', 't', 'o', 'n', 0x00C4, 0x2022, 0x20AC, 0xF8FF, 0x00A0, 0x02C7 };
+	TextChar converted[sizeof(macRoman)];
+	CHECK(MacRomanToUniChar(macRoman, sizeof(macRoman), converted) == sizeof(macRoman), "MacRoman count");
+	CHECK(memcmp(converted, uniChars, sizeof(uniChars)) == 0, "MacRoman => UniChar");
+
+	// well-formed UTF-8 of each length
+	CheckUTF8("well-formed", { 'A', 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x8D, 0x8E },
+				 { 'A', 0x00E9, 0x20AC, 0xD83C, 0xDF4E });
+	// ill-formed: one replacement per byte
+	CheckUTF8("overlong 2", { 0xC0, 0x80 }, { 0xFFFD, 0xFFFD });
+	CheckUTF8("overlong 3", { 0xE0, 0x82, 0x80 }, { 0xFFFD, 0xFFFD, 0xFFFD });
+	CheckUTF8("overlong 4", { 0xF0, 0x8F, 0xBF, 0xBF }, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD });
+	CheckUTF8("surrogate", { 0xED, 0xA0, 0x80 }, { 0xFFFD, 0xFFFD, 0xFFFD });
+	CheckUTF8("out of range", { 0xF4, 0x90, 0x80, 0x80 }, { 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD });
+	CheckUTF8("bad trail", { 0xE2, 0x82, 'A' }, { 0xFFFD, 0xFFFD, 'A' });
+	CheckUTF8("truncated", { 'A', 0xE2, 0x82 }, { 'A', 0xFFFD, 0xFFFD });
+
+	// unpaired surrogates
+	CHECK(ToUTF8({ 0xD800, 'A' }) == Bytes({ 0xEF, 0xBF, 0xBD, 'A' }), "unpaired high surrogate");
+	CHECK(ToUTF8({ 'A', 0xDC00 }) == Bytes({ 'A', 0xEF, 0xBF, 0xBD }), "unpaired low surrogate");
+	CHECK(ToUTF8({ 0xD83C, 0xDF4E }) == Bytes({ 0xF0, 0x9F, 0x8D, 0x8E }), "surrogate pair");
+
+	// nothing
+	CHECK(UTF8ToUniChar(NULL, 0, NULL) == 0 && UniCharToUTF8(NULL, 0, NULL) == 0, "empty text");
+}
+
+
+#pragma mark Random text
+/* -----------------------------------------------------------------------------
+	Random text against the reference.
+----------------------------------------------------------------------------- */
+
+static TextChar
+RandomChar(void)
+{
+	switch (rand() % 24) {
+	case 0:	return 0x80 + rand() % 0x780;			// two bytes in UTF-8
+	case 1:	return 0x800 + rand() % 0xD000;		// three, may be a surrogate
+	case 2:	return 0x0A;
+	default:	return 0x20 + rand() % 0x5F;
+	}
+}
+
+
+static void
+TestRandomText(void)
+{
+	srand(50);
+	for (int pass = 0; pass < 2000; ++pass) {
+		size_t len = rand() % 100;
+
+		// UniChar => UTF-8 => UniChar
+		Chars str(len);
+		for (TextChar & ch : str)
+			ch = RandomChar();
+		Bytes utf8 = ToUTF8(str);
+		CHECK(utf8 == ReferenceToUTF8(str), "UniChar => UTF-8, length %zu", len);
+		Chars roundTrip = ToUniChar(utf8);
+		CHECK(roundTrip == ReferenceToUniChar(utf8), "UTF-8 => UniChar, length %zu", len);
+		bool hasSurrogate = false;
+		for (TextChar ch : str)
+			hasSurrogate = hasSurrogate || (ch >= 0xD800 && ch <= 0xDFFF);
+		CHECK(hasSurrogate || roundTrip == str, "round trip, length %zu", len);
+
+		// arbitrary bytes, mostly ASCII
+		Bytes bytes(len);
+		for (uint8_t & b : bytes)
+			b = rand() % 8 == 0 ? 0x80 + rand() % 0x80 : 0x20 + rand() % 0x5F;
+		CHECK(ToUniChar(bytes) == ReferenceToUniChar(bytes), "bytes => UniChar, length %zu", len);
+
+		// MacRoman: ASCII unchanged, everything else one UniChar
+		Chars wide(len);
+		MacRomanToUniChar(bytes.data(), len, wide.data());
+		for (size_t i = 0; i < len; ++i)
+			CHECK(bytes[i] < 0x80 ? wide[i] == bytes[i] : wide[i] >= 0xA0, "MacRoman %02X => %04X", bytes[i], wide[i]);
+
+		// line endings
+		Chars lines(str);
+		size_t numOfLFs = 0;
+		for (TextChar ch : str)
+			numOfLFs += (ch == 0x0A);
+		CHECK(ConvertLineEndings(lines.data(), len) == numOfLFs, "line ending count, length %zu", len);
+		for (size_t i = 0; i < len; ++i)
+			CHECK(lines[i] == (str[i] == 0x0A ? 0x0D : str[i]), "line ending at %zu", i);
+	}
+}
+
+
+int
+main(int argc, const char * argv[])
+{
+	TestKnownText();
+	TestRandomText();
+	if (gFailures > 0)
+		fprintf(stderr, "%d failures\n", gFailures);
+	return gFailures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}